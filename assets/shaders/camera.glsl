@@ -0,0 +1,14 @@
+// Per-frame camera data, shared by every shader transforming or reconstructing view-space positions.
+// Filled once per frame by Renderer::renderEntities; see CameraUniforms in renderer.hpp.
+// Included through ResourceManager::loadShader.
+
+
+// --- Uniform Buffers
+layout(std140, binding = 0) uniform CameraUniforms {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 inverseProjectionMatrix;
+    vec2 bufferSize;    // Framebuffer width and height, in pixels
+    float nearPlane;
+    float farPlane;
+};
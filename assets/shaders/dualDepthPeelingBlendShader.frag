@@ -0,0 +1,21 @@
+#version 460 core
+
+
+// --- Input
+in vec2 texCoords;
+
+// --- Output
+out vec4 fragColor;
+
+// --- Uniforms
+layout(binding = 0) uniform sampler2D backBuffer;
+
+
+// --- Main function
+void main(void) {
+    // Fetch back layers' premultiplied color and transmittance
+    vec4 back = texture(backBuffer, texCoords);
+
+    // Output opacity in place of transmittance, as expected by front-to-back blending
+    fragColor = vec4(back.rgb, 1.0 - back.a);
+}
@@ -0,0 +1,91 @@
+#version 460 core
+
+
+// --- Includes
+#include "camera.glsl"
+#include "pass.glsl"
+#include "materials.glsl"
+
+// --- Permutations, picked by Renderer
+// FIRST_PEEL: initialization pass, storing nearest and farthest depths only
+
+// --- Constants
+// Values which leave a render target untouched under GL_MAX blending
+const float EMPTY_DEPTH = -1.0;
+const float EMPTY_NORMAL = -65504.0;
+
+// --- Render targets
+layout (location = 0) out vec2 minMaxDepth;
+layout (location = 1) out vec3 gFrontNormal;
+layout (location = 2) out vec4 gFrontDiffuse;
+layout (location = 3) out vec3 gFrontRoughnessMetalnessAO;
+layout (location = 4) out vec3 gBackNormal;
+layout (location = 5) out vec4 gBackDiffuse;
+layout (location = 6) out vec3 gBackRoughnessMetalnessAO;
+
+// --- Input
+in vec3 vPosition;
+in vec3 vNormal;
+flat in int vMaterialID;
+
+// --- Uniforms
+layout(binding = 0) uniform sampler2D previousMinMaxDepth;
+layout(binding = 1) uniform sampler2D opaqueDepth;
+
+
+// --- Main function
+void main(void) {
+    // Fetch this instance's material
+    Material material = fetchMaterial(vMaterialID);
+
+    vec2 texCoord = gl_FragCoord.xy / bufferSize;
+    float depth = gl_FragCoord.z;
+
+    // Discard if covered by opaque fragment
+    if (depth >= texture(opaqueDepth, texCoord).r)
+        discard;
+
+    // Leave every target untouched by default
+    minMaxDepth = vec2(EMPTY_DEPTH);
+    gFrontNormal = vec3(EMPTY_NORMAL);
+    gFrontDiffuse = vec4(0.0);
+    gFrontRoughnessMetalnessAO = vec3(0.0);
+    gBackNormal = vec3(EMPTY_NORMAL);
+    gBackDiffuse = vec4(0.0);
+    gBackRoughnessMetalnessAO = vec3(0.0);
+
+    // Initialization pass: only store nearest and farthest depths
+#if defined(FIRST_PEEL)
+    minMaxDepth = vec2(-depth, depth);
+    return;
+#endif
+
+    // Fetch layers peeled by the previous pass
+    vec2 previousDepth = texture(previousMinMaxDepth, texCoord).rg;
+    float nearestDepth = -previousDepth.r;
+    float farthestDepth = previousDepth.g;
+
+    // Discard if already peeled
+    if (depth < nearestDepth || depth > farthestDepth)
+        discard;
+
+    // Inner fragments contribute to the next pass' nearest and farthest depths
+    if (depth > nearestDepth && depth < farthestDepth) {
+        minMaxDepth = vec2(-depth, depth);
+        return;
+    }
+
+    // Store surface data on the front G-buffer if this is the nearest layer, on the back one otherwise
+    // When a single layer is left, nearest and farthest depths match and the front G-buffer gets it.
+    vec3 normal = normalize(vNormal);
+    vec3 roughnessMetalnessAO = vec3(material.roughness, material.metalness, material.ambientOcclusion);
+    if (depth == nearestDepth) {
+        gFrontNormal = normal;
+        gFrontDiffuse = material.diffuse;
+        gFrontRoughnessMetalnessAO = roughnessMetalnessAO;
+    } else {
+        gBackNormal = normal;
+        gBackDiffuse = material.diffuse;
+        gBackRoughnessMetalnessAO = roughnessMetalnessAO;
+    }
+}
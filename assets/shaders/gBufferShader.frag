@@ -1,13 +1,17 @@
 #version 460 core
 
 
-// --- Struct definitions
-struct Material {
-    vec4 diffuse;
-    float roughness;
-    float metalness;
-    float ambientOcclusion;
-};
+// --- Includes
+#include "camera.glsl"
+#include "pass.glsl"
+#include "packing.glsl"
+#include "materials.glsl"
+
+// --- Permutations, picked by Renderer
+// DEPTH_PEELING: keep only fragments in front of opaque ones and behind the previous peel
+// FIRST_PEEL: along with DEPTH_PEELING, there is no previous peel to test against
+// OCTAHEDRAL_NORMALS: store octahedral-encoded normals, in compact G-buffers
+// MATERIAL_IDS: store material IDs in place of gDiffuse
 
 // --- Render targets
 layout (location = 0) out vec3 gPosition;
@@ -18,39 +22,63 @@ layout (location = 3) out vec3 gRoughnessMetalnessAO;
 // --- Input
 in vec3 vPosition;
 in vec3 vNormal;
+flat in int vMaterialID;
+flat in int vInstance;
 
 // --- Uniforms
-uniform bool executeDepthPeeling;
-uniform bool firstPass;
-uniform sampler2D previousDepth;
-uniform sampler2D opaqueDepth;
-uniform float bufferWidth;
-uniform float bufferHeight;
-uniform Material material;
+layout(binding = 0) uniform sampler2D previousDepth;
+layout(binding = 1) uniform sampler2D opaqueDepth;
+
+// --- Shader Storage Buffers
+#if defined(DEPTH_PEELING)
+// Per instance, one flag per peel telling whether any of its fragments got past the peel's tests
+// Read back by Renderer::readPeelSamples, a frame later, to leave instances out of the peels past their last layer.
+// MAX_PEELS is defined from RENDERER_DEPTHPEELING_MAXPASSES.
+layout(std430, binding = 7) writeonly buffer PeelSamples {
+    uint peelSamples[];
+};
+#endif
 
 
 // --- Main function
 void main(void) {
     // Depth peeling
-    if (executeDepthPeeling) {
-        vec2 texCoord = vec2(float(gl_FragCoord.x) / bufferWidth, float(gl_FragCoord.y) / bufferHeight);
-        
-        // Peel depth layer
-        if (!firstPass && gl_FragCoord.z <= texture(previousDepth, texCoord).r)
-            discard;
-
-        // Discard if covered by opaque fragment
-        if (gl_FragCoord.z >= texture(opaqueDepth, texCoord).r)
-            discard;
-    }
+#if defined(DEPTH_PEELING)
+    vec2 texCoord = gl_FragCoord.xy / bufferSize;
+
+    // Peel depth layer
+#if !defined(FIRST_PEEL)
+    if (gl_FragCoord.z <= texture(previousDepth, texCoord).r)
+        discard;
+#endif
+
+    // Discard if covered by opaque fragment
+    if (gl_FragCoord.z >= texture(opaqueDepth, texCoord).r)
+        discard;
+
+    // Flag the instance as still having layers to peel; every fragment writes the same value, so no atomic is needed
+    peelSamples[vInstance * MAX_PEELS + peel] = 1u;
+#endif
 
     // Store fragment's position in view-space
     gPosition = vPosition;
 
     // Store fragment's normal in view-space
+    // The compact G-buffer keeps only two octahedral-encoded components.
+#if defined(OCTAHEDRAL_NORMALS)
+    gNormal = vec3(encodeOctahedral(normalize(vNormal)), 0.0);
+#else
     gNormal = normalize(vNormal);
+#endif
+
+    // Store fragment's material ID only; the lighting pass fetches the material from the materials SSBO
+#if defined(MATERIAL_IDS)
+    gDiffuse = vec4(encodeMaterialID(vMaterialID), 0.0, 0.0, 0.0);
+    return;
+#endif
 
     // Store fragment's color
+    Material material = fetchMaterial(vMaterialID);
     gDiffuse = material.diffuse;
 
     // Store fragment's roughness
@@ -1,6 +1,9 @@
 #version 460 core
 
 
+// --- Includes
+#include "camera.glsl"
+
 // --- Attributes
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
@@ -8,23 +11,43 @@ layout (location = 1) in vec3 normal;
 // --- Output
 out vec3 vPosition;
 out vec3 vNormal;
-
-// --- Uniforms
-// Matrices
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
-uniform mat3 normalMatrix;
+flat out int vMaterialID;
+flat out int vInstance;
+
+// --- Struct definitions
+// DON'T USE VEC3 (nor MAT3): https://stackoverflow.com/questions/38172696/should-i-ever-use-a-vec3-inside-of-a-uniform-buffer-or-shader-storage-buffer-o
+struct InstanceTransform {
+    mat4 modelMatrix;
+    mat4 modelViewMatrix;
+    mat4 normalMatrix;  // View-space normal matrix, in the upper-left 3x3 block
+};
+
+// --- Shader Storage Buffers
+// Filled once per frame by TransformStage::update; see InstanceTransform in transform_stage.hpp
+// Draws point at their instances through their base instance, so that one multi-draw can cover many models.
+layout(std430, binding = 5) readonly buffer Transforms {
+    InstanceTransform transforms[];
+};
+// Filled by Renderer::buildRenderQueue, in the same order as transforms
+layout(std430, binding = 6) readonly buffer InstanceMaterials {
+    int instanceMaterials[];
+};
 
 
 // --- Main function
 void main() {    
+    // Fetch instance data
+    int instance = gl_BaseInstance + gl_InstanceID;
+    InstanceTransform transform = transforms[instance];
+    vMaterialID = instanceMaterials[instance];
+    vInstance = instance;
+
     // Store vertex position in view-space
-    vec4 vPosition4 = viewMatrix * modelMatrix * vec4(position, 1.0);
+    vec4 vPosition4 = transform.modelViewMatrix * vec4(position, 1.0);
     vPosition = vPosition4.xyz;
 
     // Store normal in view-space
-    vNormal = normalize(normalMatrix * normal);
+    vNormal = normalize(mat3(transform.normalMatrix) * normal);
 
     // Compute final position
     gl_Position = projectionMatrix * vPosition4;
@@ -0,0 +1,16 @@
+// Fixed-size k-buffer of transparent fragments, shared by the k-buffer geometry and resolve passes.
+// Included through ResourceManager::loadShader, which defines K_BUFFER_LAYERS, the layers kept per pixel, from
+// RENDERER_KBUFFER_LAYERS.
+
+
+// --- Includes
+#include "packing.glsl"
+
+// --- Images
+// Each layer stores a fragment packed as gBufferShader.frag would store it on the G-buffer (16 bytes per layer):
+//      x = window-space depth, floatBitsToUint; 1.0 marks an empty layer
+//      y = octahedral-encoded normal, packSnorm2x16
+//      z = diffuse, packUnorm4x8
+//      w = roughness + metalness + ambient occlusion, packUnorm4x8
+// Layers are sorted front-to-back. Depths are positive, so they can be compared as unsigned integers.
+layout(rgba32ui, binding = 0) coherent uniform uimage2DArray kBuffer;
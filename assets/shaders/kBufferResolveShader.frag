@@ -0,0 +1,50 @@
+#version 460 core
+
+
+// --- Includes
+#include "camera.glsl"
+#include "lighting.glsl"
+#include "kBuffer.glsl"
+
+// --- Output
+layout (location = 0) out vec4 opaqueBuffer;
+
+
+// --- Main function
+void main(void) {
+    // Light layers and blend them front-to-back
+    //      C = C + T (Asrc Csrc)
+    //      T = (1-Asrc) T
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec2 coords = gl_FragCoord.xy / vec2(imageSize(kBuffer).xy);
+    vec3 color = vec3(0.0);
+    float transmittance = 1.0;
+    for (int i = 0; i < K_BUFFER_LAYERS; i++) {
+        // Layers are sorted, so the first empty one ends the pixel
+        uvec4 layer = imageLoad(kBuffer, ivec3(pixel, i));
+        float depth = uintBitsToFloat(layer.x);
+        if (depth >= 1.0) break;
+
+        // Unpack surface data, reconstructing view-space position from depth
+        vec4 ndcPosition = vec4(vec3(coords, depth) * 2.0 - 1.0, 1.0);
+        vec4 viewPosition = inverseProjectionMatrix * ndcPosition;
+        vec3 vPosition = viewPosition.xyz / viewPosition.w;
+        vec3 vNormal = decodeOctahedral(unpackSnorm2x16(layer.y));
+        vec4 diffuse = unpackUnorm4x8(layer.z);
+        vec3 roughnessMetalnessAO = unpackUnorm4x8(layer.w).rgb;
+
+        // Add ambient light and run local illumination model, as the deferred lighting pass does
+        vec3 fragmentColor = ambientLight * diffuse.rgb * roughnessMetalnessAO.b;
+        fragmentColor += reflectanceGGX(vPosition, vNormal, diffuse.rgb, roughnessMetalnessAO.r, roughnessMetalnessAO.g);
+
+        // Blend
+        color += transmittance * diffuse.a * fragmentColor;
+        transmittance *= 1.0 - diffuse.a;
+    }
+    if (transmittance >= 1.0) discard;
+
+    // Store premultiplied color and opacity; the blending settings of the application produce:
+    //      Cdst = Adst Csrc + Cdst
+    //      Adst = (1-Asrc) Adst
+    opaqueBuffer = vec4(color, 1.0 - transmittance);
+}
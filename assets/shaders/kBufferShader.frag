@@ -0,0 +1,56 @@
+#version 460 core
+
+
+// --- Includes
+#include "kBuffer.glsl"
+#include "materials.glsl"
+
+// --- Layout qualifiers
+// Fragments covered by opaque ones are rejected by the depth test before touching the k-buffer.
+layout(early_fragment_tests) in;
+
+// --- Images
+// One spin lock per pixel, guarding the read-modify-write of its layers.
+layout(r32ui, binding = 1) coherent uniform uimage2D locks;
+
+// --- Input
+in vec3 vPosition;
+in vec3 vNormal;
+flat in int vMaterialID;
+
+
+// --- Main function
+void main(void) {
+    // Fetch this instance's material
+    Material material = fetchMaterial(vMaterialID);
+
+    // Pack surface data
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uvec4 fragment = uvec4(floatBitsToUint(gl_FragCoord.z),
+                           packSnorm2x16(encodeOctahedral(normalize(vNormal))),
+                           packUnorm4x8(material.diffuse),
+                           packUnorm4x8(vec4(material.roughness, material.metalness, material.ambientOcclusion, 0.0)));
+
+    // Insert fragment through the pixel's spin lock
+    // The critical section sits inside the loop, so that threads of the same warp waiting for each other never diverge
+    // around the lock, which would deadlock them.
+    bool done = false;
+    while (!done) {
+        if (imageAtomicCompSwap(locks, pixel, 0u, 1u) == 0u) {
+            // Insertion sort: every stored layer farther than the fragment is swapped with it and pushed back,
+            // while the farthest one is dropped out of the last layer
+            for (int i = 0; i < K_BUFFER_LAYERS; i++) {
+                uvec4 stored = imageLoad(kBuffer, ivec3(pixel, i));
+                if (fragment.x < stored.x) {
+                    imageStore(kBuffer, ivec3(pixel, i), fragment);
+                    fragment = stored;
+                }
+            }
+
+            // Release lock once the layers are visible to other invocations
+            memoryBarrierImage();
+            imageAtomicExchange(locks, pixel, 0u);
+            done = true;
+        }
+    }
+}
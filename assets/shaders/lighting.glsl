@@ -0,0 +1,138 @@
+// GGX local illumination model over point lights, shared by every shader lighting surfaces.
+// Included through ResourceManager::loadShader.
+
+
+// --- Includes
+#include "lights.glsl"
+
+// --- Constants
+const float PI = 3.14159265359;
+
+// --- Uniform Buffers
+// Filled once per frame by Renderer::renderEntities; see LightingUniforms in renderer.hpp
+layout(std140, binding = 2) uniform LightingUniforms {
+    vec3 ambientLight;
+    int pointLightsNumber;
+    vec2 clusterTileSize;       // Pixels covered by a cluster along x and y
+    vec2 clusterDepthParams;    // Scale and bias mapping log(-z) to a depth slice
+    bool clusteredLighting;
+};
+
+// --- Functions
+float distributionGGX(float NdotH, float roughness) {
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float NdotH2 = NdotH * NdotH;
+    
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+    
+    return a2 / denom;
+}
+
+float geometrySchlickGGX(float NdotV, float roughness) {
+    float r = (roughness + 1.0);
+    float k = (r * r) / 8.0; // In IBL, k = (roughness*roughness)/2
+    float denom = NdotV * (1.0 - k) + k;
+    return NdotV / denom;
+}
+
+float geometrySmith(float NdotV, float NdotL, float roughness) {
+    float G1 = geometrySchlickGGX(NdotV, roughness);
+    float G2 = geometrySchlickGGX(NdotL, roughness);
+    return G1 * G2;
+}
+
+vec3 fresnelSchlick(float HdotV, vec3 F0) {
+    // The Fresnel reflectance equation describes the ratio of light that gets reflected over the light that gets refracted.
+    // F0 can be interpeted as the characteristic specular color of the substance.
+    //
+    // Clamp here to prevents black spots.
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - HdotV, 0.0, 1.0), 5.0);
+}
+
+vec3 pointLightGGX(PointLight light, vec3 fragmentPos, vec3 N, vec3 V, float NdotV, vec3 F0, vec3 diffuse, float roughness, float metalness) {
+    // Light position has to be transformed into view-space from the application stage.
+    // Fragment position is already in view-space.
+    vec3 vPointLightDist = light.position.xyz - fragmentPos;
+
+    // Skip fragments out of the light's radius
+    float distance = length(vPointLightDist);
+    float radius = light.constantLinearQuadratic.w;
+    if (distance >= radius) return vec3(0.0);
+
+    // Compute H and L
+    vec3 L = vPointLightDist / distance;
+    vec3 H = normalize(V + L);
+
+    // Calculate radiance
+    // Attenuation is windowed to reach zero at the light's radius, hiding the cut.
+    float attenuation = 1.0 / (light.constantLinearQuadratic.x + light.constantLinearQuadratic.y * distance + light.constantLinearQuadratic.z * (distance * distance));
+    float window = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+    vec3 radiance = light.color.rgb * attenuation * window * window;
+
+    // Keep dot products
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotH = max(dot(N, H), 0.0);
+    float HdotV = max(dot(H, V), 0.0);
+
+    // Cook-Torrance BRDF
+    // Distribution of microfacets
+    float D = distributionGGX(NdotH, roughness);
+    // Geometry attenuation
+    float G = geometrySmith(NdotV, NdotL, roughness);
+    // Fresnel
+    vec3 F = fresnelSchlick(HdotV, F0);
+
+    // Compute the ratio of reflected light over refracted light
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metalness; // Metallic surfaces show no diffuse colors
+
+    // Compute lambert component
+    vec3 lambert = kD * diffuse / PI;
+
+    // Compute specular component
+    vec3 numerator = D * G * F;
+    float denominator = 4.0 * NdotL * NdotV + 0.0001; // Add small constant to prevent division by zero
+    vec3 specular = numerator / denominator;
+
+    // Rendering equation
+    return (lambert + specular) * radiance * NdotL;
+}
+
+uint clusterIndex(vec3 fragmentPos) {
+    // Every shader including this file is a fragment shader, whose gl_FragCoord matches the lit surface
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), uvec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    uint slice = uint(clamp(log(-fragmentPos.z) * clusterDepthParams.x + clusterDepthParams.y, 0.0, float(CLUSTERS_Z - 1)));
+    return tile.x + CLUSTERS_X * (tile.y + CLUSTERS_Y * slice);
+}
+
+vec3 reflectanceGGX(vec3 fragmentPos, vec3 N, vec3 diffuse, float roughness, float metalness) {
+    // Compute V; keep N * V dot product
+    vec3 V = normalize(-fragmentPos);
+    float NdotV = max(dot(N, V), 0.0);
+
+    // Calculate base reflectance F0
+    //
+    // F0 can be interpeted as the characteristic specular color of the substance.
+    // The Fresnel equation used below is not thought for metallic surfaces. In order to use it with metals, a tinted F0 is used.
+    vec3 F0 = vec3(0.04);
+    F0 = mix(F0, diffuse, metalness);
+
+    // Calculate reflectance Lo
+    // With clustered lighting, only the lights whose radius reaches the fragment's cluster are visited.
+    vec3 Lo = vec3(0.0);
+    if (clusteredLighting) {
+        uint cluster = clusterIndex(fragmentPos);
+        uint count = min(clusterLightCounts[cluster], uint(MAX_LIGHTS_PER_CLUSTER));
+        for (uint i = 0; i < count; i++)
+            Lo += pointLightGGX(pointLights[clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]], fragmentPos, N, V, NdotV, F0, diffuse, roughness, metalness);
+    } else {
+        for (int i = 0; i < pointLightsNumber; i++)
+            Lo += pointLightGGX(pointLights[i], fragmentPos, N, V, NdotV, F0, diffuse, roughness, metalness);
+    }
+
+    // Return
+    return Lo;
+}
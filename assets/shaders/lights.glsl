@@ -0,0 +1,26 @@
+// Point lights and their per-cluster lists, shared by the lighting shaders and the light clustering pass.
+// Included through ResourceManager::loadShader, which defines the cluster grid (CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z and
+// MAX_LIGHTS_PER_CLUSTER) from RENDERER_CLUSTERS_X, RENDERER_CLUSTERS_Y, RENDERER_CLUSTERS_Z and
+// RENDERER_CLUSTER_MAXLIGHTS; see Renderer::getClusterDefines.
+
+// --- Struct definitions
+// DON'T USE VEC3: https://stackoverflow.com/questions/38172696/should-i-ever-use-a-vec3-inside-of-a-uniform-buffer-or-shader-storage-buffer-o
+struct PointLight {
+    vec4 position;
+    vec4 color;
+    vec4 constantLinearQuadratic;   // w holds the radius, see LightManager::newPointLight
+};
+
+// --- Shader Storage Buffers
+layout(std430, binding = 0) buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Per-cluster light lists, built by lightClusteringShader.comp
+// Each cluster owns a fixed slot of MAX_LIGHTS_PER_CLUSTER indices.
+layout(std430, binding = 2) buffer ClusterLightCounts {
+    uint clusterLightCounts[];
+};
+layout(std430, binding = 3) buffer ClusterLightIndices {
+    uint clusterLightIndices[];
+};
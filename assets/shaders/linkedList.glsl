@@ -0,0 +1,27 @@
+// Per-pixel linked lists of transparent fragments, shared by the A-buffer geometry and resolve passes.
+// Included through ResourceManager::loadShader.
+
+
+// --- Includes
+#include "packing.glsl"
+
+// --- Struct definitions
+// Surface data are packed as gBufferShader.frag would store them on the G-buffer (32 bytes per node).
+struct FragmentNode {
+    vec4 positionDepth;         // View-space position, window-space depth
+    uint normal;                // Octahedral-encoded normal, packSnorm2x16
+    uint diffuse;               // packUnorm4x8
+    uint roughnessMetalnessAO;  // packUnorm4x8
+    uint next;                  // Index of the next node, END_OF_LIST if last
+};
+
+// --- Constants
+const uint END_OF_LIST = 0xFFFFFFFFu;
+
+// --- Shader Storage Buffers
+layout(std430, binding = 1) coherent buffer FragmentNodes {
+    FragmentNode nodes[];
+};
+
+// --- Images
+layout(r32ui, binding = 0) coherent uniform uimage2D headPointers;
@@ -0,0 +1,70 @@
+#version 460 core
+
+
+// --- Includes
+#include "lighting.glsl"
+#include "linkedList.glsl"
+
+// --- Constants
+// Fragments sorted per pixel; the farthest ones are dropped beyond this limit.
+const int MAX_FRAGMENTS = 32;
+
+// --- Input
+in vec2 texCoords;
+
+// --- Output
+layout (location = 0) out vec4 opaqueBuffer;
+
+
+// --- Main function
+void main(void) {
+    // Fetch list head; discard empty pixels
+    uint index = imageLoad(headPointers, ivec2(gl_FragCoord.xy)).r;
+    if (index == END_OF_LIST) discard;
+
+    // Gather fragments, keeping the nearest MAX_FRAGMENTS sorted by depth through insertion sort
+    uint sorted[MAX_FRAGMENTS];
+    float depths[MAX_FRAGMENTS];
+    int count = 0;
+    while (index != END_OF_LIST) {
+        float depth = nodes[index].positionDepth.w;
+        if (count < MAX_FRAGMENTS || depth < depths[MAX_FRAGMENTS - 1]) {
+            int i = min(count, MAX_FRAGMENTS - 1);
+            while (i > 0 && depths[i - 1] > depth) {
+                sorted[i] = sorted[i - 1];
+                depths[i] = depths[i - 1];
+                i--;
+            }
+            sorted[i] = index;
+            depths[i] = depth;
+            count = min(count + 1, MAX_FRAGMENTS);
+        }
+        index = nodes[index].next;
+    }
+
+    // Light fragments and blend them front-to-back
+    //      C = C + T (Asrc Csrc)
+    //      T = (1-Asrc) T
+    vec3 color = vec3(0.0);
+    float transmittance = 1.0;
+    for (int i = 0; i < count; i++) {
+        FragmentNode node = nodes[sorted[i]];
+        vec3 vPosition = node.positionDepth.xyz;
+        vec3 vNormal = decodeOctahedral(unpackSnorm2x16(node.normal));
+        vec4 diffuse = unpackUnorm4x8(node.diffuse);
+        vec3 roughnessMetalnessAO = unpackUnorm4x8(node.roughnessMetalnessAO).rgb;
+
+        // Add ambient light and run local illumination model, as the deferred lighting pass does
+        vec3 fragmentColor = ambientLight * diffuse.rgb * roughnessMetalnessAO.b;
+        fragmentColor += reflectanceGGX(vPosition, vNormal, diffuse.rgb, roughnessMetalnessAO.r, roughnessMetalnessAO.g);
+
+        // Blend
+        color += transmittance * diffuse.a * fragmentColor;
+        transmittance *= 1.0 - diffuse.a;
+    }
+
+    // Store premultiplied color and opacity; the blending settings of the application produce:
+    //      Cdst = Adst Csrc + Cdst
+    //      Adst = (1-Asrc) Adst
+    opaqueBuffer = vec4(color, 1.0 - transmittance);
+}
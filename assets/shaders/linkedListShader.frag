@@ -0,0 +1,44 @@
+#version 460 core
+
+
+// --- Includes
+#include "linkedList.glsl"
+#include "materials.glsl"
+
+// --- Layout qualifiers
+// Fragments covered by opaque ones are rejected by the depth test before touching the lists.
+layout(early_fragment_tests) in;
+
+// --- Atomic counters
+layout(binding = 0, offset = 0) uniform atomic_uint nodesCounter;
+
+// --- Input
+in vec3 vPosition;
+in vec3 vNormal;
+flat in int vMaterialID;
+
+// --- Uniforms
+uniform int nodePoolSize;
+
+
+// --- Main function
+void main(void) {
+    // Fetch this instance's material
+    Material material = fetchMaterial(vMaterialID);
+
+    // Allocate node; drop fragment if the pool is exhausted
+    // The counter keeps growing past the pool size, so that overflowing fragments can be counted.
+    uint index = atomicCounterIncrement(nodesCounter);
+    if (index >= uint(nodePoolSize))
+        return;
+
+    // Push node at the head of this pixel's list
+    uint next = imageAtomicExchange(headPointers, ivec2(gl_FragCoord.xy), index);
+
+    // Store surface data
+    nodes[index].positionDepth = vec4(vPosition, gl_FragCoord.z);
+    nodes[index].normal = packSnorm2x16(encodeOctahedral(normalize(vNormal)));
+    nodes[index].diffuse = packUnorm4x8(material.diffuse);
+    nodes[index].roughnessMetalnessAO = packUnorm4x8(vec4(material.roughness, material.metalness, material.ambientOcclusion, 0.0));
+    nodes[index].next = next;
+}
@@ -0,0 +1,43 @@
+// Materials indexed by their stable ID, shared by geometry shaders fetching their instance's material and by
+// the lighting pass reading G-buffers with material IDs.
+// Included through ResourceManager::loadShader.
+
+
+// --- Constants
+// Material IDs are stored shifted by one in a normalized 16-bit channel, so that 0 marks an empty pixel.
+#define MATERIAL_ID_SCALE 65535.0
+
+// --- Struct definitions
+struct Material {
+    vec4 diffuse;
+    float roughness;
+    float metalness;
+    float ambientOcclusion;
+};
+
+// DON'T USE VEC3: https://stackoverflow.com/questions/38172696/should-i-ever-use-a-vec3-inside-of-a-uniform-buffer-or-shader-storage-buffer-o
+struct MaterialData {
+    vec4 diffuse;
+    vec4 roughnessMetalnessAO;
+};
+
+// --- Shader Storage Buffers
+// Filled by MaterialManager; see MaterialData in material.hpp
+layout(std430, binding = 4) buffer Materials {
+    MaterialData materials[];
+};
+
+// --- Functions
+Material fetchMaterial(int id) {
+    MaterialData data = materials[id];
+    return Material(data.diffuse, data.roughnessMetalnessAO.r, data.roughnessMetalnessAO.g, data.roughnessMetalnessAO.b);
+}
+
+float encodeMaterialID(int id) {
+    return float(id + 1) / MATERIAL_ID_SCALE;
+}
+
+// Returns -1 for empty pixels
+int decodeMaterialID(float encoded) {
+    return int(round(encoded * MATERIAL_ID_SCALE)) - 1;
+}
@@ -0,0 +1,10 @@
+// Per-pass constants, shared by the geometry and lighting passes of the G-buffer.
+// Filled before each pass by Renderer::uploadPassUniforms; see PassUniforms in renderer.hpp.
+// Included through ResourceManager::loadShader.
+
+
+// --- Uniform Buffers
+layout(std140, binding = 1) uniform PassUniforms {
+    vec2 gDepthMask;    // Selects the depth channel read by position reconstruction
+    int peel;           // Index of the depth peel being rendered
+};
@@ -8,8 +8,8 @@ in vec2 texCoords;
 out vec4 fragColor;
 
 // --- Uniforms
-uniform sampler2D opaqueBuffer;
-uniform sampler2D depthBuffer;
+layout(binding = 0) uniform sampler2D opaqueBuffer;
+layout(binding = 1) uniform sampler2D depthBuffer;
 
 
 // --- Main function
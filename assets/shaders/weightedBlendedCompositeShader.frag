@@ -0,0 +1,30 @@
+#version 460 core
+
+
+// --- Input
+in vec2 texCoords;
+
+// --- Output
+out vec4 fragColor;
+
+// --- Uniforms
+layout(binding = 0) uniform sampler2D accumulation;
+layout(binding = 1) uniform sampler2D revealage;
+
+
+// --- Main function
+void main(void) {
+    // Discard pixels without transparent fragments
+    float reveal = texture(revealage, texCoords).r;
+    if (reveal >= 1.0) discard;
+
+    // Compute weighted average color
+    vec4 accum = texture(accumulation, texCoords);
+    vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+
+    // Output premultiplied color and opacity, as expected by front-to-back blending
+    //      Cdst = Adst Csrc + Cdst
+    //      Adst = (1-Asrc) Adst
+    float coverage = 1.0 - reveal;
+    fragColor = vec4(averageColor * coverage, coverage);
+}
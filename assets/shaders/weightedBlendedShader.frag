@@ -0,0 +1,52 @@
+#version 460 core
+
+
+// --- Includes
+#include "lighting.glsl"
+#include "materials.glsl"
+
+// --- Render targets
+layout (location = 0) out vec4 accumulation;
+layout (location = 1) out float revealage;
+
+// --- Input
+in vec3 vPosition;
+in vec3 vNormal;
+flat in int vMaterialID;
+
+// --- Uniforms
+uniform bool skipPeeledLayers;
+layout(binding = 0) uniform sampler2D peeledDepth;
+
+// --- Functions
+float weight(float viewDepth, float alpha) {
+    // Depth weight, equation (7) of the source
+    //
+    // SOURCE: McGuire, Bavoil - Weighted Blended Order-Independent Transparency (JCGT, 2013)
+    float z = abs(viewDepth);
+    return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+
+// --- Main function
+void main(void) {
+    // Fetch this instance's material
+    Material material = fetchMaterial(vMaterialID);
+
+    // Skip fragments already peeled by depth peeling
+    if (skipPeeledLayers && gl_FragCoord.z <= texelFetch(peeledDepth, ivec2(gl_FragCoord.xy), 0).r)
+        discard;
+
+    // Light fragment, as the deferred lighting pass does
+    vec3 normal = normalize(vNormal);
+    vec3 color = ambientLight * material.diffuse.rgb * material.ambientOcclusion;
+    color += reflectanceGGX(vPosition, normal, material.diffuse.rgb, material.roughness, material.metalness);
+
+    // Accumulate weighted premultiplied color and alpha; the blending settings of the application produce:
+    //      accumulation = accumulation + w (Asrc Csrc, Asrc)
+    //      revealage    = (1-Asrc) revealage
+    float alpha = material.diffuse.a;
+    float w = weight(vPosition.z, alpha);
+    accumulation = vec4(color * alpha, alpha) * w;
+    revealage = alpha;
+}
@@ -41,9 +41,13 @@ const glm::vec3 LIGHT_COLOR_AMBIENT{ 0.25f };
 constexpr float LIGHT_CONSTANT{ 1.0f };
 constexpr float LIGHT_LINEAR{ 0.14f };
 constexpr float LIGHT_QUADRATIC{ 0.07f };
+constexpr float LIGHT_SHORT_LINEAR{ 0.7f };
+constexpr float LIGHT_SHORT_QUADRATIC{ 1.8f };
+constexpr float LIGHT_ATTENUATION_THRESHOLD{ 0.02f }; // Attenuated intensity at the light's radius
 const int LIGHT_NUMSHOWN{ 16 };
 const int LIGHT_MINSHOWN{ 0 };
-const int LIGHT_MAXSHOWN{ 128 };
+const int LIGHT_MAXSHOWN{ 4096 };
+const int LIGHT_LONGRANGE{ 128 }; // Lights generated with the default attenuation; the others are short-ranged
 const float LIGHT_ROTSPEED{ 15.f };
 const float LIGHT_MINROTSPEED{ -180.f};
 const float LIGHT_MAXROTSPEED{ 180.f };
@@ -61,9 +65,79 @@ const std::string RENDERER_DEFERRED_VERTEX{ "assets/shaders/screenSpaceShader.ve
 const std::string RENDERER_DEFERRED_FRAGMENT{ "assets/shaders/deferredShader.frag" };
 const std::string RENDERER_SCREENSPACE_VERTEX{ "assets/shaders/screenSpaceShader.vert" };
 const std::string RENDERER_SCREENSPACE_FRAGMENT{ "assets/shaders/screenSpaceShader.frag" };
+const std::string RENDERER_DUALPEELING_FRAGMENT{ "assets/shaders/dualDepthPeelingShader.frag" };
+const std::string RENDERER_DUALPEELING_BLEND_FRAGMENT{ "assets/shaders/dualDepthPeelingBlendShader.frag" };
+const std::string RENDERER_LINKEDLIST_FRAGMENT{ "assets/shaders/linkedListShader.frag" };
+const std::string RENDERER_LINKEDLIST_RESOLVE_FRAGMENT{ "assets/shaders/linkedListResolveShader.frag" };
+const std::string RENDERER_WEIGHTEDBLENDED_FRAGMENT{ "assets/shaders/weightedBlendedShader.frag" };
+const std::string RENDERER_WEIGHTEDBLENDED_COMPOSITE_FRAGMENT{ "assets/shaders/weightedBlendedCompositeShader.frag" };
+const std::string RENDERER_KBUFFER_FRAGMENT{ "assets/shaders/kBufferShader.frag" };
+const std::string RENDERER_KBUFFER_RESOLVE_FRAGMENT{ "assets/shaders/kBufferResolveShader.frag" };
 const int RENDERER_DEPTHPEELING_PASSES{ 4 };
 const int RENDERER_DEPTHPEELING_MINPASSES{ 1 };
-const int RENDERER_DEPTHPEELING_MAXPASSES{ 16 };
+const int RENDERER_DEPTHPEELING_MAXPASSES{ 16 }; // Defined as MAX_PEELS for gBufferShader.frag; at most 16, see buildRenderQueue
+const bool RENDERER_DEPTHPEELING_EARLYTERMINATION{ true };
+const int RENDERER_DEPTHPEELING_SAMPLETHRESHOLD{ 1 };
+const int RENDERER_DEPTHPEELING_MINSAMPLETHRESHOLD{ 1 };
+const int RENDERER_DEPTHPEELING_MAXSAMPLETHRESHOLD{ 4096 };
+const bool RENDERER_DEPTHPEELING_ENTITYCULLING{ true }; // Drop entities from the peels past the first one they left empty
+const std::string RENDERER_LIGHTCLUSTERING_COMPUTE{ "assets/shaders/lightClusteringShader.comp" };
+const bool RENDERER_TRANSPARENCY_SCISSOR{ true };
+const bool RENDERER_GBUFFER_MATERIALIDS{ true };
+const bool RENDERER_INSTANCING{ true };
+const bool RENDERER_MULTIDRAWINDIRECT{ true };
+const float RENDERER_QUEUE_RESORTDISTANCE{ 1.0f }; // Camera movement past which the render queue is sorted again
+const double RENDERER_RESIZE_DEBOUNCE{ 0.25 }; // Seconds with no resize before render targets are reallocated
+const bool RENDERER_CLUSTEREDLIGHTING{ true };
+const int RENDERER_CLUSTERS_X{ 16 }; // Cluster grid; defined for the shaders including lights.glsl
+const int RENDERER_CLUSTERS_Y{ 9 };
+const int RENDERER_CLUSTERS_Z{ 24 };
+const int RENDERER_CLUSTER_MAXLIGHTS{ 256 };
+const int RENDERER_LIGHTCLUSTERING_GROUPSIZE{ 128 }; // Defined as GROUP_SIZE for lightClusteringShader.comp
+const int RENDERER_HYBRID_PASSES{ 2 };
+const int RENDERER_LINKEDLIST_NODESIZE{ 32 }; // Bytes per node, see linkedList.glsl
+const int RENDERER_LINKEDLIST_NODESPERPIXEL{ 4 };
+const int RENDERER_LINKEDLIST_MINNODESPERPIXEL{ 1 };
+const int RENDERER_LINKEDLIST_MAXNODESPERPIXEL{ 32 };
+const int RENDERER_KBUFFER_LAYERS{ 4 }; // Either 4 or 8; defined as K_BUFFER_LAYERS for the k-buffer shaders
+const int RENDERER_KBUFFER_LAYERSIZE{ 16 }; // Bytes per layer, see kBuffer.glsl
+
+// Geometry arena
+const unsigned int ARENA_VERTEXCAPACITY{ 1 << 16 }; // Initial capacities; the arena doubles them when full
+const unsigned int ARENA_INDEXCAPACITY{ 1 << 18 };
+
+// State cache
+const unsigned int STATECACHE_TEXTUREUNITS{ 16 };   // Units tracked; the ones above are always bound
+const unsigned int STATECACHE_BUFFERBINDINGS{ 8 };  // Indexed binding points tracked per target
+const unsigned int STATECACHE_IMAGEUNITS{ 8 };      // Image units tracked; the ones above are always bound
+const unsigned int STATECACHE_UNKNOWN{ 0xFFFFFFFF }; // Cached value of state which has to be set anew
+
+// Frame graph
+const unsigned int FRAMEGRAPH_NONE{ 0xFFFFFFFF };    // Handle of no resource, e.g. an unused color attachment
+const unsigned int FRAMEGRAPH_MAXATTACHMENTS{ 8 };   // Color attachments per pass, as guaranteed by OpenGL
+
+// Frustum culler
+const bool FRUSTUMCULLER_ENABLED{ true };
+
+// Occlusion culler
+const bool OCCLUSIONCULLER_ENABLED{ true };
+const int OCCLUSIONCULLER_WIDTH{ 256 };              // Depth buffer resolution; the width must be a multiple of 4
+const int OCCLUSIONCULLER_HEIGHT{ 128 };
+const unsigned int OCCLUSIONCULLER_OCCLUDERS{ 8 };  // Opaque entities rasterized, largest on screen first
+const unsigned int OCCLUSIONCULLER_MAXTHREADS{ 8 };
+
+// GPU culler
+const std::string GPUCULLER_CULLING_COMPUTE{ "assets/shaders/gpuCullingShader.comp" };
+const std::string GPUCULLER_DEPTHPYRAMID_COMPUTE{ "assets/shaders/depthPyramidShader.comp" };
+const bool GPUCULLER_ENABLED{ true };                 // Only with multi-draw indirect; replaces both CPU cullers
+const bool GPUCULLER_OCCLUSION{ true };
+const bool GPUCULLER_MESHLETS{ true };               // Cull and draw each meshlet, rather than each mesh as a whole
+const int GPUCULLER_GROUPSIZE{ 64 };                 // Defined as GROUP_SIZE for gpuCullingShader.comp
+const int GPUCULLER_DEPTHPYRAMID_GROUPSIZE{ 8 };     // Defined as GROUP_SIZE for depthPyramidShader.comp
+
+// Model
+const unsigned int MODEL_MESHLET_MAXVERTICES{ 64 };
+const unsigned int MODEL_MESHLET_MAXTRIANGLES{ 124 };
 
 // Entity
 const glm::vec3 ENTITY_POS{ 0.0f };
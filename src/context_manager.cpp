@@ -11,8 +11,16 @@
 #include "debug.hpp"
 #include "context_manager.hpp"
 #include "input/input_manager.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/frustum_culler.hpp"
+#include "rendering/gpu_culler.hpp"
 #include "rendering/light_manager.hpp"
+#include "rendering/occlusion_culler.hpp"
+#include "rendering/render_target_pool.hpp"
 #include "rendering/renderer.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/transform_stage.hpp"
+#include "resources/geometry_arena.hpp"
 
 
 /* STATIC MEMBERS */
@@ -54,9 +62,10 @@ void ContextManager::init(std::string title, unsigned int width, unsigned int he
     glViewport(0, 0, framebufferWidth, framebufferHeight);
 
 	// Setup render state  
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
-	glDisable(GL_CULL_FACE);
+	StateCache::invalidate();
+	StateCache::setCapability(GL_DEPTH_TEST, true);
+	StateCache::depthFunc(GL_LEQUAL);
+	StateCache::setCapability(GL_CULL_FACE, false);
 	
 	// Set sticky keys
 	// From GLFW's documentation: When sticky keys mode is enabled, the pollable state of a key
@@ -109,8 +118,10 @@ void ContextManager::init(std::string title, unsigned int width, unsigned int he
 	InputManager::subscribeKeyboard(keyboardHandler);
 	
 	// Initialize renderer and other managers
+	GeometryArena::init();
 	Renderer::init(framebufferWidth, framebufferHeight);
 	LightManager::init();
+	MaterialManager::init();
 }
 
 void ContextManager::next() {
@@ -125,6 +136,9 @@ void ContextManager::next() {
 
 	// Update deltatime
 	updateDeltaTime();
+
+	// Start counting GL state changes anew; Dear ImGui changed state behind the cache
+	StateCache::beginFrame();
 }
 
 void ContextManager::displayGUI() {
@@ -132,7 +146,7 @@ void ContextManager::displayGUI() {
 	if (!InputManager::mouseIsEnabled()) return;
 
 	// Feed inputs to Dear ImGui; start new frame
-	glDisable(GL_BLEND);
+	StateCache::setCapability(GL_BLEND, false);
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
@@ -142,8 +156,9 @@ void ContextManager::displayGUI() {
 	if (ImGui::CollapsingHeader("Help and Credits")) {
 		ImGui::Text("ABOUT THIS DEMO:");
 		ImGui::BulletText("This OpenGL 4.6 renderer implements deferred shading.");
-		ImGui::BulletText("Transparency is handled with depth-peeling.");
+		ImGui::BulletText("Transparency is handled with depth-peeling by default.");
 		ImGui::BulletText("Each peel is deferred as well.");
+		ImGui::BulletText("Other transparency techniques can be picked from the editing tool.");
 		ImGui::Separator();
 		ImGui::Text("ABOUT EDITING TOOL:");
 		ImGui::BulletText("You can edit some aspects of the rendering process and the scene.");
@@ -168,12 +183,125 @@ void ContextManager::displayGUI() {
 		ImGui::BulletText("Original teapot model by Martin Newell (University of Utah).");
 		ImGui::Text("");
 	}
-	if (ImGui::CollapsingHeader("Depth Peeling")) {
-		int passes = Renderer::getDepthPeelingPasses();
-		if (ImGui::SliderInt("Passes", &passes, RENDERER_DEPTHPEELING_MINPASSES, RENDERER_DEPTHPEELING_MAXPASSES))
-			Renderer::setDepthPeelingPasses(passes);
+	if (ImGui::CollapsingHeader("Geometry")) {
+		bool instancing = Renderer::getInstancing();
+		if (ImGui::Checkbox("Instancing", &instancing))
+			Renderer::setInstancing(instancing);
+		bool multiDrawIndirect = Renderer::getMultiDrawIndirect();
+		if (ImGui::Checkbox("Multi-draw indirect", &multiDrawIndirect))
+			Renderer::setMultiDrawIndirect(multiDrawIndirect);
+		ImGui::Text("Draw calls: %u", Renderer::getDrawCalls());
+		bool frustumCulling = FrustumCuller::getEnabled();
+		if (ImGui::Checkbox("Frustum culling", &frustumCulling))
+			FrustumCuller::setEnabled(frustumCulling);
+		ImGui::Text("Frustum culled: %u / %u", FrustumCuller::getCulledNumber(), FrustumCuller::getTestedNumber());
+		bool occlusionCulling = OcclusionCuller::getEnabled();
+		if (ImGui::Checkbox("Occlusion culling", &occlusionCulling))
+			OcclusionCuller::setEnabled(occlusionCulling);
+		ImGui::Text("Occlusion culled: %u / %u", OcclusionCuller::getCulledNumber(), OcclusionCuller::getTestedNumber());
+		ImGui::Text("Occluders: %u, %u triangles", OcclusionCuller::getOccluderNumber(), OcclusionCuller::getTriangleNumber());
+		bool gpuCulling = GpuCuller::getEnabled();
+		if (ImGui::Checkbox("GPU culling", &gpuCulling))
+			GpuCuller::setEnabled(gpuCulling);
+		bool gpuOcclusionCulling = GpuCuller::getOcclusionCulling();
+		if (ImGui::Checkbox("GPU occlusion culling", &gpuOcclusionCulling))
+			GpuCuller::setOcclusionCulling(gpuOcclusionCulling);
+		bool gpuMeshletCulling = GpuCuller::getMeshletCulling();
+		if (ImGui::Checkbox("Meshlet culling", &gpuMeshletCulling))
+			GpuCuller::setMeshletCulling(gpuMeshletCulling);
+		ImGui::Text("GPU cull items: %u, up to %u commands", GpuCuller::getItemNumber(), GpuCuller::getCommandCapacity());
+		ImGui::Text("Meshlets: %u", GpuCuller::getMeshletNumber());
+		ImGui::Text("Depth pyramid levels: %u", GpuCuller::getPyramidLevels());
+		ImGui::Text("Render queue rebuilds: %u", Renderer::getRenderQueueRebuilds());
+		ImGui::Text("Translation-only transforms: %u", TransformStage::getTranslationOnlyNumber());
+		ImGui::Text("GL state calls: %u issued, %u elided", StateCache::getIssuedCalls(), StateCache::getElidedCalls());
+		unsigned int vertexCapacity = GeometryArena::getVertexCapacity();
+		unsigned int indexCapacity = GeometryArena::getIndexCapacity();
+		ImGui::Text("Arena vertices: %u / %u", vertexCapacity - GeometryArena::getFreeVertices(), vertexCapacity);
+		ImGui::Text("Arena indices: %u / %u", indexCapacity - GeometryArena::getFreeIndices(), indexCapacity);
+	}
+	if (ImGui::CollapsingHeader("G-Buffer")) {
+		const char *profiles[] = { "Full", "Compact" };
+		int profile = (int)Renderer::getGBufferProfile();
+		if (ImGui::Combo("Profile", &profile, profiles, IM_ARRAYSIZE(profiles)))
+			Renderer::setGBufferProfile((GBufferProfile)profile);
+		bool materialIDs = Renderer::getGBufferMaterialIDs();
+		if (ImGui::Checkbox("Material IDs", &materialIDs))
+			Renderer::setGBufferMaterialIDs(materialIDs);
+		ImGui::Text("Bytes per pixel: %u", Renderer::getGBufferBytesPerPixel());
+		ImGui::Text("Render targets: %u, %.1f MiB", RenderTargetPool::getTargetNumber(), RenderTargetPool::getTotalBytes() / (1024.0f * 1024.0f));
+		const FrameGraph &frameGraph = Renderer::getFrameGraph();
+		ImGui::Text("Frame graph passes: %u (%u culled), %u barriers", frameGraph.getPassNumber(), frameGraph.getCulledPassNumber(), frameGraph.getBarrierNumber());
+		ImGui::Text("Transient targets: %u, %u aliased", frameGraph.getTransientNumber(), frameGraph.getAliasedNumber());
+		if (Renderer::getGBufferProfile() == GBufferProfile::compact)
+			ImGui::Text("Position is reconstructed from depth.");
+		if (materialIDs)
+			ImGui::Text("Materials are fetched from the materials SSBO.");
+	}
+	if (ImGui::CollapsingHeader("Transparency")) {
+		const char *modes[] = { "Depth peeling", "Dual depth peeling", "Per-pixel linked lists", "Weighted blended OIT", "K-buffer", "Hybrid (peeling + WBOIT)" };
+		int mode = (int)Renderer::getTransparencyMode();
+		if (ImGui::Combo("Mode", &mode, modes, IM_ARRAYSIZE(modes)))
+			Renderer::setTransparencyMode((TransparencyMode)mode);
+		bool scissor = Renderer::getTransparencyScissor();
+		if (ImGui::Checkbox("Restrict to screen bounds", &scissor))
+			Renderer::setTransparencyScissor(scissor);
+		ImGui::Text("Screen coverage: %.1f%%", Renderer::getTransparencyCoverage() * 100.0f);
+		if (ImGui::TreeNode("Depth Peeling")) {
+			int passes = Renderer::getDepthPeelingPasses();
+			if (ImGui::SliderInt("Passes", &passes, RENDERER_DEPTHPEELING_MINPASSES, RENDERER_DEPTHPEELING_MAXPASSES))
+				Renderer::setDepthPeelingPasses(passes);
+			if (Renderer::getTransparencyMode() == TransparencyMode::dualDepthPeeling)
+				ImGui::Text("Each pass peels two layers (plus an initialization pass).");
+			bool earlyTermination = Renderer::getDepthPeelingEarlyTermination();
+			if (ImGui::Checkbox("Early termination", &earlyTermination))
+				Renderer::setDepthPeelingEarlyTermination(earlyTermination);
+			if (earlyTermination) {
+				int threshold = Renderer::getDepthPeelingSampleThreshold();
+				if (ImGui::SliderInt("Sample threshold", &threshold, RENDERER_DEPTHPEELING_MINSAMPLETHRESHOLD, RENDERER_DEPTHPEELING_MAXSAMPLETHRESHOLD))
+					Renderer::setDepthPeelingSampleThreshold(threshold);
+				ImGui::Text("Non-empty peels (previous frame): %d", Renderer::getDepthPeelingNonEmptyPasses());
+			}
+			ImGui::Text("Peels run: %d / %d", Renderer::getDepthPeelingActivePasses(), passes);
+			bool entityCulling = Renderer::getDepthPeelingEntityCulling();
+			if (ImGui::Checkbox("Skip entities with no layers left", &entityCulling))
+				Renderer::setDepthPeelingEntityCulling(entityCulling);
+			if (entityCulling)
+				ImGui::Text("Instances skipped across peels: %u", Renderer::getDepthPeelingSkippedInstances());
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Hybrid")) {
+			int hybridPasses = Renderer::getHybridPeelingPasses();
+			if (ImGui::SliderInt("Exact peels", &hybridPasses, RENDERER_DEPTHPEELING_MINPASSES, RENDERER_DEPTHPEELING_MAXPASSES))
+				Renderer::setHybridPeelingPasses(hybridPasses);
+			ImGui::Text("Deeper layers are approximated by weighted blended OIT.");
+			if (Renderer::getTransparencyMode() == TransparencyMode::hybrid)
+				ImGui::Text("Peels run: %d / %d", Renderer::getDepthPeelingActivePasses(), hybridPasses);
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Linked Lists")) {
+			int nodesPerPixel = Renderer::getLinkedListNodesPerPixel();
+			if (ImGui::SliderInt("Nodes per pixel", &nodesPerPixel, RENDERER_LINKEDLIST_MINNODESPERPIXEL, RENDERER_LINKEDLIST_MAXNODESPERPIXEL))
+				Renderer::setLinkedListNodesPerPixel(nodesPerPixel);
+			unsigned int poolSize = Renderer::getLinkedListNodePoolSize();
+			ImGui::Text("Node pool: %u nodes (%.1f MB)", poolSize, (float)poolSize * RENDERER_LINKEDLIST_NODESIZE / (1024.f * 1024.f));
+			ImGui::Text("Stored fragments: %u", Renderer::getLinkedListStoredFragments());
+			ImGui::Text("Overflowed fragments: %u", Renderer::getLinkedListOverflowFragments());
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("K-Buffer")) {
+			unsigned int layersSize = RENDERER_KBUFFER_LAYERS * RENDERER_KBUFFER_LAYERSIZE * Renderer::getFramebufferWidth() * Renderer::getFramebufferHeight();
+			ImGui::Text("Layers: %d, set at shader compile time", RENDERER_KBUFFER_LAYERS);
+			ImGui::Text("Layers' memory: %.1f MB", (float)layersSize / (1024.f * 1024.f));
+			ImGui::TreePop();
+		}
 	}
 	if (ImGui::CollapsingHeader("Lighting")) {
+		bool clustered = Renderer::getClusteredLighting();
+		if (ImGui::Checkbox("Clustered lighting", &clustered))
+			Renderer::setClusteredLighting(clustered);
+		if (clustered)
+			ImGui::Text("Clusters: %d x %d x %d, up to %d lights each", RENDERER_CLUSTERS_X, RENDERER_CLUSTERS_Y, RENDERER_CLUSTERS_Z, RENDERER_CLUSTER_MAXLIGHTS);
 		if (ImGui::TreeNode("Ambient Light")) {
 			glm::vec3 ambientColor = LightManager::getAmbientLight();
 			ImVec4 imguiAmbientColor{ambientColor.r, ambientColor.g, ambientColor.b, 1.f};
@@ -209,10 +337,12 @@ void ContextManager::displayGUI() {
 					diffuse.a = imguiDiffuse.w;
 					iter->second.diffuse = diffuse;
 					MaterialManager::updateAssignedEntities(&(iter->second));
+					edited = true;
 				}
-				ImGui::SliderFloat("Roughness", &(iter->second.roughness), 0.f, 1.f);
-				ImGui::SliderFloat("Metalness", &(iter->second.metalness), 0.f, 1.f);
-				ImGui::SliderFloat("Ambient Occlusion", &(iter->second.ambientOcclusion), 0.f, 1.f);
+				edited |= ImGui::SliderFloat("Roughness", &(iter->second.roughness), 0.f, 1.f);
+				edited |= ImGui::SliderFloat("Metalness", &(iter->second.metalness), 0.f, 1.f);
+				edited |= ImGui::SliderFloat("Ambient Occlusion", &(iter->second.ambientOcclusion), 0.f, 1.f);
+				if (edited) MaterialManager::updateMaterialSSBO(&(iter->second));
 				ImGui::TreePop();
 			}
 		}
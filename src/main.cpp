@@ -13,6 +13,7 @@
 #include "rendering/light_manager.hpp"
 #include "rendering/material_manager.hpp"
 #include "rendering/renderer.hpp"
+#include "resources/geometry_arena.hpp"
 #include "resources/resource_manager.hpp"
 #include "resources/model.hpp"
 #include "scene/entity_manager.hpp"
@@ -47,11 +48,13 @@ int main(int argc, char** argv) {
     Model *background = ResourceManager::loadModel("assets/models/background_cube.obj");
 
     // Generate point lights
+    // Past the first LIGHT_LONGRANGE ones, lights are short-ranged, so that clustered lighting keeps them local.
     float lightsExtent = 10.f; // They'll clip out the background cube, but that's not a big issue...
     for (int i = 0; i < LIGHT_MAXSHOWN; i++) {
         glm::vec3 randomPosition =  glm::vec3{ getRandom(-lightsExtent, lightsExtent), getRandom(-lightsExtent, lightsExtent), getRandom(-lightsExtent, lightsExtent) };
         glm::vec3 randomColor = glm::vec3{ getRandom(0.0f, 1.0f), getRandom(0.0f, 1.0f), getRandom(0.0f, 1.0f) };
-        LightManager::newPointLight(randomPosition, randomColor);
+        if (i < LIGHT_LONGRANGE) LightManager::newPointLight(randomPosition, randomColor);
+        else LightManager::newPointLight(randomPosition, randomColor, LIGHT_CONSTANT, LIGHT_SHORT_LINEAR, LIGHT_SHORT_QUADRATIC);
     }
 
     // Generate materials
@@ -82,13 +85,12 @@ int main(int argc, char** argv) {
         // Update lights
         std::vector<PointLight> *pointLights = LightManager::getPointLights();
         unsigned int pointLightsSize = pointLights->size();
-        for (int i = 0; i < pointLightsSize; i++) {
-            glm::mat4 model{1.0f};
-            model = glm::rotate(model, 0.0f, glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::rotate(model, glm::radians(LightManager::getPointLightsRotationSpeed()) * ContextManager::getDeltaTime(), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::rotate(model, 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 model{1.0f};
+        model = glm::rotate(model, 0.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::rotate(model, glm::radians(LightManager::getPointLightsRotationSpeed()) * ContextManager::getDeltaTime(), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::rotate(model, 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+        for (int i = 0; i < pointLightsSize; i++)
             (*pointLights)[i].position = model * (*pointLights)[i].position;
-        }
         LightManager::updatePointLightsSSBO(Renderer::getCamera().getViewMatrix());
 
         // Render
@@ -110,6 +112,7 @@ int main(int argc, char** argv) {
     LightManager::clear();
     EntityManager::clear();
     Renderer::clear();
+    GeometryArena::clear();
     ContextManager::clear();
     
     // Return
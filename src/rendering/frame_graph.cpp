@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "consts.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/render_target_pool.hpp"
+#include "rendering/state_cache.hpp"
+
+
+// --- Constructor
+FrameGraph::FrameGraph() : m_poolGeneration{ 0 }, m_passNumber{ 0 }, m_culledPassNumber{ 0 }, m_barrierNumber{ 0 }, m_transientNumber{ 0 }, m_aliasedNumber{ 0 } { }
+
+
+// --- Public methods
+FrameGraphResource FrameGraph::importTexture(const char *name, unsigned int texture) {
+    return addResource(name, true, texture, GL_NONE, 0, 0, 0);
+}
+
+FrameGraphResource FrameGraph::importBuffer(const char *name, unsigned int buffer) {
+    return addResource(name, true, buffer, GL_NONE, 0, 0, 0);
+}
+
+FrameGraphResource FrameGraph::createTexture(const char *name, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers) {
+    return addResource(name, false, 0, internalFormat, width, height, layers);
+}
+
+void FrameGraph::markOutput(FrameGraphResource resource) {
+    m_resources[resource].output = true;
+}
+
+void FrameGraph::addPass(const char *name, std::function<void()> execute) {
+    FrameGraphPassNode pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.depthAttachment = FRAMEGRAPH_NONE;
+    pass.culled = false;
+    pass.barriers = 0;
+    m_passes.push_back(std::move(pass));
+}
+
+void FrameGraph::read(FrameGraphResource resource, FrameGraphAccess access) {
+    if (resource == FRAMEGRAPH_NONE) return;
+    m_passes.back().reads.push_back(FrameGraphAccessNode{ resource, access });
+}
+
+void FrameGraph::write(FrameGraphResource resource, FrameGraphAccess access) {
+    if (resource == FRAMEGRAPH_NONE) return;
+    m_passes.back().writes.push_back(FrameGraphAccessNode{ resource, access });
+}
+
+void FrameGraph::setColorAttachments(std::vector<FrameGraphResource> attachments) {
+    // Unused slots are kept, so that attachment i always matches fragment output location i
+    for (FrameGraphResource attachment : attachments)
+        write(attachment, FrameGraphAccess::renderTarget);
+    m_passes.back().colorAttachments = std::move(attachments);
+}
+
+void FrameGraph::setDepthAttachment(FrameGraphResource resource, bool depthWrite) {
+    // A depth buffer only tested against is read, and does not keep its writers alive on behalf of this pass
+    if (depthWrite) write(resource, FrameGraphAccess::renderTarget);
+    else read(resource, FrameGraphAccess::renderTarget);
+    m_passes.back().depthAttachment = resource;
+}
+
+void FrameGraph::compile() {
+    // How compilation works:
+    //      1) Passes are culled walking backwards from the outputs: a pass is kept if it writes an output, or a
+    //         resource read by a pass kept after it;
+    //      2) The lifetime of each transient texture spans the kept passes using it;
+    //      3) A memory barrier is placed before the first access following each shader write (image or storage).
+    // Passes run in the order they were added, which is always a valid order, as a pass can only read resources
+    // declared before it.
+    m_passNumber = (unsigned int)m_passes.size();
+    cullPasses();
+    computeLifetimes();
+    computeBarriers();
+}
+
+void FrameGraph::execute() {
+    // Framebuffers are keyed by texture names, which GL reuses once a texture is deleted
+    if (m_poolGeneration != RenderTargetPool::getGeneration()) {
+        clear();
+        m_poolGeneration = RenderTargetPool::getGeneration();
+    }
+
+    // Run passes, backing each transient texture with a pooled target for its lifetime only
+    // A target released by a pass is handed to the next transient with the same format and size, so that
+    // transients whose lifetimes do not overlap share memory, e.g. the G-buffers of consecutive peels.
+    m_releasedTextures.clear();
+    m_aliasedNumber = 0;
+    for (int p = 0; p < (int)m_passes.size(); p++) {
+        FrameGraphPassNode &pass = m_passes[p];
+        if (pass.culled) continue;
+
+        // Acquire transients first used by this pass
+        for (FrameGraphResourceNode &resource : m_resources) {
+            if (resource.imported || resource.firstPass != p) continue;
+            resource.object = RenderTargetPool::acquire(resource.internalFormat, resource.width, resource.height, resource.layers);
+            if (std::find(m_releasedTextures.begin(), m_releasedTextures.end(), resource.object) != m_releasedTextures.end())
+                m_aliasedNumber++;
+        }
+
+        // Make shader writes of previous passes visible, then bind attachments
+        if (pass.barriers != 0) glMemoryBarrier(pass.barriers);
+        if (!pass.colorAttachments.empty() || pass.depthAttachment != FRAMEGRAPH_NONE)
+            StateCache::bindFramebuffer(GL_FRAMEBUFFER, getFramebuffer(pass));
+
+        // Run pass, labelled for graphics debuggers
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, pass.name);
+        pass.execute();
+        glPopDebugGroup();
+
+        // Release transients last used by this pass
+        for (FrameGraphResourceNode &resource : m_resources) {
+            if (resource.imported || resource.lastPass != p) continue;
+            m_releasedTextures.push_back(resource.object);
+            RenderTargetPool::release(resource.object);
+        }
+    }
+
+    // Free targets which no pass asked for, e.g. the ones of a transparency technique no longer in use
+    RenderTargetPool::collect();
+}
+
+void FrameGraph::reset() {
+    m_resources.clear();
+    m_passes.clear();
+}
+
+void FrameGraph::clear() {
+    StateCache::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (auto iter = m_framebuffers.begin(); iter != m_framebuffers.end(); iter++)
+        glDeleteFramebuffers(1, &iter->second);
+    m_framebuffers.clear();
+}
+
+unsigned int FrameGraph::getTexture(FrameGraphResource resource) const {
+    return resource == FRAMEGRAPH_NONE ? 0 : m_resources[resource].object;
+}
+
+unsigned int FrameGraph::getBuffer(FrameGraphResource resource) const {
+    return resource == FRAMEGRAPH_NONE ? 0 : m_resources[resource].object;
+}
+
+unsigned int FrameGraph::getPassNumber() const {
+    return m_passNumber;
+}
+
+unsigned int FrameGraph::getCulledPassNumber() const {
+    return m_culledPassNumber;
+}
+
+unsigned int FrameGraph::getBarrierNumber() const {
+    return m_barrierNumber;
+}
+
+unsigned int FrameGraph::getTransientNumber() const {
+    return m_transientNumber;
+}
+
+unsigned int FrameGraph::getAliasedNumber() const {
+    return m_aliasedNumber;
+}
+
+
+// --- Private methods
+FrameGraphResource FrameGraph::addResource(const char *name, bool imported, unsigned int object, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers) {
+    m_resources.push_back(FrameGraphResourceNode{ name, imported, false, object, internalFormat, width, height, layers, -1, -1 });
+    return (FrameGraphResource)(m_resources.size() - 1);
+}
+
+void FrameGraph::cullPasses() {
+    // Writes are never assumed to overwrite a resource entirely, so a resource stays needed by earlier writers too
+    std::vector<bool> needed(m_resources.size(), false);
+    for (size_t r = 0; r < m_resources.size(); r++)
+        needed[r] = m_resources[r].output;
+
+    m_culledPassNumber = 0;
+    for (int p = (int)m_passes.size() - 1; p >= 0; p--) {
+        FrameGraphPassNode &pass = m_passes[p];
+        pass.culled = true;
+        for (const FrameGraphAccessNode &write : pass.writes) {
+            if (needed[write.resource]) {
+                pass.culled = false;
+                break;
+            }
+        }
+        if (pass.culled) {
+            m_culledPassNumber++;
+            continue;
+        }
+        for (const FrameGraphAccessNode &read : pass.reads)
+            needed[read.resource] = true;
+    }
+}
+
+void FrameGraph::computeLifetimes() {
+    m_transientNumber = 0;
+    for (int p = 0; p < (int)m_passes.size(); p++) {
+        const FrameGraphPassNode &pass = m_passes[p];
+        if (pass.culled) continue;
+        for (const std::vector<FrameGraphAccessNode> *accesses : { &pass.reads, &pass.writes }) {
+            for (const FrameGraphAccessNode &access : *accesses) {
+                FrameGraphResourceNode &resource = m_resources[access.resource];
+                if (resource.firstPass < 0) {
+                    resource.firstPass = p;
+                    if (!resource.imported) m_transientNumber++;
+                }
+                resource.lastPass = p;
+            }
+        }
+    }
+}
+
+void FrameGraph::computeBarriers() {
+    // Resources written by shader stores, not yet made visible to the following accesses
+    std::vector<bool> pending(m_resources.size(), false);
+    m_barrierNumber = 0;
+    for (FrameGraphPassNode &pass : m_passes) {
+        pass.barriers = 0;
+        if (pass.culled) continue;
+
+        // A barrier only covers the way the resource is accessed next
+        for (const std::vector<FrameGraphAccessNode> *accesses : { &pass.reads, &pass.writes })
+            for (const FrameGraphAccessNode &access : *accesses)
+                if (pending[access.resource]) pass.barriers |= getBarrierBits(access.access);
+        for (const std::vector<FrameGraphAccessNode> *accesses : { &pass.reads, &pass.writes })
+            for (const FrameGraphAccessNode &access : *accesses)
+                pending[access.resource] = false;
+        if (pass.barriers != 0) m_barrierNumber++;
+
+        // Shader stores of this pass need a barrier before anyone else accesses the resource
+        for (const FrameGraphAccessNode &write : pass.writes)
+            if (write.access == FrameGraphAccess::image || write.access == FrameGraphAccess::storage)
+                pending[write.resource] = true;
+    }
+}
+
+unsigned int FrameGraph::getFramebuffer(const FrameGraphPassNode &pass) {
+    // Look the framebuffer up by its attachments: color textures in order (0 for unused slots), then depth
+    std::vector<unsigned int> key;
+    key.reserve(pass.colorAttachments.size() + 1);
+    for (FrameGraphResource attachment : pass.colorAttachments)
+        key.push_back(getTexture(attachment));
+    key.push_back(getTexture(pass.depthAttachment));
+    auto iter = m_framebuffers.find(key);
+    if (iter != m_framebuffers.end()) return iter->second;
+
+    // Create framebuffer
+    unsigned int framebuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    StateCache::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    // Attach color targets; unused slots draw to GL_NONE
+    GLenum drawBuffers[FRAMEGRAPH_MAXATTACHMENTS];
+    unsigned int colorNumber = (unsigned int)std::min(pass.colorAttachments.size(), (size_t)FRAMEGRAPH_MAXATTACHMENTS);
+    for (unsigned int i = 0; i < colorNumber; i++) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, key[i], 0);
+        drawBuffers[i] = key[i] != 0 ? GL_COLOR_ATTACHMENT0 + i : GL_NONE;
+    }
+    if (colorNumber > 0) glDrawBuffers(colorNumber, drawBuffers);
+    else {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    // Attach depth target
+    if (key.back() != 0) glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, key.back(), 0);
+
+    // Check if the FBO is complete
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER: " << pass.name << " FBO not complete.\n";
+    m_framebuffers[key] = framebuffer;
+    return framebuffer;
+}
+
+GLbitfield FrameGraph::getBarrierBits(FrameGraphAccess access) {
+    switch (access) {
+        case FrameGraphAccess::renderTarget:
+            return GL_FRAMEBUFFER_BARRIER_BIT;
+        case FrameGraphAccess::texture:
+            return GL_TEXTURE_FETCH_BARRIER_BIT;
+        case FrameGraphAccess::image:
+            return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        case FrameGraphAccess::indirect:
+            return GL_COMMAND_BARRIER_BIT;
+        case FrameGraphAccess::storage:
+        default:
+            return GL_SHADER_STORAGE_BARRIER_BIT;
+    }
+}
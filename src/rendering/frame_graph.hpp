@@ -0,0 +1,117 @@
+#ifndef FRAME_GRAPH_HPP
+#define FRAME_GRAPH_HPP
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "consts.hpp"
+
+
+// --- Handle to a resource of the frame graph; FRAMEGRAPH_NONE stands for no resource
+typedef unsigned int FrameGraphResource;
+
+// --- How a pass accesses a resource
+// Render targets are attachments (or blending destinations), textures are sampled, images and storage buffers are
+// accessed by shader stores and atomics, whose writes need a memory barrier before anyone else reads them. Indirect
+// buffers are read by draw commands, for their arguments and draw counts.
+enum class FrameGraphAccess { renderTarget, texture, image, storage, indirect };
+
+// --- Texture or buffer used by the passes of a frame
+// Imported resources are owned by the caller and outlive the frame; transient textures live from their first use
+// to their last one, and are backed by render targets of the pool in the meanwhile.
+struct FrameGraphResourceNode {
+    const char *name;
+    bool imported;
+    bool output;            // Imported resource read after the frame, keeping its writers alive
+    unsigned int object;    // Texture or buffer; 0 for transient textures outside of their lifetime
+    GLenum internalFormat;
+    unsigned int width;
+    unsigned int height;
+    unsigned int layers;
+    int firstPass;          // Lifetime among the passes left by culling; -1 if never used
+    int lastPass;
+};
+
+// --- Resource accessed by a pass
+struct FrameGraphAccessNode {
+    FrameGraphResource resource;
+    FrameGraphAccess access;
+};
+
+// --- Pass of the frame graph, recorded by addPass and run by execute
+struct FrameGraphPassNode {
+    const char *name;
+    std::function<void()> execute;
+    std::vector<FrameGraphAccessNode> reads;
+    std::vector<FrameGraphAccessNode> writes;
+    std::vector<FrameGraphResource> colorAttachments;
+    FrameGraphResource depthAttachment;
+    bool culled;
+    GLbitfield barriers;    // Memory barriers issued before the pass
+};
+
+// --- FrameGraph class
+// Passes of a frame declare which resources they read and write; the graph then culls the passes whose results are
+// never read, inserts memory barriers after shader writes, builds the framebuffers of each pass, and backs transient
+// textures with pooled render targets only for the span of passes using them.
+class FrameGraph {
+    public:
+        // --- Constructor
+        FrameGraph();
+
+        // --- Public methods
+        // Resources
+        FrameGraphResource importTexture(const char *name, unsigned int texture);
+        FrameGraphResource importBuffer(const char *name, unsigned int buffer);
+        FrameGraphResource createTexture(const char *name, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers = 1);
+        void markOutput(FrameGraphResource resource);
+
+        // Passes; accesses and attachments are declared on the last pass added
+        void addPass(const char *name, std::function<void()> execute);
+        void read(FrameGraphResource resource, FrameGraphAccess access = FrameGraphAccess::texture);
+        void write(FrameGraphResource resource, FrameGraphAccess access = FrameGraphAccess::renderTarget);
+        void setColorAttachments(std::vector<FrameGraphResource> attachments);
+        void setDepthAttachment(FrameGraphResource resource, bool depthWrite);
+
+        // Frame
+        void compile();
+        void execute();
+        void reset();
+        void clear();
+
+        // Getters; objects of transient textures are valid only while their passes run
+        unsigned int getTexture(FrameGraphResource resource) const;
+        unsigned int getBuffer(FrameGraphResource resource) const;
+        unsigned int getPassNumber() const;
+        unsigned int getCulledPassNumber() const;
+        unsigned int getBarrierNumber() const;
+        unsigned int getTransientNumber() const;
+        unsigned int getAliasedNumber() const;
+
+    private:
+        // --- Private methods
+        FrameGraphResource addResource(const char *name, bool imported, unsigned int object, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers);
+        void cullPasses();
+        void computeLifetimes();
+        void computeBarriers();
+        unsigned int getFramebuffer(const FrameGraphPassNode &pass);
+        static GLbitfield getBarrierBits(FrameGraphAccess access);
+
+        // --- Private members
+        std::vector<FrameGraphResourceNode> m_resources;
+        std::vector<FrameGraphPassNode> m_passes;
+        std::map<std::vector<unsigned int>, unsigned int> m_framebuffers;   // Keyed by attached textures
+        std::vector<unsigned int> m_releasedTextures;
+        unsigned int m_poolGeneration;
+        unsigned int m_passNumber;          // Statistics of the last frame compiled
+        unsigned int m_culledPassNumber;
+        unsigned int m_barrierNumber;
+        unsigned int m_transientNumber;
+        unsigned int m_aliasedNumber;
+};
+
+
+#endif // FRAME_GRAPH_HPP
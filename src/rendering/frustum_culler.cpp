@@ -0,0 +1,223 @@
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+#include "consts.hpp"
+#include "rendering/frustum_culler.hpp"
+#include "resources/model.hpp"
+
+
+// --- Private static members
+bool FrustumCuller::s_enabled{ FRUSTUMCULLER_ENABLED };
+glm::vec4 FrustumCuller::s_planes[6];
+std::vector<float> FrustumCuller::s_centersX;
+std::vector<float> FrustumCuller::s_centersY;
+std::vector<float> FrustumCuller::s_centersZ;
+std::vector<float> FrustumCuller::s_extentsX;
+std::vector<float> FrustumCuller::s_extentsY;
+std::vector<float> FrustumCuller::s_extentsZ;
+std::vector<float> FrustumCuller::s_radii;
+std::vector<unsigned char> FrustumCuller::s_outside;
+std::vector<Entity*> FrustumCuller::s_visibleOpaqueEntities;
+std::vector<Entity*> FrustumCuller::s_visibleTransparentEntities;
+unsigned int FrustumCuller::s_version{ 0 };
+unsigned int FrustumCuller::s_testedNumber{ 0 };
+unsigned int FrustumCuller::s_culledNumber{ 0 };
+
+
+// --- Public static methods
+void FrustumCuller::cull(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities, const glm::mat4 &viewProjection) {
+    // How frustum culling works:
+    //      1) The six planes are extracted from the rows of the view-projection matrix, pointing inwards;
+    //      2) World-space bounds of every entity are gathered into SoA arrays: sphere center and radius, and the
+    //         half-extents of the box rotated along with the entity;
+    //      3) Each plane is tested against eight (AVX) or four (SSE) entities at once. The reach of an entity towards
+    //         the plane is the smaller one between its sphere radius and its box projected on the plane's normal;
+    //         the entity is outside if its center lies farther than its reach behind any plane;
+    //      4) Entities left are written to the visible sets, which are compared in place with last frame's ones.
+    //
+    // SOURCE: https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++)
+        rows[r] = glm::vec4{ viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r] };
+    for (int p = 0; p < 3; p++) {
+        s_planes[2 * p] = rows[3] + rows[p];
+        s_planes[2 * p + 1] = rows[3] - rows[p];
+    }
+    for (int p = 0; p < 6; p++)
+        s_planes[p] /= glm::length(glm::vec3{ s_planes[p] });
+
+    s_testedNumber = 0;
+    s_culledNumber = 0;
+    bool opaqueChanged = cullEntities(opaqueEntities, s_visibleOpaqueEntities);
+    bool transparentChanged = cullEntities(transparentEntities, s_visibleTransparentEntities);
+    if (opaqueChanged || transparentChanged) s_version++;
+}
+
+std::vector<Entity*> *FrustumCuller::getVisibleOpaqueEntities() {
+    return &s_visibleOpaqueEntities;
+}
+
+std::vector<Entity*> *FrustumCuller::getVisibleTransparentEntities() {
+    return &s_visibleTransparentEntities;
+}
+
+unsigned int FrustumCuller::getVersion() {
+    return s_version;
+}
+
+unsigned int FrustumCuller::getTestedNumber() {
+    return s_testedNumber;
+}
+
+unsigned int FrustumCuller::getCulledNumber() {
+    return s_culledNumber;
+}
+
+bool FrustumCuller::getEnabled() {
+    return s_enabled;
+}
+
+void FrustumCuller::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+
+// --- Private static methods
+bool FrustumCuller::cullEntities(std::vector<Entity*> *entities, std::vector<Entity*> &visible) {
+    // With culling off, every entity is visible
+    size_t count = entities->size();
+    if (s_enabled) {
+        gatherBounds(entities);
+        testBounds();
+        s_testedNumber += (unsigned int)count;
+    } else s_outside.assign(count, 0);
+
+    // Compact visible entities, noting whether the set differs from the previous one
+    bool changed = false;
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (s_outside[i]) {
+            s_culledNumber++;
+            continue;
+        }
+        Entity *entity = (*entities)[i];
+        if (visibleCount == visible.size()) {
+            visible.push_back(entity);
+            changed = true;
+        } else if (visible[visibleCount] != entity) {
+            visible[visibleCount] = entity;
+            changed = true;
+        }
+        visibleCount++;
+    }
+    if (visibleCount != visible.size()) {
+        visible.resize(visibleCount);
+        changed = true;
+    }
+    return changed;
+}
+
+void FrustumCuller::gatherBounds(std::vector<Entity*> *entities) {
+    // Results of padding lanes are never read
+    size_t count = entities->size();
+    size_t paddedCount = (count + 7) & ~(size_t)7;
+    for (std::vector<float> *values : { &s_centersX, &s_centersY, &s_centersZ, &s_extentsX, &s_extentsY, &s_extentsZ, &s_radii })
+        values->resize(paddedCount, 0.0f);
+    for (size_t i = 0; i < count; i++) {
+        Entity *entity = (*entities)[i];
+        glm::vec3 center, extents;
+        entity->getWorldBounds(center, extents);
+        s_centersX[i] = center.x;
+        s_centersY[i] = center.y;
+        s_centersZ[i] = center.z;
+        s_extentsX[i] = extents.x;
+        s_extentsY[i] = extents.y;
+        s_extentsZ[i] = extents.z;
+        s_radii[i] = entity->getModel()->getBounds().radius;
+    }
+}
+
+void FrustumCuller::testBounds() {
+    // An entity is outside if, for any plane: n . c + d + min(radius, |n| . e) < 0
+    size_t count = s_centersX.size();
+    s_outside.resize(count);
+#if defined(FRUSTUM_CULLER_AVX)
+    // Broadcast every plane coefficient, so that each lane handles one entity
+    __m256 planes[6][7];
+    for (int p = 0; p < 6; p++) {
+        for (int k = 0; k < 4; k++)
+            planes[p][k] = _mm256_set1_ps(s_planes[p][k]);
+        for (int k = 0; k < 3; k++)
+            planes[p][4 + k] = _mm256_set1_ps(glm::abs(s_planes[p][k]));
+    }
+    __m256 zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&s_centersX[i]);
+        __m256 cy = _mm256_loadu_ps(&s_centersY[i]);
+        __m256 cz = _mm256_loadu_ps(&s_centersZ[i]);
+        __m256 ex = _mm256_loadu_ps(&s_extentsX[i]);
+        __m256 ey = _mm256_loadu_ps(&s_extentsY[i]);
+        __m256 ez = _mm256_loadu_ps(&s_extentsZ[i]);
+        __m256 radius = _mm256_loadu_ps(&s_radii[i]);
+        __m256 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], cx), _mm256_mul_ps(planes[p][1], cy)), _mm256_add_ps(_mm256_mul_ps(planes[p][2], cz), planes[p][3]));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][4], ex), _mm256_mul_ps(planes[p][5], ey)), _mm256_mul_ps(planes[p][6], ez));
+            reach = _mm256_min_ps(reach, radius);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+        }
+        int mask = _mm256_movemask_ps(outside);
+        for (int lane = 0; lane < 8; lane++)
+            s_outside[i + lane] = (unsigned char)((mask >> lane) & 1);
+    }
+#elif defined(FRUSTUM_CULLER_SSE)
+    // Broadcast every plane coefficient, so that each lane handles one entity
+    __m128 planes[6][7];
+    for (int p = 0; p < 6; p++) {
+        for (int k = 0; k < 4; k++)
+            planes[p][k] = _mm_set1_ps(s_planes[p][k]);
+        for (int k = 0; k < 3; k++)
+            planes[p][4 + k] = _mm_set1_ps(glm::abs(s_planes[p][k]));
+    }
+    __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 cx = _mm_loadu_ps(&s_centersX[i]);
+        __m128 cy = _mm_loadu_ps(&s_centersY[i]);
+        __m128 cz = _mm_loadu_ps(&s_centersZ[i]);
+        __m128 ex = _mm_loadu_ps(&s_extentsX[i]);
+        __m128 ey = _mm_loadu_ps(&s_extentsY[i]);
+        __m128 ez = _mm_loadu_ps(&s_extentsZ[i]);
+        __m128 radius = _mm_loadu_ps(&s_radii[i]);
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], cx), _mm_mul_ps(planes[p][1], cy)), _mm_add_ps(_mm_mul_ps(planes[p][2], cz), planes[p][3]));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][4], ex), _mm_mul_ps(planes[p][5], ey)), _mm_mul_ps(planes[p][6], ez));
+            reach = _mm_min_ps(reach, radius);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int lane = 0; lane < 4; lane++)
+            s_outside[i + lane] = (unsigned char)((mask >> lane) & 1);
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            glm::vec3 normal{ s_planes[p] };
+            float distance = glm::dot(normal, glm::vec3{ s_centersX[i], s_centersY[i], s_centersZ[i] }) + s_planes[p].w;
+            float reach = glm::min(glm::dot(glm::abs(normal), glm::vec3{ s_extentsX[i], s_extentsY[i], s_extentsZ[i] }), s_radii[i]);
+            outside = distance + reach < 0.0f;
+        }
+        s_outside[i] = (unsigned char)outside;
+    }
+#endif
+}
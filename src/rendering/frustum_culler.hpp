@@ -0,0 +1,54 @@
+#ifndef FRUSTUM_CULLER_HPP
+#define FRUSTUM_CULLER_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/entity.hpp"
+
+
+// --- FrustumCuller class
+// Keeps, once per frame, the entities whose bounding volumes intersect the view frustum; every pass then draws from
+// these visible sets only. Entity order is preserved.
+class FrustumCuller {
+    public:
+        // --- Public static methods
+        static void cull(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities, const glm::mat4 &viewProjection);
+        static std::vector<Entity*> *getVisibleOpaqueEntities();
+        static std::vector<Entity*> *getVisibleTransparentEntities();
+        static unsigned int getVersion();
+        static unsigned int getTestedNumber();
+        static unsigned int getCulledNumber();
+        static bool getEnabled();
+        static void setEnabled(bool enabled);
+
+    private:
+        // --- Private constructor
+        FrustumCuller();
+
+        // --- Private static methods
+        static bool cullEntities(std::vector<Entity*> *entities, std::vector<Entity*> &visible);
+        static void gatherBounds(std::vector<Entity*> *entities);
+        static void testBounds();
+
+        // --- Private static members
+        static bool s_enabled;
+        static glm::vec4 s_planes[6];
+        static std::vector<float> s_centersX;   // World-space bounds, padded to a multiple of the SIMD width
+        static std::vector<float> s_centersY;
+        static std::vector<float> s_centersZ;
+        static std::vector<float> s_extentsX;
+        static std::vector<float> s_extentsY;
+        static std::vector<float> s_extentsZ;
+        static std::vector<float> s_radii;
+        static std::vector<unsigned char> s_outside;
+        static std::vector<Entity*> s_visibleOpaqueEntities;
+        static std::vector<Entity*> s_visibleTransparentEntities;
+        static unsigned int s_version;          // Incremented whenever a visible set changes
+        static unsigned int s_testedNumber;
+        static unsigned int s_culledNumber;
+};
+
+
+#endif // FRUSTUM_CULLER_HPP
@@ -0,0 +1,336 @@
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "consts.hpp"
+#include "rendering/gpu_culler.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/transform_stage.hpp"
+#include "resources/resource_manager.hpp"
+
+
+// --- Private static members
+bool GpuCuller::s_enabled{ GPUCULLER_ENABLED };
+bool GpuCuller::s_occlusionCulling{ GPUCULLER_OCCLUSION };
+bool GpuCuller::s_meshletCulling{ GPUCULLER_MESHLETS };
+Shader *GpuCuller::s_cullingShader{ nullptr };
+Shader *GpuCuller::s_depthPyramidShader{ nullptr };
+UniformHandle<int> GpuCuller::s_itemsNumberUniform;
+UniformHandle<int> GpuCuller::s_occlusionCullingUniform;
+UniformHandle<int> GpuCuller::s_meshletCullingUniform;
+UniformHandle<glm::mat4> GpuCuller::s_previousViewProjectionUniform;
+UniformHandle<int> GpuCuller::s_sourceLevelUniform;
+std::vector<GpuCullItem> GpuCuller::s_items;
+std::vector<GpuModelBounds> GpuCuller::s_modelBounds;
+std::vector<GpuMesh> GpuCuller::s_meshes;
+std::vector<GpuMeshlet> GpuCuller::s_meshlets;
+std::vector<Model*> GpuCuller::s_models;
+std::vector<unsigned int> GpuCuller::s_modelFirstMeshes;
+std::vector<unsigned int> GpuCuller::s_listFirstCommands;
+std::vector<unsigned int> GpuCuller::s_listCapacities;
+unsigned int GpuCuller::s_commandCapacity{ 0 };
+unsigned int GpuCuller::s_itemsSSBO{ 0 };
+unsigned int GpuCuller::s_itemsSSBOCapacity{ 0 };
+unsigned int GpuCuller::s_modelBoundsSSBO{ 0 };
+unsigned int GpuCuller::s_modelBoundsSSBOCapacity{ 0 };
+unsigned int GpuCuller::s_meshesSSBO{ 0 };
+unsigned int GpuCuller::s_meshesSSBOCapacity{ 0 };
+unsigned int GpuCuller::s_meshletsSSBO{ 0 };
+unsigned int GpuCuller::s_meshletsSSBOCapacity{ 0 };
+unsigned int GpuCuller::s_reachesSSBO{ 0 };
+unsigned int GpuCuller::s_reachesSSBOCapacity{ 0 };
+unsigned int GpuCuller::s_commandsBuffer{ 0 };
+unsigned int GpuCuller::s_commandsBufferCapacity{ 0 };
+unsigned int GpuCuller::s_countsBuffer{ 0 };
+unsigned int GpuCuller::s_countsBufferCapacity{ 0 };
+unsigned int GpuCuller::s_depthPyramid{ 0 };
+unsigned int GpuCuller::s_depthPyramidWidth{ 0 };
+unsigned int GpuCuller::s_depthPyramidHeight{ 0 };
+unsigned int GpuCuller::s_depthPyramidLevels{ 0 };
+
+
+// --- Public static methods
+void GpuCuller::init() {
+    // Load shaders and resolve their uniforms
+    s_cullingShader = ResourceManager::loadComputeShader("gpuCullingShader", GPUCULLER_CULLING_COMPUTE, { "GROUP_SIZE " + std::to_string(GPUCULLER_GROUPSIZE) });
+    s_depthPyramidShader = ResourceManager::loadComputeShader("depthPyramidShader", GPUCULLER_DEPTHPYRAMID_COMPUTE, { "GROUP_SIZE " + std::to_string(GPUCULLER_DEPTHPYRAMID_GROUPSIZE) });
+    s_itemsNumberUniform = s_cullingShader->getUniform<int>(SHADER_NAME("itemsNumber"));
+    s_occlusionCullingUniform = s_cullingShader->getUniform<int>(SHADER_NAME("occlusionCulling"));
+    s_meshletCullingUniform = s_cullingShader->getUniform<int>(SHADER_NAME("meshletCulling"));
+    s_previousViewProjectionUniform = s_cullingShader->getUniform<glm::mat4>(SHADER_NAME("previousViewProjection"));
+    s_sourceLevelUniform = s_depthPyramidShader->getUniform<int>(SHADER_NAME("sourceLevel"));
+
+    // Create buffers; they grow with the number of instances. The depth pyramid follows the framebuffer's size.
+    glGenBuffers(1, &s_itemsSSBO);
+    glGenBuffers(1, &s_modelBoundsSSBO);
+    glGenBuffers(1, &s_meshesSSBO);
+    glGenBuffers(1, &s_meshletsSSBO);
+    glGenBuffers(1, &s_reachesSSBO);
+    glGenBuffers(1, &s_commandsBuffer);
+    glGenBuffers(1, &s_countsBuffer);
+}
+
+void GpuCuller::setupLists(const std::vector<DrawList*> &drawLists) {
+    // Flatten every draw list into one item per instance
+    // Each list owns a range of compacted commands as large as its instances times their meshlets, so that it can
+    // never overflow into the next one. Lists are numbered in the order given.
+    s_items.clear();
+    s_models.clear();
+    s_modelFirstMeshes.clear();
+    s_modelBounds.clear();
+    s_meshes.clear();
+    s_meshlets.clear();
+    s_listFirstCommands.clear();
+    s_listCapacities.clear();
+    unsigned int output = 0;
+    for (unsigned int l = 0; l < (unsigned int)drawLists.size(); l++) {
+        const DrawList &drawList = *drawLists[l];
+        unsigned int firstTemplate = drawList.firstCommand;
+        s_listFirstCommands.push_back(output);
+        for (const DrawGroup &group : drawList.groups) {
+            // Models are few, so their bounds and meshlets are searched linearly
+            unsigned int model = 0;
+            while (model < s_models.size() && s_models[model] != group.model) model++;
+            if (model == s_models.size()) {
+                const BoundingVolume &bounds = group.model->getBounds();
+                s_models.push_back(group.model);
+                s_modelFirstMeshes.push_back((unsigned int)s_meshes.size());
+                s_modelBounds.push_back(GpuModelBounds{ glm::vec4{ bounds.center, bounds.radius }, glm::vec4{ (bounds.max - bounds.min) * 0.5f, 0.0f } });
+                for (const Mesh &mesh : group.model->getMeshes()) {
+                    s_meshes.push_back(GpuMesh{ (unsigned int)s_meshlets.size(), (unsigned int)mesh.getMeshlets().size() });
+                    for (const Meshlet &meshlet : mesh.getMeshlets())
+                        s_meshlets.push_back(GpuMeshlet{ glm::vec4{ meshlet.center, meshlet.radius }, glm::vec4{ meshlet.coneAxis, meshlet.coneCutoff }, meshlet.firstIndex, meshlet.indexCount, { 0, 0 } });
+                }
+            }
+
+            // Groups emit one command per mesh, in order (see Renderer::buildRenderQueue)
+            // Instances take up to one command per meshlet, or one per mesh for meshes without any.
+            unsigned int meshCount = (unsigned int)group.model->getMeshesNumber();
+            unsigned int instanceCapacity = 0;
+            for (unsigned int m = 0; m < meshCount; m++)
+                instanceCapacity += glm::max(s_meshes[s_modelFirstMeshes[model] + m].meshletCount, 1u);
+            for (unsigned int i = 0; i < group.instanceCount; i++)
+                s_items.push_back(GpuCullItem{ group.firstInstance + i, model, firstTemplate, meshCount, l, s_listFirstCommands[l], s_modelFirstMeshes[model], (unsigned int)drawList.backFaceCulling, drawList.peel });
+            firstTemplate += meshCount;
+            output += group.instanceCount * instanceCapacity;
+        }
+        s_listCapacities.push_back(output - s_listFirstCommands[l]);
+    }
+    s_commandCapacity = output;
+
+    // Upload items, bounds and meshlets, and size the compacted commands and their counts
+    setupBuffer(s_itemsSSBO, s_itemsSSBOCapacity, (unsigned int)s_items.size(), sizeof(GpuCullItem), s_items.data());
+    setupBuffer(s_modelBoundsSSBO, s_modelBoundsSSBOCapacity, (unsigned int)s_modelBounds.size(), sizeof(GpuModelBounds), s_modelBounds.data());
+    setupBuffer(s_meshesSSBO, s_meshesSSBOCapacity, (unsigned int)s_meshes.size(), sizeof(GpuMesh), s_meshes.data());
+    setupBuffer(s_meshletsSSBO, s_meshletsSSBOCapacity, (unsigned int)s_meshlets.size(), sizeof(GpuMeshlet), s_meshlets.data());
+    setupBuffer(s_commandsBuffer, s_commandsBufferCapacity, s_commandCapacity, sizeof(DrawElementsIndirectCommand), nullptr);
+    setupBuffer(s_countsBuffer, s_countsBufferCapacity, (unsigned int)drawLists.size(), sizeof(unsigned int), nullptr);
+}
+
+void GpuCuller::setupReaches(const std::vector<unsigned int> &reaches) {
+    // Peels reached by each instance, indexed by instance
+    setupBuffer(s_reachesSSBO, s_reachesSSBOCapacity, (unsigned int)reaches.size(), sizeof(unsigned int), reaches.data());
+}
+
+void GpuCuller::cull(unsigned int drawCommandsBuffer, unsigned int depthBuffer, unsigned int width, unsigned int height, const glm::mat4 &previousViewProjection, bool previousDepthValid) {
+    // How GPU culling works:
+    //      1) Draw lists are flattened into cull items whenever the render queue is rebuilt: one per instance of each
+    //         list, pointing at the commands of its group (see setupLists);
+    //      2) The opaque depth buffer, still holding the previous frame, is reduced into a pyramid whose texels keep
+    //         the farthest depth below them;
+    //      3) One invocation per item drops the instance from peel lists past the last peel it reaches (see
+    //         Renderer::uploadInstanceReaches), then tests its world-space box against the frustum planes, projects
+    //         it with the previous frame's camera, and compares its nearest depth with the pyramid, on the level where
+    //         the box spans 2x2 texels;
+    //      4) Visible items then test the bounding sphere of each meshlet against the frustum planes, and, on lists
+    //         culling back faces, its normal cone against the camera position: a meshlet whose every triangle faces
+    //         away would be dropped by the rasterizer anyway;
+    //      5) Visible meshlets are appended as commands to their list's range, counted by an atomic per list; every
+    //         geometry pass then draws its list with a single glMultiDrawElementsIndirectCount.
+    // The CPU only dispatches, whatever the number of instances. Occlusion lags a frame behind, though: an instance
+    // revealed by a camera move is drawn from the next frame on. Transparent lists draw back faces, so that they only
+    // test meshlets against the frustum.
+    //
+    // SOURCE: Haar, Aaltonen - GPU-Driven Rendering Pipelines (SIGGRAPH 2015)
+    // SOURCE: https://github.com/zeux/meshoptimizer (meshopt_computeMeshletBounds)
+    if (s_items.empty()) return;
+
+    // 2) Build depth pyramid; the depth buffer holds nothing usable right after being reallocated
+    bool occlusion = s_occlusionCulling && previousDepthValid;
+    if (occlusion) {
+        setupDepthPyramid(width, height);
+        buildDepthPyramid(depthBuffer);
+    }
+
+    // Reset counts
+    unsigned int zero = 0;
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_countsBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // 3), 4) and 5) Dispatch one invocation per item
+    // Compacted commands are made visible to the geometry passes by the frame graph, as they read them as indirect.
+    s_cullingShader->use();
+    s_itemsNumberUniform.set((int)s_items.size());
+    s_occlusionCullingUniform.set((int)occlusion);
+    s_meshletCullingUniform.set((int)s_meshletCulling);
+    s_previousViewProjectionUniform.set(previousViewProjection);
+    StateCache::bindTexture(0, GL_TEXTURE_2D, s_depthPyramid);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, s_itemsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s_modelBoundsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, drawCommandsBuffer);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, s_commandsBuffer);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, s_countsBuffer);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, TransformStage::getTransformsSSBO());
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, s_meshesSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, s_meshletsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, s_reachesSSBO);
+    glDispatchCompute(((unsigned int)s_items.size() + GPUCULLER_GROUPSIZE - 1) / GPUCULLER_GROUPSIZE, 1, 1);
+}
+
+void GpuCuller::draw(unsigned int list) {
+    // Commands of the list are compacted at the start of its range; how many were written is read by the GPU
+    if (list >= s_listCapacities.size() || s_listCapacities[list] == 0) return;
+    StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, s_commandsBuffer);
+    StateCache::bindBuffer(GL_PARAMETER_BUFFER, s_countsBuffer);
+    glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(sizeof(DrawElementsIndirectCommand) * s_listFirstCommands[list]), (GLintptr)(sizeof(unsigned int) * list), s_listCapacities[list], 0);
+    StateCache::bindBuffer(GL_PARAMETER_BUFFER, 0);
+    StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+unsigned int GpuCuller::getCommandsBuffer() {
+    return s_commandsBuffer;
+}
+
+unsigned int GpuCuller::getItemNumber() {
+    return (unsigned int)s_items.size();
+}
+
+unsigned int GpuCuller::getCommandCapacity() {
+    return s_commandCapacity;
+}
+
+unsigned int GpuCuller::getMeshletNumber() {
+    return (unsigned int)s_meshlets.size();
+}
+
+unsigned int GpuCuller::getPyramidLevels() {
+    return s_depthPyramidLevels;
+}
+
+bool GpuCuller::getEnabled() {
+    return s_enabled;
+}
+
+void GpuCuller::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+bool GpuCuller::getOcclusionCulling() {
+    return s_occlusionCulling;
+}
+
+void GpuCuller::setOcclusionCulling(bool enabled) {
+    s_occlusionCulling = enabled;
+}
+
+bool GpuCuller::getMeshletCulling() {
+    return s_meshletCulling;
+}
+
+void GpuCuller::setMeshletCulling(bool enabled) {
+    s_meshletCulling = enabled;
+}
+
+void GpuCuller::clear() {
+    StateCache::deleteBuffer(s_itemsSSBO);
+    StateCache::deleteBuffer(s_modelBoundsSSBO);
+    StateCache::deleteBuffer(s_meshesSSBO);
+    StateCache::deleteBuffer(s_meshletsSSBO);
+    StateCache::deleteBuffer(s_reachesSSBO);
+    StateCache::deleteBuffer(s_commandsBuffer);
+    StateCache::deleteBuffer(s_countsBuffer);
+    StateCache::deleteTexture(s_depthPyramid);
+    s_itemsSSBO = 0;
+    s_modelBoundsSSBO = 0;
+    s_meshesSSBO = 0;
+    s_meshletsSSBO = 0;
+    s_reachesSSBO = 0;
+    s_commandsBuffer = 0;
+    s_countsBuffer = 0;
+    s_depthPyramid = 0;
+    s_itemsSSBOCapacity = 0;
+    s_modelBoundsSSBOCapacity = 0;
+    s_meshesSSBOCapacity = 0;
+    s_meshletsSSBOCapacity = 0;
+    s_reachesSSBOCapacity = 0;
+    s_commandsBufferCapacity = 0;
+    s_countsBufferCapacity = 0;
+    s_depthPyramidWidth = 0;
+    s_depthPyramidHeight = 0;
+    s_depthPyramidLevels = 0;
+    s_items.clear();
+    s_models.clear();
+    s_modelFirstMeshes.clear();
+    s_modelBounds.clear();
+    s_meshes.clear();
+    s_meshlets.clear();
+    s_listFirstCommands.clear();
+    s_listCapacities.clear();
+    s_commandCapacity = 0;
+}
+
+
+// --- Private static methods
+void GpuCuller::setupBuffer(unsigned int buffer, unsigned int &capacity, unsigned int size, size_t elementSize, const void *data) {
+    // Allocate more memory only if needed, doubling it so that growing queues reallocate rarely
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (size > capacity) {
+        capacity = glm::max(size, capacity * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, elementSize * capacity, NULL, data != nullptr ? GL_DYNAMIC_DRAW : GL_DYNAMIC_COPY);
+    }
+    if (data != nullptr && size > 0)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, elementSize * size, data);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::setupDepthPyramid(unsigned int width, unsigned int height) {
+    // Level 0 is half the depth buffer's size, down to a single texel
+    unsigned int pyramidWidth = glm::max(width / 2, 1u);
+    unsigned int pyramidHeight = glm::max(height / 2, 1u);
+    if (s_depthPyramid != 0 && pyramidWidth == s_depthPyramidWidth && pyramidHeight == s_depthPyramidHeight) return;
+
+    // Storage is immutable, so a new size takes a new texture
+    if (s_depthPyramid != 0) StateCache::deleteTexture(s_depthPyramid);
+    s_depthPyramidWidth = pyramidWidth;
+    s_depthPyramidHeight = pyramidHeight;
+    s_depthPyramidLevels = 1;
+    while ((glm::max(pyramidWidth, pyramidHeight) >> s_depthPyramidLevels) > 0) s_depthPyramidLevels++;
+    glGenTextures(1, &s_depthPyramid);
+    StateCache::bindTexture(0, GL_TEXTURE_2D, s_depthPyramid);
+    glTexStorage2D(GL_TEXTURE_2D, s_depthPyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
+}
+
+void GpuCuller::buildDepthPyramid(unsigned int depthBuffer) {
+    // Reduce the depth buffer into level 0, then each level into the next one
+    // Levels are read texel by texel and written as images; each one is made visible to the next by a barrier.
+    s_depthPyramidShader->use();
+    for (unsigned int level = 0; level < s_depthPyramidLevels; level++) {
+        if (level == 0) StateCache::bindTexture(0, GL_TEXTURE_2D, depthBuffer);
+        else {
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            StateCache::bindTexture(0, GL_TEXTURE_2D, s_depthPyramid);
+        }
+        s_sourceLevelUniform.set(level == 0 ? 0 : (int)level - 1);
+        StateCache::bindImageTexture(0, s_depthPyramid, level, GL_FALSE, GL_WRITE_ONLY, GL_R32F);
+        unsigned int levelWidth = glm::max(s_depthPyramidWidth >> level, 1u);
+        unsigned int levelHeight = glm::max(s_depthPyramidHeight >> level, 1u);
+        glDispatchCompute((levelWidth + GPUCULLER_DEPTHPYRAMID_GROUPSIZE - 1) / GPUCULLER_DEPTHPYRAMID_GROUPSIZE, (levelHeight + GPUCULLER_DEPTHPYRAMID_GROUPSIZE - 1) / GPUCULLER_DEPTHPYRAMID_GROUPSIZE, 1);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
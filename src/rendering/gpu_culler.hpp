@@ -0,0 +1,127 @@
+#ifndef GPU_CULLER_HPP
+#define GPU_CULLER_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "rendering/renderer.hpp"
+#include "resources/model.hpp"
+#include "resources/shader.hpp"
+
+
+// --- Instance of a draw list to test, laid out as std430 for the cull items SSBO (see gpuCullingShader.comp)
+struct GpuCullItem {
+    unsigned int instance;
+    unsigned int model;         // Index of the model's bounds
+    unsigned int firstTemplate; // First command of the instance's draw group, one per mesh
+    unsigned int meshCount;
+    unsigned int list;
+    unsigned int firstOutput;   // First compacted command of the list
+    unsigned int firstMesh;     // Index of the model's first mesh
+    unsigned int coneCulling;   // Whether the list culls back faces, so that meshlets facing away can be dropped
+    unsigned int peel;          // Depth peel the list draws; instances reaching no further are dropped
+};
+
+// --- Model-space bounds of a model, laid out as std430 for the model bounds SSBO
+struct GpuModelBounds {
+    glm::vec4 centerRadius;
+    glm::vec4 extents;
+};
+
+// --- Meshlets of a mesh, laid out as std430 for the meshes SSBO
+struct GpuMesh {
+    unsigned int firstMeshlet;
+    unsigned int meshletCount;
+};
+
+// --- Model-space bounds of a meshlet and its range of indices, laid out as std430 for the meshlets SSBO (see Meshlet)
+struct GpuMeshlet {
+    glm::vec4 centerRadius;
+    glm::vec4 coneAxisCutoff;
+    unsigned int firstIndex;    // Relative to the mesh's first index
+    unsigned int indexCount;
+    unsigned int padding[2];
+};
+
+// --- GpuCuller class
+// Tests every instance of the render queue against the view frustum and a depth pyramid of the previous frame in a
+// compute pass, then the meshlets of visible instances against the frustum and their normal cones. Compacted indirect
+// commands and their number per draw list are written, and draw lists are then submitted with
+// glMultiDrawElementsIndirectCount, so that the CPU never touches visible sets.
+// The CPU still does per-entity work every frame, linear in the number of entities: TransformStage::update computes
+// every instance's matrices, and Renderer::computeTransparencyBounds projects every transparent entity's bounds.
+// setupLists runs only when the render queue is rebuilt, which camera movement alone no longer triggers; the peels
+// reached by instances, which change as they enter and leave the view, are uploaded apart by setupReaches.
+class GpuCuller {
+    public:
+        // --- Public static methods
+        static void init();
+        static void setupLists(const std::vector<DrawList*> &drawLists);
+        static void setupReaches(const std::vector<unsigned int> &reaches);
+        static void cull(unsigned int drawCommandsBuffer, unsigned int depthBuffer, unsigned int width, unsigned int height, const glm::mat4 &previousViewProjection, bool previousDepthValid);
+        static void draw(unsigned int list);
+        static unsigned int getCommandsBuffer();
+        static unsigned int getItemNumber();
+        static unsigned int getCommandCapacity();
+        static unsigned int getMeshletNumber();
+        static unsigned int getPyramidLevels();
+        static bool getEnabled();
+        static void setEnabled(bool enabled);
+        static bool getOcclusionCulling();
+        static void setOcclusionCulling(bool enabled);
+        static bool getMeshletCulling();
+        static void setMeshletCulling(bool enabled);
+        static void clear();
+
+    private:
+        // --- Private constructor
+        GpuCuller();
+
+        // --- Private static methods
+        static void setupBuffer(unsigned int buffer, unsigned int &capacity, unsigned int size, size_t elementSize, const void *data);
+        static void setupDepthPyramid(unsigned int width, unsigned int height);
+        static void buildDepthPyramid(unsigned int depthBuffer);
+
+        // --- Private static members
+        static bool s_enabled;
+        static bool s_occlusionCulling;
+        static bool s_meshletCulling;
+        static Shader *s_cullingShader;
+        static Shader *s_depthPyramidShader;
+        static UniformHandle<int> s_itemsNumberUniform;
+        static UniformHandle<int> s_occlusionCullingUniform;
+        static UniformHandle<int> s_meshletCullingUniform;
+        static UniformHandle<glm::mat4> s_previousViewProjectionUniform;
+        static UniformHandle<int> s_sourceLevelUniform;
+        static std::vector<GpuCullItem> s_items;
+        static std::vector<GpuModelBounds> s_modelBounds;
+        static std::vector<GpuMesh> s_meshes;
+        static std::vector<GpuMeshlet> s_meshlets;
+        static std::vector<Model*> s_models;
+        static std::vector<unsigned int> s_modelFirstMeshes;
+        static std::vector<unsigned int> s_listFirstCommands;
+        static std::vector<unsigned int> s_listCapacities;
+        static unsigned int s_commandCapacity;
+        static unsigned int s_itemsSSBO;
+        static unsigned int s_itemsSSBOCapacity;
+        static unsigned int s_modelBoundsSSBO;
+        static unsigned int s_modelBoundsSSBOCapacity;
+        static unsigned int s_meshesSSBO;
+        static unsigned int s_meshesSSBOCapacity;
+        static unsigned int s_meshletsSSBO;
+        static unsigned int s_meshletsSSBOCapacity;
+        static unsigned int s_reachesSSBO;
+        static unsigned int s_reachesSSBOCapacity;
+        static unsigned int s_commandsBuffer;
+        static unsigned int s_commandsBufferCapacity;
+        static unsigned int s_countsBuffer;
+        static unsigned int s_countsBufferCapacity;
+        static unsigned int s_depthPyramid;
+        static unsigned int s_depthPyramidWidth;   // Level 0, half the depth buffer's size
+        static unsigned int s_depthPyramidHeight;
+        static unsigned int s_depthPyramidLevels;
+};
+
+
+#endif // GPU_CULLER_HPP
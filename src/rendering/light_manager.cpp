@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstddef>
+#include <limits>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -8,11 +9,13 @@
 
 #include "rendering/light_manager.hpp"
 #include "rendering/lights.hpp"
+#include "rendering/state_cache.hpp"
 
 
 // --- Public static members
 glm::vec3 LightManager::s_ambientLight{ LIGHT_COLOR_AMBIENT };
 std::vector<PointLight> LightManager::s_pointLights;
+std::vector<PointLight> LightManager::s_viewSpacePointLights;
 unsigned int LightManager::s_pointLightsSSBO{ 0 };
 int LightManager::s_numberOfShownPointLights{ LIGHT_NUMSHOWN };
 float LightManager::s_pointLightsRotationSpeed{ LIGHT_ROTSPEED };
@@ -22,10 +25,10 @@ float LightManager::s_pointLightsRotationSpeed{ LIGHT_ROTSPEED };
 void LightManager::init() {
     // Create empty SSBO for point lights
     glGenBuffers(1, &s_pointLightsSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
     PointLight light{};
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * s_pointLights.capacity(), NULL, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 PointLight *LightManager::newPointLight(glm::vec3 position, glm::vec3 color, float constant, float linear, float quadratic) {
@@ -43,6 +46,19 @@ PointLight *LightManager::newPointLight(glm::vec3 position, glm::vec3 color, flo
     light.constantLinearQuadratic.y = linear;
     light.constantLinearQuadratic.z = quadratic;
 
+    // Compute radius, where the attenuated intensity of the brightest channel drops to LIGHT_ATTENUATION_THRESHOLD:
+    //      maxChannel / (constant + linear d + quadratic d^2) = threshold
+    //      quadratic d^2 + linear d + (constant - maxChannel / threshold) = 0
+    // Lights never brighter than the threshold get no radius.
+    float c = constant - glm::max(color.r, glm::max(color.g, color.b)) / LIGHT_ATTENUATION_THRESHOLD;
+    float radius = 0.0f;
+    if (c < 0.0f) {
+        if (quadratic > 0.0f) radius = (-linear + glm::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+        else if (linear > 0.0f) radius = -c / linear;
+        else radius = std::numeric_limits<float>::max();
+    }
+    light.constantLinearQuadratic.w = radius;
+
     // Keep vector's capacity before element insertion
     unsigned int prevCapacity = s_pointLights.capacity();
 
@@ -50,25 +66,27 @@ PointLight *LightManager::newPointLight(glm::vec3 position, glm::vec3 color, flo
     s_pointLights.push_back(light);
 
     // Insert element in SSBO; allocate more memory only if needed
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
     if (prevCapacity != s_pointLights.capacity())
         glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * s_pointLights.capacity(), s_pointLights.data(), GL_DYNAMIC_DRAW);
     else
         glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * (s_pointLights.size() - 1), sizeof(PointLight), &light);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
     // Return element on vector
     return &s_pointLights[s_pointLights.size() - 1];
 }
 
 void LightManager::updatePointLightsSSBO(const glm::mat4 &viewMatrix, bool updateNotShown) { 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
-    int size = updateNotShown ? s_pointLights.size() : s_numberOfShownPointLights;
-    for (int i = 0; i < size; i++) {
-        glm::vec4 vPosition = viewMatrix * s_pointLights[i].position;
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * i + offsetof(PointLight, position), sizeof(glm::vec4), &vPosition);
-    }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    // Transform positions into view-space on a staging copy, then upload it at once
+    // A single upload keeps the cost per frame low with thousands of lights.
+    int size = glm::min(updateNotShown ? (int)s_pointLights.size() : s_numberOfShownPointLights, (int)s_pointLights.size());
+    s_viewSpacePointLights.assign(s_pointLights.begin(), s_pointLights.begin() + size);
+    for (int i = 0; i < size; i++)
+        s_viewSpacePointLights[i].position = viewMatrix * s_pointLights[i].position;
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_pointLightsSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PointLight) * size, s_viewSpacePointLights.data());
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void LightManager::setAmbientLight(glm::vec3 ambientLight) {
@@ -115,4 +133,5 @@ float LightManager::getPointLightsRotationSpeed() {
 
 void LightManager::clear() {
     s_pointLights.clear();
+    s_viewSpacePointLights.clear();
 }
\ No newline at end of file
@@ -37,6 +37,7 @@ private:
     // --- Private static members
     static glm::vec3 s_ambientLight;
     static std::vector<PointLight> s_pointLights;
+    static std::vector<PointLight> s_viewSpacePointLights;
     static unsigned int s_pointLightsSSBO;
     static int s_numberOfShownPointLights;
     static float s_pointLightsRotationSpeed;
@@ -17,6 +17,13 @@ struct Material {
     float roughness;
     float metalness;
     float ambientOcclusion;
+    unsigned int id; // Stable index into the materials SSBO, assigned by MaterialManager
+};
+
+// --- GPU-side material, laid out as std430 for the materials SSBO (see materials.glsl)
+struct MaterialData {
+    glm::vec4 diffuse;
+    glm::vec4 roughnessMetalnessAO;
 };
 
 
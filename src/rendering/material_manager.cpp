@@ -2,11 +2,13 @@
 #include <iostream>
 #include <string>
 
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "rendering/material_manager.hpp"
+#include "rendering/state_cache.hpp"
 #include "scene/entity_manager.hpp"
 #include "consts.hpp"
 
@@ -14,12 +16,39 @@
 // --- Public static members
 std::map<std::string, Material> MaterialManager::s_materials;
 std::map<Material*, std::vector<Entity*>> MaterialManager::s_materialAssignments;
+std::vector<MaterialData> MaterialManager::s_materialsData;
+unsigned int MaterialManager::s_materialsSSBO{ 0 };
 
 
 // --- Public static functions
+void MaterialManager::init() {
+    // Create empty SSBO for materials
+    glGenBuffers(1, &s_materialsSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_materialsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialData) * s_materialsData.capacity(), NULL, GL_DYNAMIC_DRAW);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
 Material *MaterialManager::newMaterial(std::string name, glm::vec4 diffuse, float roughness, float metalness, float ambientOcclusion) {
-    s_materials[name] = Material{ diffuse, roughness, metalness, ambientOcclusion };
+    // Redefining a material keeps its ID, so that its slot in the SSBO stays valid
+    auto found = s_materials.find(name);
+    unsigned int id = found != s_materials.end() ? found->second.id : (unsigned int)s_materialsData.size();
+    s_materials[name] = Material{ diffuse, roughness, metalness, ambientOcclusion, id };
     s_materialAssignments[&s_materials[name]] = std::vector<Entity*>{};
+
+    // Keep vector's capacity before element insertion
+    unsigned int prevCapacity = s_materialsData.capacity();
+    if (id == s_materialsData.size()) s_materialsData.push_back(MaterialData{});
+
+    // Insert element in SSBO; allocate more memory only if needed
+    if (prevCapacity != s_materialsData.capacity()) {
+        StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_materialsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialData) * s_materialsData.capacity(), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(MaterialData) * s_materialsData.size(), s_materialsData.data());
+        StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    updateMaterialSSBO(&s_materials[name]);
+
     return &s_materials[name];
 }
 
@@ -44,6 +73,7 @@ void MaterialManager::assignMaterial(Material *material, Entity *entity) {
 
     // Assign this material to this entity
     s_materialAssignments[material].push_back(entity);
+    EntityManager::markChanged();
 }
 
 void MaterialManager::updateAssignedEntities(Material *material) {
@@ -52,6 +82,20 @@ void MaterialManager::updateAssignedEntities(Material *material) {
         EntityManager::setEntityTransparency(*iter, material->diffuse.a < 1.f);
 }
 
+void MaterialManager::updateMaterialSSBO(Material *material) {
+    // Refresh the staging copy and upload this single material
+    MaterialData &data = s_materialsData[material->id];
+    data.diffuse = material->diffuse;
+    data.roughnessMetalnessAO = glm::vec4{ material->roughness, material->metalness, material->ambientOcclusion, 0.0f };
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_materialsSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialData) * material->id, sizeof(MaterialData), &data);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+unsigned int MaterialManager::getMaterialsSSBO() {
+    return s_materialsSSBO;
+}
+
 void MaterialManager::clear() {
     // TO SOLVE: clearing s_materials won't work, as well as deleting its strings and materials directly.
     //s_materials.clear();
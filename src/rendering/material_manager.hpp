@@ -20,11 +20,14 @@
 class MaterialManager {
 public:
     // --- Public static methods
+    static void init();
     static Material *newMaterial(std::string name, glm::vec4 diffuse = MATERIAL_DIFFUSE, float roughness = MATERIAL_ROUGHNESS, float metalness = MATERIAL_METALNESS, float ambientOcclusion = MATERIAL_AMBIENT_OCCLUSION);
     static Material *getMaterial(std::string name);
     static std::map<std::string, Material> *getMaterials();
     static void assignMaterial(Material *material, Entity *entity);
     static void updateAssignedEntities(Material *material);
+    static void updateMaterialSSBO(Material *material);
+    static unsigned int getMaterialsSSBO();
     static void clear();
 
 private:
@@ -34,6 +37,8 @@ private:
     // --- Private static members
     static std::map<std::string, Material> s_materials;
     static std::map<Material*, std::vector<Entity*>> s_materialAssignments;
+    static std::vector<MaterialData> s_materialsData;
+    static unsigned int s_materialsSSBO;
 };
 
 
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_CULLER_SSE
+#endif
+
+#include "consts.hpp"
+#include "rendering/occlusion_culler.hpp"
+#include "resources/model.hpp"
+
+
+// --- Private static members
+bool OcclusionCuller::s_enabled{ OCCLUSIONCULLER_ENABLED };
+glm::mat4 OcclusionCuller::s_viewProjection{ 1.0f };
+unsigned int OcclusionCuller::s_threadNumber{ 1 };
+std::vector<std::thread> OcclusionCuller::s_workers;
+std::mutex OcclusionCuller::s_workersMutex;
+std::condition_variable OcclusionCuller::s_taskReady;
+std::condition_variable OcclusionCuller::s_taskDone;
+void (*OcclusionCuller::s_task)(unsigned int){ nullptr };
+unsigned int OcclusionCuller::s_taskGeneration{ 0 };
+unsigned int OcclusionCuller::s_pendingWorkers{ 0 };
+bool OcclusionCuller::s_stopping{ false };
+std::vector<Entity*> OcclusionCuller::s_occluders;
+std::vector<OccluderMesh> OcclusionCuller::s_occluderMeshes;
+std::vector<std::vector<OccluderTriangle>> OcclusionCuller::s_triangles;
+std::vector<std::vector<glm::vec4>> OcclusionCuller::s_clipVertices;
+std::vector<float> OcclusionCuller::s_depthBuffer;
+std::vector<Entity*> OcclusionCuller::s_visibleOpaqueEntities;
+std::vector<Entity*> OcclusionCuller::s_visibleTransparentEntities;
+unsigned int OcclusionCuller::s_version{ 0 };
+unsigned int OcclusionCuller::s_testedNumber{ 0 };
+unsigned int OcclusionCuller::s_culledNumber{ 0 };
+unsigned int OcclusionCuller::s_triangleNumber{ 0 };
+
+
+// --- Public static methods
+void OcclusionCuller::init() {
+    // Start workers once; they sleep between tasks, so that no thread is created per frame
+    // Without them, e.g. before init or after clear, every task runs on the calling thread alone.
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    s_threadNumber = glm::clamp(hardwareThreads, 1u, OCCLUSIONCULLER_MAXTHREADS);
+    s_stopping = false;
+    for (unsigned int t = 1; t < s_threadNumber; t++)
+        s_workers.emplace_back(runWorker, t, s_taskGeneration);
+}
+
+void OcclusionCuller::cull(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities, const glm::mat4 &viewProjection) {
+    // How occlusion culling works:
+    //      1) The opaque entities covering the most screen, judged by their bounding spheres, become occluders;
+    //      2) Each thread transforms the triangles of some occluders, dropping back-facing ones and the ones crossing
+    //         the near plane, and sets up their edge and depth planes;
+    //      3) Each thread rasterizes every triangle into its own band of rows of the depth buffer, four pixels at a
+    //         time, keeping the nearest depth. Only pixels lying wholly inside a triangle are written, with the
+    //         triangle's farthest depth over them, so that the buffer never claims more than occluders hide;
+    //      4) The bounding box of every entity is projected, and the entity is occluded if the depth buffer is nearer
+    //         than the box's nearest corner over the whole rectangle covered by the box.
+    // Occluders never occlude themselves, as their boxes lie in front of their surfaces. Entities which were not
+    // tested, e.g. with culling off, are kept. Pixels straddling an edge shared by two triangles are written by
+    // neither, which only lets more entities through.
+    //
+    // SOURCE: https://www.intel.com/content/www/us/en/developer/articles/technical/masked-software-occlusion-culling.html
+    s_testedNumber = 0;
+    s_culledNumber = 0;
+    s_triangleNumber = 0;
+    s_occluders.clear();
+    if (s_enabled) {
+        s_viewProjection = viewProjection;
+
+        // 1) Occluders
+        selectOccluders(opaqueEntities);
+
+        // 2) and 3) Triangle setup and rasterization
+        rasterizeOccluders();
+    }
+
+    // 4) Visibility tests
+    bool opaqueChanged = cullEntities(opaqueEntities, s_visibleOpaqueEntities);
+    bool transparentChanged = cullEntities(transparentEntities, s_visibleTransparentEntities);
+    if (opaqueChanged || transparentChanged) s_version++;
+}
+
+void OcclusionCuller::rasterize(const std::vector<OccluderMesh> &occluders, const glm::mat4 &viewProjection) {
+    // Rasterize the given geometry alone, as cull does with the largest entities' meshes
+    s_viewProjection = viewProjection;
+    s_occluderMeshes = occluders;
+    rasterizeOccluders();
+}
+
+bool OcclusionCuller::isOccluded(const glm::vec3 &center, const glm::vec3 &extents) {
+    // Project the corners of the bounding box; boxes reaching behind the near plane are never occluded
+    glm::vec2 screenMin{ std::numeric_limits<float>::max() };
+    glm::vec2 screenMax{ std::numeric_limits<float>::lowest() };
+    float nearestDepth = 1.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 offset{ (corner & 1) ? extents.x : -extents.x, (corner & 2) ? extents.y : -extents.y, (corner & 4) ? extents.z : -extents.z };
+        glm::vec4 clip = s_viewProjection * glm::vec4{ center + offset, 1.0f };
+        if (clip.w < CAMERA_DEFAULT_ZNEAR) return false;
+        glm::vec3 ndc = glm::vec3{ clip } / clip.w;
+        glm::vec2 screen = (glm::vec2{ ndc } + 1.0f) * glm::vec2{ OCCLUSIONCULLER_WIDTH * 0.5f, OCCLUSIONCULLER_HEIGHT * 0.5f };
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearestDepth = glm::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    // Every pixel touched by the rectangle is tested, not only the ones whose centers it covers
+    int minX = glm::max((int)std::floor(screenMin.x), 0) & ~3;
+    int minY = glm::max((int)std::floor(screenMin.y), 0);
+    int maxX = glm::min((int)std::floor(screenMax.x), OCCLUSIONCULLER_WIDTH - 1);
+    int maxY = glm::min((int)std::floor(screenMax.y), OCCLUSIONCULLER_HEIGHT - 1);
+    if (minX > maxX || minY > maxY) return false;
+    for (int y = minY; y <= maxY; y++) {
+        const float *row = &s_depthBuffer[y * OCCLUSIONCULLER_WIDTH];
+#ifdef OCCLUSION_CULLER_SSE
+        // Rows are tested four pixels at a time; the extra pixels at the ends can only keep the entity visible
+        __m128 depth = _mm_set1_ps(nearestDepth);
+        for (int x = minX; x <= maxX; x += 4)
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&row[x]), depth)) != 0) return false;
+#else
+        for (int x = minX; x <= maxX; x++)
+            if (row[x] >= nearestDepth) return false;
+#endif
+    }
+    return true;
+}
+
+std::vector<Entity*> *OcclusionCuller::getVisibleOpaqueEntities() {
+    return &s_visibleOpaqueEntities;
+}
+
+std::vector<Entity*> *OcclusionCuller::getVisibleTransparentEntities() {
+    return &s_visibleTransparentEntities;
+}
+
+const std::vector<float> &OcclusionCuller::getDepthBuffer() {
+    return s_depthBuffer;
+}
+
+unsigned int OcclusionCuller::getVersion() {
+    return s_version;
+}
+
+unsigned int OcclusionCuller::getTestedNumber() {
+    return s_testedNumber;
+}
+
+unsigned int OcclusionCuller::getCulledNumber() {
+    return s_culledNumber;
+}
+
+unsigned int OcclusionCuller::getOccluderNumber() {
+    return (unsigned int)s_occluders.size();
+}
+
+unsigned int OcclusionCuller::getTriangleNumber() {
+    return s_triangleNumber;
+}
+
+bool OcclusionCuller::getEnabled() {
+    return s_enabled;
+}
+
+void OcclusionCuller::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+void OcclusionCuller::clear() {
+    // Wake workers up for the last time, and wait for them to return
+    {
+        std::lock_guard<std::mutex> lock(s_workersMutex);
+        s_stopping = true;
+    }
+    s_taskReady.notify_all();
+    for (std::thread &worker : s_workers)
+        worker.join();
+    s_workers.clear();
+    s_threadNumber = 1;
+}
+
+
+// --- Private static methods
+void OcclusionCuller::selectOccluders(std::vector<Entity*> *opaqueEntities) {
+    // Screen size is estimated as the sphere's radius over its distance from the camera, i.e. the view depth of its
+    // nearest point; spheres reaching behind the camera count as covering the whole screen.
+    std::vector<std::pair<float, Entity*>> candidates;
+    candidates.reserve(opaqueEntities->size());
+    for (Entity *entity : *opaqueEntities) {
+        glm::vec3 center, extents;
+        entity->getWorldBounds(center, extents);
+        float radius = entity->getModel()->getBounds().radius;
+        float depth = (s_viewProjection * glm::vec4{ center, 1.0f }).w - radius;
+        candidates.push_back(std::make_pair(radius / glm::max(depth, CAMERA_DEFAULT_ZNEAR), entity));
+    }
+    size_t occluderNumber = std::min(candidates.size(), (size_t)OCCLUSIONCULLER_OCCLUDERS);
+    std::partial_sort(candidates.begin(), candidates.begin() + occluderNumber, candidates.end(),
+        [](const std::pair<float, Entity*> &a, const std::pair<float, Entity*> &b) { return a.first > b.first; });
+    s_occluderMeshes.clear();
+    for (size_t i = 0; i < occluderNumber; i++) {
+        Entity *occluder = candidates[i].second;
+        s_occluders.push_back(occluder);
+        glm::mat4 modelMatrix = occluder->getModelMatrix();
+        for (const Mesh &mesh : occluder->getModel()->getMeshes())
+            s_occluderMeshes.push_back(OccluderMesh{ &mesh.getVertices(), &mesh.getIndices(), modelMatrix });
+    }
+}
+
+void OcclusionCuller::setupTriangles(unsigned int thread) {
+    // Occluder meshes are dealt round-robin, so that threads get as many of them
+    std::vector<OccluderTriangle> &triangles = s_triangles[thread];
+    std::vector<glm::vec4> &clipVertices = s_clipVertices[thread];
+    triangles.clear();
+    glm::vec2 halfSize{ OCCLUSIONCULLER_WIDTH * 0.5f, OCCLUSIONCULLER_HEIGHT * 0.5f };
+    for (size_t o = thread; o < s_occluderMeshes.size(); o += s_threadNumber) {
+        glm::mat4 modelViewProjection = s_viewProjection * s_occluderMeshes[o].modelMatrix;
+
+        // Transform vertices once, as most are shared by several triangles
+        const std::vector<Vertex> &vertices = *s_occluderMeshes[o].vertices;
+        clipVertices.resize(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            clipVertices[v] = modelViewProjection * glm::vec4{ vertices[v].position, 1.0f };
+
+        const std::vector<GLuint> &indices = *s_occluderMeshes[o].indices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            // Triangles crossing the near plane are dropped rather than clipped: occluders may only shrink
+            glm::vec3 screen[3];
+            bool behind = false;
+            for (int k = 0; k < 3; k++) {
+                const glm::vec4 &clip = clipVertices[indices[i + k]];
+                if (clip.w < CAMERA_DEFAULT_ZNEAR) {
+                    behind = true;
+                    break;
+                }
+                glm::vec3 ndc = glm::vec3{ clip } / clip.w;
+                screen[k] = glm::vec3{ (glm::vec2{ ndc } + 1.0f) * halfSize, ndc.z * 0.5f + 0.5f };
+            }
+            if (behind) continue;
+
+            // Drop back-facing triangles, as the opaque geometry pass does; front faces wind counter-clockwise
+            float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+            if (area <= 0.0f) continue;
+
+            // Pixels whose centers lie in the triangle's bounding rectangle
+            glm::vec2 screenMin = glm::min(glm::min(glm::vec2{ screen[0] }, glm::vec2{ screen[1] }), glm::vec2{ screen[2] });
+            glm::vec2 screenMax = glm::max(glm::max(glm::vec2{ screen[0] }, glm::vec2{ screen[1] }), glm::vec2{ screen[2] });
+            OccluderTriangle triangle;
+            triangle.rect = glm::ivec4{ glm::max((int)std::ceil(screenMin.x - 0.5f), 0),
+                                        glm::max((int)std::ceil(screenMin.y - 0.5f), 0),
+                                        glm::min((int)std::floor(screenMax.x - 0.5f), OCCLUSIONCULLER_WIDTH - 1),
+                                        glm::min((int)std::floor(screenMax.y - 0.5f), OCCLUSIONCULLER_HEIGHT - 1) };
+            if (triangle.rect.x > triangle.rect.z || triangle.rect.y > triangle.rect.w) continue;
+
+            // Edge from vertex k to the next one: (x1 - x0) (y - y0) - (y1 - y0) (x - x0)
+            // Over a pixel, an edge function is lowest at one of its corners, 0.5 (|a| + |b|) below its center.
+            for (int k = 0; k < 3; k++) {
+                const glm::vec3 &v0 = screen[k];
+                const glm::vec3 &v1 = screen[(k + 1) % 3];
+                float a = v0.y - v1.y;
+                float b = v1.x - v0.x;
+                triangle.edges[k] = glm::vec3{ a, b, -a * v0.x - b * v0.y - 0.5f * (std::abs(a) + std::abs(b)) };
+            }
+
+            // Depth gradients, from the barycentric coordinates of the plane through the three vertices
+            // Likewise, depth is farthest at one of the pixel's corners.
+            float dzdx = ((screen[1].z - screen[0].z) * (screen[2].y - screen[0].y) - (screen[2].z - screen[0].z) * (screen[1].y - screen[0].y)) / area;
+            float dzdy = ((screen[2].z - screen[0].z) * (screen[1].x - screen[0].x) - (screen[1].z - screen[0].z) * (screen[2].x - screen[0].x)) / area;
+            triangle.depth = glm::vec3{ dzdx, dzdy, screen[0].z - dzdx * screen[0].x - dzdy * screen[0].y + 0.5f * (std::abs(dzdx) + std::abs(dzdy)) };
+            triangles.push_back(triangle);
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeOccluders() {
+    // 2) Triangle setup
+    s_triangleNumber = 0;
+    s_triangles.resize(s_threadNumber);
+    s_clipVertices.resize(s_threadNumber);
+    s_depthBuffer.resize(OCCLUSIONCULLER_WIDTH * OCCLUSIONCULLER_HEIGHT);
+    runParallel(setupTriangles);
+    for (const std::vector<OccluderTriangle> &triangles : s_triangles)
+        s_triangleNumber += (unsigned int)triangles.size();
+
+    // 3) Rasterization
+    runParallel(rasterizeBand);
+}
+
+void OcclusionCuller::rasterizeBand(unsigned int band) {
+    // Bands split rows evenly, so that no two threads write the same pixel
+    int bandMinY = OCCLUSIONCULLER_HEIGHT * (int)band / (int)s_threadNumber;
+    int bandMaxY = OCCLUSIONCULLER_HEIGHT * ((int)band + 1) / (int)s_threadNumber - 1;
+    std::fill(s_depthBuffer.begin() + bandMinY * OCCLUSIONCULLER_WIDTH, s_depthBuffer.begin() + (bandMaxY + 1) * OCCLUSIONCULLER_WIDTH, 1.0f);
+
+    for (const std::vector<OccluderTriangle> &triangles : s_triangles) {
+        for (const OccluderTriangle &triangle : triangles) {
+            int minY = glm::max(triangle.rect.y, bandMinY);
+            int maxY = glm::min(triangle.rect.w, bandMaxY);
+            if (minY > maxY) continue;
+
+            // Rows start on a multiple of four pixels; pixels outside the triangle fail its edge tests anyway
+            int minX = triangle.rect.x & ~3;
+            int maxX = triangle.rect.z;
+            for (int y = minY; y <= maxY; y++) {
+                float centerY = (float)y + 0.5f;
+                float *row = &s_depthBuffer[y * OCCLUSIONCULLER_WIDTH];
+#ifdef OCCLUSION_CULLER_SSE
+                __m128 centersX = _mm_add_ps(_mm_set1_ps((float)minX), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+                __m128 edges[3], edgeSteps[3];
+                for (int k = 0; k < 3; k++) {
+                    const glm::vec3 &edge = triangle.edges[k];
+                    edges[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge.x), centersX), _mm_set1_ps(edge.y * centerY + edge.z));
+                    edgeSteps[k] = _mm_set1_ps(edge.x * 4.0f);
+                }
+                __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depth.x), centersX), _mm_set1_ps(triangle.depth.y * centerY + triangle.depth.z));
+                __m128 depthStep = _mm_set1_ps(triangle.depth.x * 4.0f);
+                __m128 zero = _mm_setzero_ps();
+                for (int x = minX; x <= maxX; x += 4) {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edges[0], zero), _mm_cmpge_ps(edges[1], zero)), _mm_cmpge_ps(edges[2], zero));
+                    if (_mm_movemask_ps(inside) != 0) {
+                        __m128 stored = _mm_loadu_ps(&row[x]);
+                        __m128 nearest = _mm_min_ps(stored, depth);
+                        _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+                    }
+                    for (int k = 0; k < 3; k++)
+                        edges[k] = _mm_add_ps(edges[k], edgeSteps[k]);
+                    depth = _mm_add_ps(depth, depthStep);
+                }
+#else
+                for (int x = minX; x <= maxX; x++) {
+                    glm::vec3 center{ (float)x + 0.5f, centerY, 1.0f };
+                    if (glm::dot(triangle.edges[0], center) < 0.0f || glm::dot(triangle.edges[1], center) < 0.0f || glm::dot(triangle.edges[2], center) < 0.0f) continue;
+                    row[x] = glm::min(row[x], glm::dot(triangle.depth, center));
+                }
+#endif
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::cullEntities(std::vector<Entity*> *entities, std::vector<Entity*> &visible) {
+    // Compact visible entities, noting whether the set differs from the previous one
+    bool changed = false;
+    size_t visibleCount = 0;
+    for (Entity *entity : *entities) {
+        if (s_enabled) {
+            s_testedNumber++;
+            glm::vec3 center, extents;
+            entity->getWorldBounds(center, extents);
+            if (isOccluded(center, extents)) {
+                s_culledNumber++;
+                continue;
+            }
+        }
+        if (visibleCount == visible.size()) {
+            visible.push_back(entity);
+            changed = true;
+        } else if (visible[visibleCount] != entity) {
+            visible[visibleCount] = entity;
+            changed = true;
+        }
+        visibleCount++;
+    }
+    if (visibleCount != visible.size()) {
+        visible.resize(visibleCount);
+        changed = true;
+    }
+    return changed;
+}
+
+void OcclusionCuller::runParallel(void (*task)(unsigned int)) {
+    // Hand the task to the workers, take the first share of the work on the calling thread, then wait for the rest
+    {
+        std::lock_guard<std::mutex> lock(s_workersMutex);
+        s_task = task;
+        s_pendingWorkers = (unsigned int)s_workers.size();
+        s_taskGeneration++;
+    }
+    s_taskReady.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(s_workersMutex);
+    s_taskDone.wait(lock, []() { return s_pendingWorkers == 0; });
+}
+
+void OcclusionCuller::runWorker(unsigned int thread, unsigned int generation) {
+    // Run every new task once, with the share of the work matching the thread, until clear stops the workers
+    while (true) {
+        void (*task)(unsigned int);
+        {
+            std::unique_lock<std::mutex> lock(s_workersMutex);
+            s_taskReady.wait(lock, [generation]() { return s_stopping || s_taskGeneration != generation; });
+            if (s_stopping) return;
+            generation = s_taskGeneration;
+            task = s_task;
+        }
+        task(thread);
+        {
+            std::lock_guard<std::mutex> lock(s_workersMutex);
+            s_pendingWorkers--;
+        }
+        s_taskDone.notify_one();
+    }
+}
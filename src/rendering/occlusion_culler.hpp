@@ -0,0 +1,92 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "resources/mesh.hpp"
+#include "scene/entity.hpp"
+
+
+// --- Occluder geometry, placed in world-space by its model matrix
+struct OccluderMesh {
+    const std::vector<Vertex> *vertices;
+    const std::vector<GLuint> *indices;
+    glm::mat4 modelMatrix;
+};
+
+// --- Occluder triangle, set up in the pixel space of the depth buffer
+// Edge functions and depth are planes evaluated at pixel centers as a * x + b * y + c. Edges are moved inwards by
+// half a pixel, so that they are positive only on pixels lying wholly inside; depth is the farthest over the pixel.
+struct OccluderTriangle {
+    glm::vec3 edges[3];
+    glm::vec3 depth;
+    glm::ivec4 rect;    // Pixels covered: min x, min y, max x, max y, inclusive
+};
+
+// --- OcclusionCuller class
+// Rasterizes the largest opaque entities into a low-resolution depth buffer on the CPU, then leaves out of every pass
+// the entities whose bounding boxes lie entirely behind it. Entity order is preserved.
+class OcclusionCuller {
+    public:
+        // --- Public static methods
+        static void init();
+        static void cull(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities, const glm::mat4 &viewProjection);
+        static void rasterize(const std::vector<OccluderMesh> &occluders, const glm::mat4 &viewProjection);
+        static bool isOccluded(const glm::vec3 &center, const glm::vec3 &extents);
+        static std::vector<Entity*> *getVisibleOpaqueEntities();
+        static std::vector<Entity*> *getVisibleTransparentEntities();
+        static const std::vector<float> &getDepthBuffer();
+        static unsigned int getVersion();
+        static unsigned int getTestedNumber();
+        static unsigned int getCulledNumber();
+        static unsigned int getOccluderNumber();
+        static unsigned int getTriangleNumber();
+        static bool getEnabled();
+        static void setEnabled(bool enabled);
+        static void clear();
+
+    private:
+        // --- Private constructor
+        OcclusionCuller();
+
+        // --- Private static methods
+        static void selectOccluders(std::vector<Entity*> *opaqueEntities);
+        static void setupTriangles(unsigned int thread);
+        static void rasterizeOccluders();
+        static void rasterizeBand(unsigned int band);
+        static bool cullEntities(std::vector<Entity*> *entities, std::vector<Entity*> &visible);
+        static void runParallel(void (*task)(unsigned int));
+        static void runWorker(unsigned int thread, unsigned int generation);
+
+        // --- Private static members
+        static bool s_enabled;
+        static glm::mat4 s_viewProjection;
+        static unsigned int s_threadNumber;
+        static std::vector<std::thread> s_workers;                      // Threads other than the caller's, see init
+        static std::mutex s_workersMutex;
+        static std::condition_variable s_taskReady;
+        static std::condition_variable s_taskDone;
+        static void (*s_task)(unsigned int);
+        static unsigned int s_taskGeneration;   // Incremented for every task, so that workers run each once
+        static unsigned int s_pendingWorkers;
+        static bool s_stopping;
+        static std::vector<Entity*> s_occluders;
+        static std::vector<OccluderMesh> s_occluderMeshes;
+        static std::vector<std::vector<OccluderTriangle>> s_triangles;  // Per thread
+        static std::vector<std::vector<glm::vec4>> s_clipVertices;      // Per thread scratch
+        static std::vector<float> s_depthBuffer;
+        static std::vector<Entity*> s_visibleOpaqueEntities;
+        static std::vector<Entity*> s_visibleTransparentEntities;
+        static unsigned int s_version;          // Incremented whenever a visible set changes
+        static unsigned int s_testedNumber;
+        static unsigned int s_culledNumber;
+        static unsigned int s_triangleNumber;
+};
+
+
+#endif // OCCLUSION_CULLER_HPP
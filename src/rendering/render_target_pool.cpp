@@ -0,0 +1,134 @@
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "rendering/render_target_pool.hpp"
+#include "rendering/state_cache.hpp"
+
+
+// --- Private static members
+std::vector<RenderTarget> RenderTargetPool::s_targets;
+size_t RenderTargetPool::s_totalBytes{ 0 };
+unsigned int RenderTargetPool::s_generation{ 0 };
+
+
+// --- Public static methods
+unsigned int RenderTargetPool::acquire(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers) {
+    // Reuse a released target with the same key, if any
+    for (RenderTarget &target : s_targets) {
+        if (!target.inUse && target.internalFormat == internalFormat && target.width == width && target.height == height && target.layers == layers) {
+            target.inUse = true;
+            target.acquired = true;
+            return target.texture;
+        }
+    }
+
+    // Allocate a new target; storage is immutable, so a target never changes its key
+    // Every target is sampled texel by texel (or accessed as an image), hence nearest filtering.
+    RenderTarget target{ 0, internalFormat, width, height, layers, true, true };
+    GLenum textureTarget = layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    glGenTextures(1, &target.texture);
+    StateCache::bindTexture(0, textureTarget, target.texture);
+    if (layers > 1) glTexStorage3D(textureTarget, 1, internalFormat, width, height, layers);
+    else glTexStorage2D(textureTarget, 1, internalFormat, width, height);
+    glTexParameteri(textureTarget, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(textureTarget, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    StateCache::bindTexture(0, textureTarget, 0);
+    s_targets.push_back(target);
+    s_totalBytes += getBytes(target);
+    return target.texture;
+}
+
+void RenderTargetPool::release(unsigned int &texture) {
+    // Hand the target back to the pool; its storage is kept for the next request with the same key
+    if (texture == 0) return;
+    for (RenderTarget &target : s_targets) {
+        if (target.texture == texture) {
+            target.inUse = false;
+            break;
+        }
+    }
+    texture = 0;
+}
+
+void RenderTargetPool::trim(unsigned int width, unsigned int height) {
+    // Delete released targets of any other size, as they will not be requested again until the next resize
+    for (size_t i = 0; i < s_targets.size();) {
+        RenderTarget &target = s_targets[i];
+        if (!target.inUse && (target.width != width || target.height != height)) deleteTarget(i);
+        else i++;
+    }
+}
+
+void RenderTargetPool::collect() {
+    // Delete released targets which were not acquired since the last collect
+    // Called once per frame, this frees the transient targets of passes which stopped running.
+    for (size_t i = 0; i < s_targets.size();) {
+        RenderTarget &target = s_targets[i];
+        if (!target.inUse && !target.acquired) deleteTarget(i);
+        else {
+            target.acquired = false;
+            i++;
+        }
+    }
+}
+
+unsigned int RenderTargetPool::getGeneration() {
+    // Changes whenever a target is deleted, as GL may then hand its texture name to a new target
+    return s_generation;
+}
+
+unsigned int RenderTargetPool::getTargetNumber() {
+    return (unsigned int)s_targets.size();
+}
+
+size_t RenderTargetPool::getTotalBytes() {
+    return s_totalBytes;
+}
+
+void RenderTargetPool::clear() {
+    for (RenderTarget &target : s_targets)
+        StateCache::deleteTexture(target.texture);
+    s_targets.clear();
+    s_totalBytes = 0;
+    s_generation++;
+}
+
+
+// --- Private static methods
+size_t RenderTargetPool::getBytesPerTexel(GLenum internalFormat) {
+    // Formats used by the renderer; the depth format is assumed to be padded to 32 bits
+    switch (internalFormat) {
+        case GL_R16:
+        case GL_R16F:
+            return 2;
+        case GL_RGBA8:
+        case GL_RG16F:
+        case GL_R32UI:
+        case GL_DEPTH_COMPONENT24:
+            return 4;
+        case GL_RGBA16:
+        case GL_RGBA16F:
+        case GL_RG32F:
+            return 8;
+        case GL_RGBA32F:
+        case GL_RGBA32UI:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+size_t RenderTargetPool::getBytes(const RenderTarget &target) {
+    return getBytesPerTexel(target.internalFormat) * target.width * target.height * target.layers;
+}
+
+void RenderTargetPool::deleteTarget(size_t index) {
+    // Order does not matter, so the last target takes the place of the deleted one
+    StateCache::deleteTexture(s_targets[index].texture);
+    s_totalBytes -= getBytes(s_targets[index]);
+    s_targets[index] = s_targets.back();
+    s_targets.pop_back();
+    s_generation++;
+}
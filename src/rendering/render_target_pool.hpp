@@ -0,0 +1,54 @@
+#ifndef RENDER_TARGET_POOL_HPP
+#define RENDER_TARGET_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+
+// --- Texture owned by the pool
+struct RenderTarget {
+    unsigned int texture;
+    GLenum internalFormat;
+    unsigned int width;
+    unsigned int height;
+    unsigned int layers;    // 1 for 2D textures, more for 2D array textures
+    bool inUse;
+    bool acquired;          // Acquired since the last collect
+};
+
+// --- RenderTargetPool class
+// Render targets of the renderer, allocated with immutable storage and keyed by (format, width, height).
+// Released targets are handed to the next request with the same key, so that only the targets which change are
+// allocated again, e.g. when toggling a G-buffer layout. Targets released and acquired again within a frame alias,
+// see FrameGraph.
+class RenderTargetPool {
+    public:
+        // --- Public static methods
+        static unsigned int acquire(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers = 1);
+        static void release(unsigned int &texture);
+        static void trim(unsigned int width, unsigned int height);
+        static void collect();
+        static unsigned int getGeneration();
+        static unsigned int getTargetNumber();
+        static size_t getTotalBytes();
+        static void clear();
+
+    private:
+        // --- Private constructor
+        RenderTargetPool();
+
+        // --- Private static methods
+        static size_t getBytesPerTexel(GLenum internalFormat);
+        static size_t getBytes(const RenderTarget &target);
+        static void deleteTarget(size_t index);
+
+        // --- Private static members
+        static std::vector<RenderTarget> s_targets;
+        static size_t s_totalBytes;
+        static unsigned int s_generation;
+};
+
+
+#endif // RENDER_TARGET_POOL_HPP
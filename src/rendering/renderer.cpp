@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <string>
 
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
@@ -9,8 +15,17 @@
 
 #include "consts.hpp"
 #include "input/input_manager.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/frustum_culler.hpp"
+#include "rendering/gpu_culler.hpp"
 #include "rendering/lights.hpp"
+#include "rendering/occlusion_culler.hpp"
+#include "rendering/render_target_pool.hpp"
 #include "rendering/renderer.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/transform_stage.hpp"
+#include "scene/entity_manager.hpp"
+#include "resources/geometry_arena.hpp"
 #include "resources/resource_manager.hpp"
 #include "resources/model.hpp"
 
@@ -19,25 +34,111 @@
 bool Renderer::s_isInitialized{ false };
 Camera Renderer::s_camera;
 Shader *Renderer::s_gBufferShader;
+Shader *Renderer::s_gBufferFirstPeelShader;
+Shader *Renderer::s_gBufferPeelShader;
 Shader *Renderer::s_deferredShader;
+Shader *Renderer::s_dualDeferredShader;
 Shader *Renderer::s_screenSpaceShader;
+Shader *Renderer::s_dualDepthPeelingShader;
+Shader *Renderer::s_dualDepthPeelingInitShader;
+Shader *Renderer::s_dualDepthPeelingBlendShader;
+Shader *Renderer::s_linkedListShader;
+Shader *Renderer::s_linkedListResolveShader;
+Shader *Renderer::s_weightedBlendedShader;
+Shader *Renderer::s_weightedBlendedCompositeShader;
+Shader *Renderer::s_kBufferShader;
+Shader *Renderer::s_kBufferResolveShader;
+Shader *Renderer::s_lightClusteringShader;
+TransparencyMode Renderer::s_transparencyMode{ TransparencyMode::depthPeeling };
+GBufferProfile Renderer::s_gBufferProfile{ GBufferProfile::full };
+bool Renderer::s_gBufferMaterialIDs{ RENDERER_GBUFFER_MATERIALIDS };
+bool Renderer::s_transparencyScissor{ RENDERER_TRANSPARENCY_SCISSOR };
+int Renderer::s_transparencyBounds[4] = {0, 0, 0, 0};
+float Renderer::s_transparencyCoverage{ 1.0f };
 unsigned int Renderer::s_framebufferWidth{ 0 };
 unsigned int Renderer::s_framebufferHeight{ 0 };
+unsigned int Renderer::s_outputWidth{ 0 };
+unsigned int Renderer::s_outputHeight{ 0 };
+bool Renderer::s_resizePending{ false };
+double Renderer::s_resizeTime{ 0.0 };
 unsigned int Renderer::s_depthPeelingPasses{ RENDERER_DEPTHPEELING_PASSES };
-unsigned int Renderer::s_opaqueFBO{ 0 };
+unsigned int Renderer::s_depthPeelingActivePasses{ 0 };
+unsigned int Renderer::s_depthPeelingNonEmptyPasses{ 0 };
+bool Renderer::s_depthPeelingEarlyTermination{ RENDERER_DEPTHPEELING_EARLYTERMINATION };
+unsigned int Renderer::s_depthPeelingSampleThreshold{ RENDERER_DEPTHPEELING_SAMPLETHRESHOLD };
+unsigned int Renderer::s_hybridPeelingPasses{ RENDERER_HYBRID_PASSES };
+unsigned int Renderer::s_depthPeelingQueries[2][RENDERER_DEPTHPEELING_MAXPASSES] = {};
+unsigned int Renderer::s_depthPeelingQueriesIssued[2] = {0, 0};
+unsigned int Renderer::s_depthPeelingQuerySet{ 0 };
+bool Renderer::s_depthPeelingEntityCulling{ RENDERER_DEPTHPEELING_ENTITYCULLING };
+unsigned int Renderer::s_depthPeelingSkippedInstances{ 0 };
+unsigned int Renderer::s_peelSamplesSSBOs[2] = {0, 0};
+unsigned int Renderer::s_peelSamplesSSBOCapacities[2] = {0, 0};
+GLsync Renderer::s_peelSamplesFences[2] = {nullptr, nullptr};
+std::vector<Entity*> Renderer::s_peelSamplesEntities[2];
+unsigned int Renderer::s_peelSamplesEntitiesVersions[2] = {0, 0};
+unsigned int Renderer::s_peelSamplesFirstInstances[2] = {0, 0};
+unsigned int Renderer::s_peelSamplesPasses[2] = {0, 0};
+unsigned int Renderer::s_peelSamplesSet{ 0 };
+std::vector<unsigned int> Renderer::s_peelSamples;
+std::unordered_map<Entity*, unsigned int> Renderer::s_peelReaches;
+unsigned int Renderer::s_peelReachesVersion{ 0 };
+std::vector<unsigned int> Renderer::s_instanceReaches;
+unsigned int Renderer::s_instanceReachesVersion{ 0 };
+unsigned int Renderer::s_instanceReachesSkipped[RENDERER_DEPTHPEELING_MAXPASSES] = { 0 };
+DrawList Renderer::s_peelDrawLists[RENDERER_DEPTHPEELING_MAXPASSES];
+FrameGraph Renderer::s_frameGraph;
 unsigned int Renderer::s_opaqueBuffer{ 0 };
-unsigned int Renderer::s_transparentGBufferFBO[2] = {0, 0};
-unsigned int Renderer::s_transparentDepthBuffer[2] = {0, 0};
-unsigned int Renderer::s_transparentGPosition{ 0 };
-unsigned int Renderer::s_transparentGNormal{ 0 };
-unsigned int Renderer::s_transparentGDiffuse{ 0 };
-unsigned int Renderer::s_transparentGRoughnessMetalnessAO{ 0 };
-unsigned int Renderer::s_opaqueGBufferFBO{ 0 };
 unsigned int Renderer::s_opaqueDepthBuffer{ 0 };
-unsigned int Renderer::s_opaqueGPosition{ 0 };
-unsigned int Renderer::s_opaqueGNormal{ 0 };
-unsigned int Renderer::s_opaqueGDiffuse{ 0 };
-unsigned int Renderer::s_opaqueGRoughnessMetalnessAO{ 0 };
+unsigned int Renderer::s_linkedListNodesPerPixel{ RENDERER_LINKEDLIST_NODESPERPIXEL };
+unsigned int Renderer::s_linkedListNodesSSBO{ 0 };
+unsigned int Renderer::s_linkedListCounters[2] = {0, 0};
+GLsync Renderer::s_linkedListFences[2] = {nullptr, nullptr};
+unsigned int Renderer::s_linkedListCounterSet{ 0 };
+unsigned int Renderer::s_linkedListStoredFragments{ 0 };
+unsigned int Renderer::s_linkedListOverflowFragments{ 0 };
+bool Renderer::s_clusteredLighting{ RENDERER_CLUSTEREDLIGHTING };
+unsigned int Renderer::s_clusterLightCountsSSBO{ 0 };
+unsigned int Renderer::s_clusterLightIndicesSSBO{ 0 };
+bool Renderer::s_instancing{ RENDERER_INSTANCING };
+std::vector<int> Renderer::s_instanceMaterials;
+bool Renderer::s_multiDrawIndirect{ RENDERER_MULTIDRAWINDIRECT };
+bool Renderer::s_gpuCulling{ false };
+glm::mat4 Renderer::s_previousViewProjection{ 1.0f };
+bool Renderer::s_previousDepthValid{ false };
+std::vector<DrawElementsIndirectCommand> Renderer::s_drawCommands;
+DrawList Renderer::s_opaqueDrawList;
+DrawList Renderer::s_transparentDrawList;
+unsigned int Renderer::s_instanceMaterialsSSBO{ 0 };
+unsigned int Renderer::s_instanceMaterialsSSBOCapacity{ 0 };
+unsigned int Renderer::s_drawCommandsBuffer{ 0 };
+unsigned int Renderer::s_drawCommandsBufferCapacity{ 0 };
+std::vector<DrawItem> Renderer::s_drawItems;
+std::vector<DrawItem> Renderer::s_drawItemsScratch;
+std::vector<Entity*> Renderer::s_instanceEntities;
+std::vector<Model*> Renderer::s_queueModels;
+std::vector<unsigned int> Renderer::s_meshFirstIndices;
+std::vector<int> Renderer::s_meshBaseVertices;
+std::vector<int> Renderer::s_meshIndicesNumbers;
+bool Renderer::s_renderQueueValid{ false };
+unsigned int Renderer::s_renderQueueEntitiesVersion{ 0 };
+unsigned int Renderer::s_renderQueueModelsVersion{ 0 };
+unsigned int Renderer::s_renderQueueVisibilityVersion{ 0 };
+unsigned int Renderer::s_renderQueuePeelReachesVersion{ 0 };
+bool Renderer::s_renderQueueGpuCulling{ false };
+glm::vec3 Renderer::s_renderQueueCameraPosition{ 0.0f };
+unsigned int Renderer::s_renderQueueRebuilds{ 0 };
+unsigned int Renderer::s_drawCalls{ 0 };
+unsigned int Renderer::s_cameraUBO{ 0 };
+unsigned int Renderer::s_passUBO{ 0 };
+unsigned int Renderer::s_lightingUBO{ 0 };
+PassUniforms Renderer::s_passUniforms{};
+PassUniforms Renderer::s_uploadedPassUniforms{};
+bool Renderer::s_passUniformsUploaded{ false };
+UniformHandle<int> Renderer::s_nodePoolSizeUniform;
+UniformHandle<int> Renderer::s_skipPeeledLayersUniform;
+UniformHandle<int> Renderer::s_clusteringLightsNumberUniform;
+UniformHandle<glm::vec2> Renderer::s_clusteringTileSizeUniform;
 unsigned int Renderer::s_quadVAO{ 0 };
 unsigned int Renderer::s_quadVBO{ 0 };
 
@@ -47,6 +148,8 @@ void Renderer::init(unsigned int framebufferWidth, unsigned int framebufferHeigh
     // Set framebuffer's resolution
     s_framebufferWidth = framebufferWidth;
     s_framebufferHeight = framebufferHeight;
+    s_outputWidth = framebufferWidth;
+    s_outputHeight = framebufferHeight;
     
     // Create camera
     s_camera = Camera{CAMERA_DEFAULT_POSITION, framebufferWidth, framebufferHeight};
@@ -55,9 +158,27 @@ void Renderer::init(unsigned int framebufferWidth, unsigned int framebufferHeigh
     setupFramebuffers(framebufferWidth, framebufferHeight);
     
     // Load shaders
-    s_gBufferShader = ResourceManager::loadShader("gBufferShader", RENDERER_GBUFFER_VERTEX, RENDERER_GBUFFER_FRAGMENT);
-    s_deferredShader = ResourceManager::loadShader("deferredShader", RENDERER_DEFERRED_VERTEX, RENDERER_DEFERRED_FRAGMENT);
+    // Features known per pass are compiled in as permutations, so that shaders carry no branch on them.
+    loadGBufferShaders();
+    s_dualDeferredShader = ResourceManager::loadShader("deferredShader", RENDERER_DEFERRED_VERTEX, RENDERER_DEFERRED_FRAGMENT, "", getClusterDefines({ "LOCAL_MODEL_GGX", "RECONSTRUCT_POSITION" }));
     s_screenSpaceShader = ResourceManager::loadShader("screenSpaceShader", RENDERER_SCREENSPACE_VERTEX, RENDERER_SCREENSPACE_FRAGMENT);
+    s_dualDepthPeelingInitShader = ResourceManager::loadShader("dualDepthPeelingShader", RENDERER_GBUFFER_VERTEX, RENDERER_DUALPEELING_FRAGMENT, "", { "FIRST_PEEL" });
+    s_dualDepthPeelingShader = ResourceManager::loadShader("dualDepthPeelingShader", RENDERER_GBUFFER_VERTEX, RENDERER_DUALPEELING_FRAGMENT);
+    s_linkedListShader = ResourceManager::loadShader("linkedListShader", RENDERER_GBUFFER_VERTEX, RENDERER_LINKEDLIST_FRAGMENT);
+    s_linkedListResolveShader = ResourceManager::loadShader("linkedListResolveShader", RENDERER_SCREENSPACE_VERTEX, RENDERER_LINKEDLIST_RESOLVE_FRAGMENT, "", getClusterDefines());
+    s_weightedBlendedShader = ResourceManager::loadShader("weightedBlendedShader", RENDERER_GBUFFER_VERTEX, RENDERER_WEIGHTEDBLENDED_FRAGMENT, "", getClusterDefines());
+    s_weightedBlendedCompositeShader = ResourceManager::loadShader("weightedBlendedCompositeShader", RENDERER_SCREENSPACE_VERTEX, RENDERER_WEIGHTEDBLENDED_COMPOSITE_FRAGMENT);
+    s_dualDepthPeelingBlendShader = ResourceManager::loadShader("dualDepthPeelingBlendShader", RENDERER_SCREENSPACE_VERTEX, RENDERER_DUALPEELING_BLEND_FRAGMENT);
+    std::string kBufferLayers = "K_BUFFER_LAYERS " + std::to_string(RENDERER_KBUFFER_LAYERS);
+    s_kBufferShader = ResourceManager::loadShader("kBufferShader", RENDERER_GBUFFER_VERTEX, RENDERER_KBUFFER_FRAGMENT, "", { kBufferLayers });
+    s_kBufferResolveShader = ResourceManager::loadShader("kBufferResolveShader", RENDERER_SCREENSPACE_VERTEX, RENDERER_KBUFFER_RESOLVE_FRAGMENT, "", getClusterDefines({ kBufferLayers }));
+    s_lightClusteringShader = ResourceManager::loadComputeShader("lightClusteringShader", RENDERER_LIGHTCLUSTERING_COMPUTE, getClusterDefines({ "GROUP_SIZE " + std::to_string(RENDERER_LIGHTCLUSTERING_GROUPSIZE) }));
+
+    // Resolve handles to the uniforms which are not in uniform buffers
+    s_nodePoolSizeUniform = s_linkedListShader->getUniform<int>(SHADER_NAME("nodePoolSize"));
+    s_skipPeeledLayersUniform = s_weightedBlendedShader->getUniform<int>(SHADER_NAME("skipPeeledLayers"));
+    s_clusteringLightsNumberUniform = s_lightClusteringShader->getUniform<int>(SHADER_NAME("pointLightsNumber"));
+    s_clusteringTileSizeUniform = s_lightClusteringShader->getUniform<glm::vec2>(SHADER_NAME("clusterTileSize"));
 
     // Setup quad VAO and VBO
     float quadVertices[] = {
@@ -69,15 +190,62 @@ void Renderer::init(unsigned int framebufferWidth, unsigned int framebufferHeigh
     };
     glGenVertexArrays(1, &s_quadVAO);
     glGenBuffers(1, &s_quadVBO);
-    glBindVertexArray(s_quadVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, s_quadVBO);
+    StateCache::bindVertexArray(s_quadVAO);
+    StateCache::bindBuffer(GL_ARRAY_BUFFER, s_quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    StateCache::bindVertexArray(0);
+    StateCache::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Create occlusion queries for depth peeling passes; one set per frame, alternating
+    glGenQueries(2 * RENDERER_DEPTHPEELING_MAXPASSES, &s_depthPeelingQueries[0][0]);
+
+    // Create per-instance sample flags for depth peeling passes; one set per frame, alternating
+    // They grow with the number of entities.
+    glGenBuffers(2, s_peelSamplesSSBOs);
+
+    // Create atomic counters for linked lists' node allocation; one per frame, alternating
+    unsigned int zero = 0;
+    glGenBuffers(2, s_linkedListCounters);
+    for (int i = 0; i < 2; i++) {
+        StateCache::bindBuffer(GL_ATOMIC_COUNTER_BUFFER, s_linkedListCounters[i]);
+        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(unsigned int), &zero, GL_DYNAMIC_DRAW);
+    }
+    StateCache::bindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    // Create per-cluster light lists; their size does not depend on resolution
+    unsigned int clustersNumber = RENDERER_CLUSTERS_X * RENDERER_CLUSTERS_Y * RENDERER_CLUSTERS_Z;
+    glGenBuffers(1, &s_clusterLightCountsSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_clusterLightCountsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * clustersNumber, NULL, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &s_clusterLightIndicesSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_clusterLightIndicesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * clustersNumber * RENDERER_CLUSTER_MAXLIGHTS, NULL, GL_DYNAMIC_COPY);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Create SSBO for per-instance material IDs and buffer for indirect draw commands; they grow with the number of
+    // entities. Per-instance matrices are owned by the transform stage, compacted draw commands by the GPU culler.
+    glGenBuffers(1, &s_instanceMaterialsSSBO);
+    glGenBuffers(1, &s_drawCommandsBuffer);
+    TransformStage::init();
+    OcclusionCuller::init();
+    GpuCuller::init();
+
+    // Create uniform buffers for per-frame and per-pass constants; their size is fixed
+    glGenBuffers(1, &s_cameraUBO);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_cameraUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &s_passUBO);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_passUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(PassUniforms), NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &s_lightingUBO);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_lightingUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingUniforms), NULL, GL_DYNAMIC_DRAW);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    s_passUniformsUploaded = false;
 
     // Subscribe to InputManager
     InputManager::subscribeKeyboard(keyboardHandler);
@@ -89,148 +257,214 @@ void Renderer::init(unsigned int framebufferWidth, unsigned int framebufferHeigh
 }
 
 void Renderer::renderEntities(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities, glm::vec3 ambientLight, unsigned int pointLightsSSBO, unsigned int pointLightsSize) {
-    // Clear opaque framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueFBO);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);    
+    // Reallocate render targets once a resize settled; until then, render at the size of the current ones
+    applyPendingResolution();
+    glViewport(0, 0, s_framebufferWidth, s_framebufferHeight);
+
+    // Upload per-frame uniforms and bind them to their fixed binding points, for every pass of this frame
+    glm::mat4 viewMatrix = s_camera.getViewMatrix();
+    uploadFrameUniforms(viewMatrix, ambientLight, pointLightsSize);
+
+    // Leave entities outside of the view frustum, or hidden behind the largest opaque ones, out of every pass
+    // Hidden transparent entities then cost nothing in any peel. GPU culling, which needs multi-draw indirect,
+    // replaces both CPU cullers: the queue then holds every entity, and the GPU drops the hidden ones each frame.
+    glm::mat4 viewProjection = s_camera.getPerspectiveMatrix() * viewMatrix;
+    s_gpuCulling = GpuCuller::getEnabled() && s_multiDrawIndirect;
+    if (!s_gpuCulling) {
+        FrustumCuller::cull(opaqueEntities, transparentEntities, viewProjection);
+        OcclusionCuller::cull(FrustumCuller::getVisibleOpaqueEntities(), FrustumCuller::getVisibleTransparentEntities(), viewProjection);
+        opaqueEntities = OcclusionCuller::getVisibleOpaqueEntities();
+        transparentEntities = OcclusionCuller::getVisibleTransparentEntities();
+    }
+
+    // The opaque depth buffer still holds the previous frame, which GPU culling tests occlusion against
+    glm::mat4 previousViewProjection = s_previousViewProjection;
+    bool previousDepthValid = s_previousDepthValid;
+    s_previousViewProjection = viewProjection;
+    s_previousDepthValid = true;
+
+    // Learn which peels each transparent entity still has layers in, from the samples of a previous frame
+    readPeelSamples();
+
+    // Rebuild the render queue only when entities, materials, models, visible sets, peels reached by entities or the
+    // culling path changed, or when the camera moved enough to stale its front-to-back order; then compute
+    // per-instance transforms, for every geometry pass of this frame. GPU culling compacts commands in whatever order
+    // its invocations finish, so no sorted order survives it and camera movement alone never rebuilds the queue.
+    // Neither do peels reached by entities, which the GPU culler reads from a buffer of its own instead.
+    bool queueStale = !s_renderQueueValid
+        || s_renderQueueEntitiesVersion != EntityManager::getVersion()
+        || s_renderQueueModelsVersion != ResourceManager::getModelsVersion()
+        || (!s_gpuCulling && s_renderQueueVisibilityVersion != OcclusionCuller::getVersion())
+        || (!s_gpuCulling && s_renderQueuePeelReachesVersion != s_peelReachesVersion)
+        || s_renderQueueGpuCulling != s_gpuCulling
+        || (!s_gpuCulling && glm::distance(s_renderQueueCameraPosition, s_camera.getPosition()) > RENDERER_QUEUE_RESORTDISTANCE);
+    if (queueStale) buildRenderQueue(opaqueEntities, transparentEntities);
+    if (s_gpuCulling && (queueStale || s_instanceReachesVersion != s_peelReachesVersion)) uploadInstanceReaches();
+    TransformStage::update(s_instanceEntities, viewMatrix);
+    s_drawCalls = 0;
 
     // How rendering works:
+    //      0) Point lights are binned into clusters, for every lighting pass of this frame;
     //      1) Geometry pass for opaque entities;
     //      2) Geometry and lighting passes for transparent entities, using depth buffer computed from step 1;
     //      3) Lighting pass for opaque entities.
+    // Passes are recorded on the frame graph, then run at once: the graph culls the passes no output depends on
+    // (e.g. light binning, with clustered lighting off) and backs every other target with pooled memory, only for
+    // the passes using it. Only the opaque buffer and depth buffer outlive the frame.
+    s_frameGraph.reset();
+    FrameResources frame;
+    frame.output = s_frameGraph.importTexture("Opaque buffer", s_opaqueBuffer);
+    frame.depth = s_frameGraph.importTexture("Opaque depth buffer", s_opaqueDepthBuffer);
+    frame.clusterLightCounts = s_frameGraph.importBuffer("Cluster light counts", s_clusterLightCountsSSBO);
+    frame.clusterLightIndices = s_frameGraph.importBuffer("Cluster light indices", s_clusterLightIndicesSSBO);
+    frame.drawCommands = s_frameGraph.importBuffer("Culled draw commands", GpuCuller::getCommandsBuffer());
+    frame.pointLightsSSBO = pointLightsSSBO;
+    s_frameGraph.markOutput(frame.output);
+    s_frameGraph.markOutput(frame.depth);
 
 
     // ------------------------------------------------------------------------
-    // ---1--- Geometry pass for opaque entities    
-// Set options
-    glDisable(GL_BLEND);
-    glEnable(GL_CULL_FACE);
-
-    // Clear G-buffer
-    // By setting alpha to 0, the blending operations for the lighting pass will make the background black with alpha = 1.
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueGBufferFBO);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // Setup shader and common uniforms
-    s_gBufferShader->use();
-    glm::mat4 viewMatrix = s_camera.getViewMatrix();
-    s_gBufferShader->setMatrix4("viewMatrix", viewMatrix);
-    s_gBufferShader->setMatrix4("projectionMatrix", s_camera.getPerspectiveMatrix());
-    s_gBufferShader->setInteger("executeDepthPeeling", false);
-    
-    // Run geometry pass
-    for (auto iter = opaqueEntities->begin(); iter != opaqueEntities->end(); iter++)
-        deferredRenderGeometry(true, (*iter), viewMatrix);
+    // ---0--- Light binning
+    s_frameGraph.addPass("Light clustering", [pointLightsSSBO, pointLightsSize]() {
+        buildLightClusters(pointLightsSSBO, pointLightsSize);
+    });
+    s_frameGraph.write(frame.clusterLightCounts, FrameGraphAccess::storage);
+    s_frameGraph.write(frame.clusterLightIndices, FrameGraphAccess::storage);
+
+    // Cull instances on the GPU, against the depth of the previous frame; culled when no geometry pass reads them
+    s_frameGraph.addPass("GPU culling", [previousViewProjection, previousDepthValid]() {
+        GpuCuller::cull(s_drawCommandsBuffer, s_opaqueDepthBuffer, s_framebufferWidth, s_framebufferHeight, previousViewProjection, previousDepthValid);
+    });
+    s_frameGraph.read(frame.depth);
+    s_frameGraph.write(frame.drawCommands, FrameGraphAccess::storage);
+
+    // Clear opaque buffer
+    s_frameGraph.addPass("Clear", []() {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    });
+    s_frameGraph.setColorAttachments({ frame.output });
+
+
+    // ------------------------------------------------------------------------
+    // ---1--- Geometry pass for opaque entities
+    GBufferResources opaqueGBuffer = createGBuffer(frame.depth);
+    s_frameGraph.addPass("Opaque geometry", []() {
+        // Set options
+        StateCache::setCapability(GL_BLEND, false);
+        StateCache::setCapability(GL_CULL_FACE, true);
+
+        // Clear G-buffer
+        // By setting alpha to 0, the blending operations for the lighting pass will make the background black with alpha = 1.
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Setup shader
+        s_gBufferShader->use();
+
+        // Run geometry pass
+        deferredRenderGeometry(s_opaqueDrawList);
+    });
+    writeGBuffer(opaqueGBuffer);
+    readDrawCommands(frame);
+
 
     // ------------------------------------------------------------------------
     // ---2--- Geometry and lighting passes for transparent entities
-    if (transparentEntities->size() > 0) {
-        // Disable backface culling
-        glDisable(GL_CULL_FACE);
-
-        // Setup common uniforms for geometry pass
-        s_gBufferShader->setInteger("executeDepthPeeling", true);
-        s_gBufferShader->setInteger("previousDepth", 0);
-        s_gBufferShader->setInteger("opaqueDepth", 1);
-        s_gBufferShader->setFloat("bufferWidth", (float)s_framebufferWidth);
-        s_gBufferShader->setFloat("bufferHeight", (float)s_framebufferHeight);
-
-        // Execute depth peeling passes
-        int maxPasses = Renderer::getDepthPeelingPasses();
-        for (int pass = 0; pass < maxPasses; pass++) {
-            // Bind correct G-buffer FBO
-            int currId = pass % 2;
-            int prevId = 1 - currId;
-            glBindFramebuffer(GL_FRAMEBUFFER, s_transparentGBufferFBO[currId]);
+    // Transparency is skipped altogether when no transparent entity reaches the screen.
+    bool transparencyVisible = transparentEntities->size() > 0 && computeTransparencyBounds(transparentEntities, viewMatrix);
+    s_depthPeelingSkippedInstances = 0;
+    if (transparencyVisible) {
+        // Pick how many peels to run from the previous frame's occlusion queries
+        // The hybrid technique caps them at its exact layers.
+        bool peeling = s_transparencyMode == TransparencyMode::depthPeeling || s_transparencyMode == TransparencyMode::dualDepthPeeling;
+        if (peeling) s_depthPeelingActivePasses = estimateDepthPeelingPasses(s_depthPeelingPasses);
+        else if (s_transparencyMode == TransparencyMode::hybrid) s_depthPeelingActivePasses = estimateDepthPeelingPasses(s_hybridPeelingPasses);
+        else s_depthPeelingActivePasses = 0;
+
+        // Record the passes of the selected transparency technique
+        switch (s_transparencyMode) {
+            default:
+            case TransparencyMode::depthPeeling:
+                addDepthPeelingPasses(frame);
+                break;
+            case TransparencyMode::dualDepthPeeling:
+                addDualDepthPeelingPasses(frame);
+                break;
+            case TransparencyMode::linkedList:
+                addLinkedListPasses(frame);
+                break;
+            case TransparencyMode::weightedBlended:
+                addWeightedBlendedPasses(frame);
+                break;
+            case TransparencyMode::kBuffer:
+                addKBufferPasses(frame);
+                break;
+            case TransparencyMode::hybrid:
+                addHybridPasses(frame);
+                break;
+        }
+    } else s_depthPeelingActivePasses = 0;
 
-            // Clear G-buffer
-            // By setting alpha to 0, the blending operations for the lighting pass will make the background black with alpha = 1.
-            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Keep track of issued queries; next frame will read them while this frame's set is being rendered
+    s_depthPeelingQueriesIssued[s_depthPeelingQuerySet] = s_depthPeelingActivePasses;
+    s_depthPeelingQuerySet = 1 - s_depthPeelingQuerySet;
 
-            // Disable blending for geometry pass
-            glDisable(GL_BLEND);
 
-            // Use shader on G-buffer
-            s_gBufferShader->use();
+    // ------------------------------------------------------------------------
+    // ---3--- Lighting pass for opaque entities
+    if (opaqueEntities->size() > 0) {
+        s_frameGraph.addPass("Opaque lighting", [opaqueGBuffer, pointLightsSSBO]() {
+            // Light the whole screen
+            StateCache::setCapability(GL_SCISSOR_TEST, false);
 
-            // Setup depth peeling textures for geometry pass
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, s_transparentDepthBuffer[prevId]);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, s_opaqueDepthBuffer);
-
-            // Run geometry pass
-            bool first = pass == 0;
-            for (auto iter = transparentEntities->begin(); iter != transparentEntities->end(); iter++)
-                if ((*iter)->getMaterial()->diffuse.a >= 0.0001f)
-                    deferredRenderGeometry(first, (*iter), viewMatrix);
             // Enable blending for lighting pass
             //
-            // These blending settings enable front-to-back blending.
-            // The front-to-back blending equation is:
-            //      Cdst = Adst (Asrc Csrc) + Cdst
-            //      Adst = (1-Asrc) Adst
-            // The following blending settings produce:
-            //      Cdst = Adst (Csrc) + Cdst
-            //      Adst = (1-Asrc) Adst
-            // The missing multiply by Asrc must be compensated in the shader of the lighting pass,
-            // by simply multiplying the rgb component of the final color with the alpha value.
+            // These blending settings enable front-to-back blending:
+            //      Cdst = Adst Csrc + Cdst
             //
             // SOURCE: https://community.khronos.org/t/front-to-back-blending/65155/3
-            glEnable(GL_BLEND);
-            glBlendEquation(GL_FUNC_ADD);
-            glBlendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA); 
+            StateCache::setCapability(GL_BLEND, true);
+            StateCache::blendEquation(GL_FUNC_ADD);
+            StateCache::blendFunc(GL_DST_ALPHA, GL_ONE);
+            StateCache::setCapability(GL_CULL_FACE, true);
 
             // Run lighting pass
-            deferredRenderLighting(true, ambientLight, pointLightsSSBO, pointLightsSize);
-        }
+            deferredRenderLighting(GBufferSource::opaque, opaqueGBuffer, pointLightsSSBO);
+        });
+        s_frameGraph.setColorAttachments({ frame.output });
+        s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+        readGBuffer(opaqueGBuffer);
+        readLights(frame);
     }
 
-    // ------------------------------------------------------------------------
-    // ---3--- Lighting pass for opaque entities
-    // Enable blending for lighting pass
-    //
-    // These blending settings enable front-to-back blending:
-    //      Cdst = Adst Csrc + Cdst
-    //
-    // SOURCE: https://community.khronos.org/t/front-to-back-blending/65155/3
-    if (opaqueEntities->size() > 0) {
-        glEnable(GL_BLEND);
-        glBlendEquation(GL_FUNC_ADD);
-        glBlendFunc(GL_DST_ALPHA, GL_ONE);
-        glEnable(GL_CULL_FACE);
 
-        // Run lighting pass
-        deferredRenderLighting(false, ambientLight, pointLightsSSBO, pointLightsSize);
-    }
+    // ------------------------------------------------------------------------
+    // Run passes
+    s_frameGraph.compile();
+    s_frameGraph.execute();
+    StateCache::setCapability(GL_SCISSOR_TEST, false);
 }
 
 void Renderer::renderOnDefaultFramebuffer() {
     // Set blending options
-    glDisable(GL_BLEND);
+    StateCache::setCapability(GL_BLEND, false);
 
-    // Bind default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Bind default framebuffer; the opaque buffer is scaled to it while a resize is pending
+    StateCache::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, s_outputWidth, s_outputHeight);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     s_screenSpaceShader->use();
 
     // Bind opaque buffer
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueBuffer);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueDepthBuffer);
-    
-    // Setup OIT-buffer textures uniforms
-    s_screenSpaceShader->setInteger("opaqueBuffer", 0);
-    s_screenSpaceShader->setInteger("depthBuffer", 1);
+    StateCache::bindTexture(0, GL_TEXTURE_2D, s_opaqueBuffer);
+    StateCache::bindTexture(1, GL_TEXTURE_2D, s_opaqueDepthBuffer);
 
     // Draw on quad
-    glBindVertexArray(s_quadVAO);
+    StateCache::bindVertexArray(s_quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    StateCache::bindVertexArray(0);
 }
 
 bool Renderer::isInitialized() {
@@ -238,35 +472,54 @@ bool Renderer::isInitialized() {
 }
 
 void Renderer::setFramebufferResolution(unsigned int framebufferWidth, unsigned int framebufferHeight) {
-    // Update framebuffer metrics
-    s_framebufferWidth = framebufferWidth;
-    s_framebufferHeight = framebufferHeight;
-    
-    // Update camera's view frustum
-    s_camera.setResolution(framebufferWidth, framebufferHeight);
+    // Keep the current targets while the window is minimized
+    if (framebufferWidth == 0 || framebufferHeight == 0) return;
 
-    // Update G-buffer textures
-    setupFramebuffers(framebufferWidth, framebufferHeight);
+    // Update output metrics
+    s_outputWidth = framebufferWidth;
+    s_outputHeight = framebufferHeight;
+
+    // Update camera's view frustum now, so that the image keeps its proportions while scaled
+    s_camera.setResolution((float)framebufferWidth, (float)framebufferHeight);
+
+    // Defer G-buffer textures until the size settles; a window drag resizes the framebuffer on nearly every frame
+    s_resizePending = true;
+    s_resizeTime = glfwGetTime();
 }
 
 void Renderer::clear() {
     s_isInitialized = false;
-	glDeleteFramebuffers(1, (GLuint*)&s_opaqueFBO);
-    glDeleteFramebuffers(2, (GLuint*)s_transparentGBufferFBO);
-    glDeleteFramebuffers(1, (GLuint*)&s_opaqueGBufferFBO);
-	glDeleteTextures(1, (GLuint*)&s_opaqueBuffer);
-    glDeleteTextures(2, (GLuint*)s_transparentDepthBuffer);
-	glDeleteTextures(1, (GLuint*)&s_transparentGPosition);
-	glDeleteTextures(1, (GLuint*)&s_transparentGNormal);
-	glDeleteTextures(1, (GLuint*)&s_transparentGDiffuse);
-	glDeleteTextures(1, (GLuint*)&s_transparentGRoughnessMetalnessAO);
-    glDeleteTextures(1, (GLuint*)&s_opaqueDepthBuffer);
-    glDeleteTextures(1, (GLuint*)&s_opaqueGPosition);
-    glDeleteTextures(1, (GLuint*)&s_opaqueGNormal);
-    glDeleteTextures(1, (GLuint*)&s_opaqueGDiffuse);
-    glDeleteTextures(1, (GLuint*)&s_opaqueGRoughnessMetalnessAO);
-    glDeleteVertexArrays(1, (GLuint*)&s_quadVAO);
-    glDeleteBuffers(1, (GLuint*)&s_quadVBO);
+    s_resizePending = false;
+    s_frameGraph.reset();
+    s_frameGraph.clear();
+    StateCache::deleteBuffer(s_linkedListNodesSSBO);
+    StateCache::deleteBuffer(s_linkedListCounters[0]);
+    StateCache::deleteBuffer(s_linkedListCounters[1]);
+    RenderTargetPool::clear();
+    for (int i = 0; i < 2; i++) {
+        if (s_linkedListFences[i] != nullptr) glDeleteSync(s_linkedListFences[i]);
+        if (s_peelSamplesFences[i] != nullptr) glDeleteSync(s_peelSamplesFences[i]);
+        s_linkedListFences[i] = nullptr;
+        s_peelSamplesFences[i] = nullptr;
+        StateCache::deleteBuffer(s_peelSamplesSSBOs[i]);
+        s_peelSamplesSSBOCapacities[i] = 0;
+    }
+    StateCache::deleteBuffer(s_clusterLightCountsSSBO);
+    StateCache::deleteBuffer(s_clusterLightIndicesSSBO);
+    StateCache::deleteBuffer(s_instanceMaterialsSSBO);
+    StateCache::deleteBuffer(s_drawCommandsBuffer);
+    TransformStage::clear();
+    OcclusionCuller::clear();
+    GpuCuller::clear();
+    StateCache::deleteBuffer(s_cameraUBO);
+    StateCache::deleteBuffer(s_passUBO);
+    StateCache::deleteBuffer(s_lightingUBO);
+    s_instanceMaterialsSSBOCapacity = 0;
+    s_drawCommandsBufferCapacity = 0;
+    s_renderQueueValid = false;
+    glDeleteQueries(2 * RENDERER_DEPTHPEELING_MAXPASSES, (GLuint*)&s_depthPeelingQueries[0][0]);
+    StateCache::deleteVertexArray(s_quadVAO);
+    StateCache::deleteBuffer(s_quadVBO);
 }
 
 Camera& Renderer::getCamera() {
@@ -294,254 +547,1348 @@ void Renderer::setDepthPeelingPasses(int passesNumber) {
         s_depthPeelingPasses = passesNumber;
 }
 
+unsigned int Renderer::getDepthPeelingActivePasses() {
+    return s_depthPeelingActivePasses;
+}
+
+unsigned int Renderer::getDepthPeelingNonEmptyPasses() {
+    return s_depthPeelingNonEmptyPasses;
+}
+
+bool Renderer::getDepthPeelingEarlyTermination() {
+    return s_depthPeelingEarlyTermination;
+}
+
+void Renderer::setDepthPeelingEarlyTermination(bool enable) {
+    s_depthPeelingEarlyTermination = enable;
+}
+
+unsigned int Renderer::getDepthPeelingSampleThreshold() {
+    return s_depthPeelingSampleThreshold;
+}
+
+void Renderer::setDepthPeelingSampleThreshold(int threshold) {
+    if (threshold >= RENDERER_DEPTHPEELING_MAXSAMPLETHRESHOLD)
+        s_depthPeelingSampleThreshold = RENDERER_DEPTHPEELING_MAXSAMPLETHRESHOLD;
+    else if (threshold <= RENDERER_DEPTHPEELING_MINSAMPLETHRESHOLD)
+        s_depthPeelingSampleThreshold = RENDERER_DEPTHPEELING_MINSAMPLETHRESHOLD;
+    else
+        s_depthPeelingSampleThreshold = threshold;
+}
+
+bool Renderer::getDepthPeelingEntityCulling() {
+    return s_depthPeelingEntityCulling;
+}
+
+void Renderer::setDepthPeelingEntityCulling(bool enable) {
+    // Entities are ordered by the peels they reach only while culling is on
+    if (enable != s_depthPeelingEntityCulling) s_renderQueueValid = false;
+    s_depthPeelingEntityCulling = enable;
+}
+
+unsigned int Renderer::getDepthPeelingSkippedInstances() {
+    return s_depthPeelingSkippedInstances;
+}
+
+unsigned int Renderer::getHybridPeelingPasses() {
+    return s_hybridPeelingPasses;
+}
+
+void Renderer::setHybridPeelingPasses(int passesNumber) {
+    if (passesNumber >= RENDERER_DEPTHPEELING_MAXPASSES)
+        s_hybridPeelingPasses = RENDERER_DEPTHPEELING_MAXPASSES;
+    else if (passesNumber <= RENDERER_DEPTHPEELING_MINPASSES)
+        s_hybridPeelingPasses = RENDERER_DEPTHPEELING_MINPASSES;
+    else
+        s_hybridPeelingPasses = passesNumber;
+}
+
+unsigned int Renderer::getLinkedListNodesPerPixel() {
+    return s_linkedListNodesPerPixel;
+}
+
+void Renderer::setLinkedListNodesPerPixel(int nodesPerPixel) {
+    if (nodesPerPixel >= RENDERER_LINKEDLIST_MAXNODESPERPIXEL)
+        s_linkedListNodesPerPixel = RENDERER_LINKEDLIST_MAXNODESPERPIXEL;
+    else if (nodesPerPixel <= RENDERER_LINKEDLIST_MINNODESPERPIXEL)
+        s_linkedListNodesPerPixel = RENDERER_LINKEDLIST_MINNODESPERPIXEL;
+    else
+        s_linkedListNodesPerPixel = nodesPerPixel;
+
+    // Reallocate node pool
+    if (s_isInitialized) setupLinkedListNodePool();
+}
+
+unsigned int Renderer::getLinkedListNodePoolSize() {
+    return s_linkedListNodesPerPixel * s_framebufferWidth * s_framebufferHeight;
+}
+
+unsigned int Renderer::getLinkedListStoredFragments() {
+    return s_linkedListStoredFragments;
+}
+
+unsigned int Renderer::getLinkedListOverflowFragments() {
+    return s_linkedListOverflowFragments;
+}
+
+bool Renderer::getTransparencyScissor() {
+    return s_transparencyScissor;
+}
+
+void Renderer::setTransparencyScissor(bool enable) {
+    s_transparencyScissor = enable;
+}
+
+float Renderer::getTransparencyCoverage() {
+    return s_transparencyCoverage;
+}
+
+bool Renderer::getClusteredLighting() {
+    return s_clusteredLighting;
+}
+
+void Renderer::setClusteredLighting(bool enable) {
+    s_clusteredLighting = enable;
+}
+
+GBufferProfile Renderer::getGBufferProfile() {
+    return s_gBufferProfile;
+}
+
+void Renderer::setGBufferProfile(GBufferProfile profile) {
+    // G-buffers are declared on the frame graph every frame, so the next frame picks the new layout up
+    s_gBufferProfile = profile;
+    loadGBufferShaders();
+}
+
+bool Renderer::getGBufferMaterialIDs() {
+    return s_gBufferMaterialIDs;
+}
+
+void Renderer::setGBufferMaterialIDs(bool enable) {
+    // G-buffers are declared on the frame graph every frame, so the next frame picks the new layout up
+    s_gBufferMaterialIDs = enable;
+    loadGBufferShaders();
+}
+
+unsigned int Renderer::getGBufferBytesPerPixel() {
+    // Full:         position RGBA16F (8) + normal RGBA32F (16) + depth (4)
+    // Compact:      normal RG16F (4) + depth (4)
+    // Plus either:  diffuse RGBA8 (4) + roughness/metalness/AO RGBA8 (4), or material ID R16 (2)
+    unsigned int geometry = s_gBufferProfile == GBufferProfile::compact ? 8 : 28;
+    return geometry + (s_gBufferMaterialIDs ? 2 : 8);
+}
+
+bool Renderer::getInstancing() {
+    return s_instancing;
+}
+
+void Renderer::setInstancing(bool enable) {
+    s_instancing = enable;
+}
+
+bool Renderer::getMultiDrawIndirect() {
+    return s_multiDrawIndirect;
+}
+
+void Renderer::setMultiDrawIndirect(bool enable) {
+    s_multiDrawIndirect = enable;
+}
+
+unsigned int Renderer::getDrawCalls() {
+    return s_drawCalls;
+}
+
+unsigned int Renderer::getRenderQueueRebuilds() {
+    return s_renderQueueRebuilds;
+}
+
+const FrameGraph &Renderer::getFrameGraph() {
+    return s_frameGraph;
+}
+
+TransparencyMode Renderer::getTransparencyMode() {
+    return s_transparencyMode;
+}
+
+void Renderer::setTransparencyMode(TransparencyMode mode) {
+    // Transparent draw items are keyed by the technique's shader
+    if (mode != s_transparencyMode) s_renderQueueValid = false;
+    s_transparencyMode = mode;
+}
+
 // --- Private static methods
+std::vector<std::string> Renderer::getClusterDefines(std::vector<std::string> defines) {
+    // Shaders including lights.glsl take the cluster grid from here, on top of their own defines
+    defines.push_back("CLUSTERS_X " + std::to_string(RENDERER_CLUSTERS_X));
+    defines.push_back("CLUSTERS_Y " + std::to_string(RENDERER_CLUSTERS_Y));
+    defines.push_back("CLUSTERS_Z " + std::to_string(RENDERER_CLUSTERS_Z));
+    defines.push_back("MAX_LIGHTS_PER_CLUSTER " + std::to_string(RENDERER_CLUSTER_MAXLIGHTS));
+    return defines;
+}
+
+void Renderer::loadGBufferShaders() {
+    // The G-buffer layout is compiled into the shaders writing and reading it, one permutation per layout.
+    // Permutations are cached by ResourceManager, so toggling the layout back and forth compiles each once.
+    std::vector<std::string> layout;
+    if (s_gBufferProfile == GBufferProfile::compact) layout.push_back("OCTAHEDRAL_NORMALS");
+    if (s_gBufferMaterialIDs) layout.push_back("MATERIAL_IDS");
+    std::vector<std::string> firstPeel = layout, peel = layout, lighting = getClusterDefines(layout);
+    std::string maxPeels = "MAX_PEELS " + std::to_string(RENDERER_DEPTHPEELING_MAXPASSES);
+    firstPeel.insert(firstPeel.end(), { "DEPTH_PEELING", "FIRST_PEEL", maxPeels });
+    peel.insert(peel.end(), { "DEPTH_PEELING", maxPeels });
+    lighting.push_back("LOCAL_MODEL_GGX");
+    if (s_gBufferProfile == GBufferProfile::compact) lighting.push_back("RECONSTRUCT_POSITION");
+    s_gBufferShader = ResourceManager::loadShader("gBufferShader", RENDERER_GBUFFER_VERTEX, RENDERER_GBUFFER_FRAGMENT, "", layout);
+    s_gBufferFirstPeelShader = ResourceManager::loadShader("gBufferShader", RENDERER_GBUFFER_VERTEX, RENDERER_GBUFFER_FRAGMENT, "", firstPeel);
+    s_gBufferPeelShader = ResourceManager::loadShader("gBufferShader", RENDERER_GBUFFER_VERTEX, RENDERER_GBUFFER_FRAGMENT, "", peel);
+    s_deferredShader = ResourceManager::loadShader("deferredShader", RENDERER_DEFERRED_VERTEX, RENDERER_DEFERRED_FRAGMENT, "", lighting);
+}
+
+void Renderer::applyPendingResolution() {
+    // Apply the latest framebuffer size once no resize came for a while
+    if (!s_resizePending || glfwGetTime() - s_resizeTime < RENDERER_RESIZE_DEBOUNCE) return;
+    s_resizePending = false;
+    if (s_outputWidth == s_framebufferWidth && s_outputHeight == s_framebufferHeight) return;
+    s_framebufferWidth = s_outputWidth;
+    s_framebufferHeight = s_outputHeight;
+    setupFramebuffers(s_framebufferWidth, s_framebufferHeight);
+}
+
 void Renderer::setupFramebuffers(unsigned int framebufferWidth, unsigned int framebufferHeight) {
-    // --- Opaque FBO
-    // Create opaque FBO
-    if (s_opaqueFBO == 0) glGenFramebuffers(1, &s_opaqueFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueFBO);
-
-    // Create and attach opaque buffer
-	if (s_opaqueBuffer == 0) glGenTextures(1, &s_opaqueBuffer);
-	glBindTexture(GL_TEXTURE_2D, s_opaqueBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_opaqueBuffer, 0);
-
-    // Check if opaque FBO is complete
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueFBO);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER: opaque FBO not complete.\n";
-
-
-    // --- Transparency G-buffer FBOs
-    // Create position buffer for tranparency rendering
-    if (s_transparentGPosition == 0) glGenTextures(1, &s_transparentGPosition);
-    glBindTexture(GL_TEXTURE_2D, s_transparentGPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create normal buffer for tranparency rendering
-    if (s_transparentGNormal == 0) glGenTextures(1, &s_transparentGNormal);
-    glBindTexture(GL_TEXTURE_2D, s_transparentGNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create diffuse buffer for tranparency rendering
-    if (s_transparentGDiffuse == 0) glGenTextures(1, &s_transparentGDiffuse);
-    glBindTexture(GL_TEXTURE_2D, s_transparentGDiffuse);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create roughness + metalness + ambient occlusion buffer for tranparency rendering
-    if (s_transparentGRoughnessMetalnessAO == 0) glGenTextures(1, &s_transparentGRoughnessMetalnessAO);
-    glBindTexture(GL_TEXTURE_2D, s_transparentGRoughnessMetalnessAO);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create G-buffer FBOs for tranparency rendering
-    for (int i = 0; i < 2; i++) {
-        // Create FBO
-        if (s_transparentGBufferFBO[i] == 0) glGenFramebuffers(1, &s_transparentGBufferFBO[i]);
-        glBindFramebuffer(GL_FRAMEBUFFER, s_transparentGBufferFBO[i]);
-
-        // Attach color buffers to this G-buffer
-        glBindTexture(GL_TEXTURE_2D, s_transparentGPosition);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_transparentGPosition, 0);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGNormal);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, s_transparentGNormal, 0);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGDiffuse);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, s_transparentGDiffuse, 0);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGRoughnessMetalnessAO);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, s_transparentGRoughnessMetalnessAO, 0);
-
-        // Tell OpenGL which color attachments the G-buffer FBOs will use for rendering
-        unsigned int gAttachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-        glDrawBuffers(4, gAttachments);
-
-        // Create and attach depth buffer
-        if (s_transparentDepthBuffer[i] == 0) glGenTextures(1, &s_transparentDepthBuffer[i]);
-        glBindTexture(GL_TEXTURE_2D, s_transparentDepthBuffer[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, framebufferWidth, framebufferHeight, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, s_transparentDepthBuffer[i], 0);
-        // If you want to let shaders use these buffers with sampler2DShadow, set the following parameter for both textures:
-        // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-    
-        // Check if the FBO is complete
-        glBindFramebuffer(GL_FRAMEBUFFER, s_transparentGBufferFBO[i]);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "ERROR::FRAMEBUFFER: Transparency G-buffer(" << i << ") FBO not complete.\n";
+    // --- Persistent targets
+    // Only the opaque buffer and depth buffer outlive a frame, as renderOnDefaultFramebuffer presents them; every
+    // other target is transient, declared on the frame graph by the passes using it (see renderEntities).
+    setupTexture(s_opaqueBuffer, GL_RGBA16, framebufferWidth, framebufferHeight);
+    setupTexture(s_opaqueDepthBuffer, GL_DEPTH_COMPONENT24, framebufferWidth, framebufferHeight);
+    s_previousDepthValid = false;
+
+    // --- Linked lists' node pool
+    setupLinkedListNodePool();
+
+    // Free the targets left over by the previous size
+    RenderTargetPool::trim(framebufferWidth, framebufferHeight);
+
+
+    // NOTE FOR RESIZE: targets are allocated with glTexStorage2D, whose storage is immutable and cannot be resized.
+    //                  Each setup releases the persistent targets to the pool and acquires them again: targets whose
+    //                  format and size did not change are handed back as they are, the others are allocated anew.
+    //                  Transient targets follow the new size on the next frame, and the frame graph drops framebuffers
+    //                  attached to deleted targets. Resizes are debounced (see setFramebufferResolution), so that this
+    //                  happens once the window settles rather than on every step of a drag.
+}
+
+unsigned int Renderer::estimateDepthPeelingPasses(unsigned int maxPasses) {
+    // Run up to maxPasses passes if early termination is off, or if the previous frame issued no queries
+    unsigned int prevSet = 1 - s_depthPeelingQuerySet;
+    unsigned int issued = s_depthPeelingQueriesIssued[prevSet];
+    if (!s_depthPeelingEarlyTermination || issued == 0)
+        return maxPasses;
+
+    // Count the leading passes of the previous frame which produced enough samples
+    // Results are read only if already available, so that the CPU never waits for the GPU;
+    // otherwise, the estimate of the previous frame is kept.
+    unsigned int nonEmpty = 0;
+    for (; nonEmpty < issued; nonEmpty++) {
+        unsigned int available = 0;
+        glGetQueryObjectuiv(s_depthPeelingQueries[prevSet][nonEmpty], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return s_depthPeelingActivePasses > 0 ? glm::min(s_depthPeelingActivePasses, maxPasses) : maxPasses;
+        unsigned int samples = 0;
+        glGetQueryObjectuiv(s_depthPeelingQueries[prevSet][nonEmpty], GL_QUERY_RESULT, &samples);
+        if (samples < s_depthPeelingSampleThreshold) break;
+    }
+    s_depthPeelingNonEmptyPasses = nonEmpty;
+
+    // Run one more pass than the non-empty ones: it probes whether deeper layers appeared,
+    // letting the number of peels grow back by one pass per frame.
+    return glm::min(nonEmpty + 1, maxPasses);
+}
+
+void Renderer::readPeelSamples() {
+    // Read the sample flags of the previous frame, only if the GPU is done with them
+    unsigned int prevSet = 1 - s_peelSamplesSet;
+    if (!s_depthPeelingEntityCulling || s_peelSamplesFences[prevSet] == nullptr) return;
+    GLenum status = glClientWaitSync(s_peelSamplesFences[prevSet], 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+    glDeleteSync(s_peelSamplesFences[prevSet]);
+    s_peelSamplesFences[prevSet] = nullptr;
+
+    // Flags of entities which changed since are dropped; entities with no flags reach every peel
+    std::unordered_map<Entity*, unsigned int> reaches;
+    const std::vector<Entity*> &entities = s_peelSamplesEntities[prevSet];
+    if (s_peelSamplesEntitiesVersions[prevSet] == EntityManager::getVersion() && !entities.empty()) {
+        s_peelSamples.resize(entities.size() * RENDERER_DEPTHPEELING_MAXPASSES);
+        GLintptr offset = sizeof(unsigned int) * s_peelSamplesFirstInstances[prevSet] * RENDERER_DEPTHPEELING_MAXPASSES;
+        StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_peelSamplesSSBOs[prevSet]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, sizeof(unsigned int) * s_peelSamples.size(), s_peelSamples.data());
+        StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // An entity with no fragments past peel k has none past any later peel, as layers only get deeper; it is
+        // drawn up to peel k, which keeps probing for layers it may gain as the camera moves.
+        // Peels which did not run tell nothing, so an entity with samples in all of them reaches every peel. Neither
+        // does an entity with no samples in the first peel: it may just have been culled on the GPU, and would
+        // otherwise take a frame per peel to regain its deeper layers once back in view.
+        unsigned int passes = s_peelSamplesPasses[prevSet];
+        for (size_t i = 0; i < entities.size(); i++) {
+            const unsigned int *samples = &s_peelSamples[i * RENDERER_DEPTHPEELING_MAXPASSES];
+            if (samples[0] == 0) continue;
+            unsigned int reach = 0;
+            while (reach < passes && samples[reach] != 0) reach++;
+            if (reach < passes) reaches[entities[i]] = reach;
+        }
+    }
+
+    // The render queue orders instances by the peels they reach, so it is rebuilt whenever they change; with GPU
+    // culling, only the reaches read by the culler are uploaded again
+    if (reaches != s_peelReaches) {
+        s_peelReaches.swap(reaches);
+        s_peelReachesVersion++;
+    }
+}
+
+void Renderer::uploadInstanceReaches() {
+    // Peels reached by every instance of the render queue, for the GPU culler to drop instances from the peel lists
+    // they do not reach; every one of them, when unknown. Peel lists are then left untouched by reaches, so that
+    // reaches changing as entities enter and leave the view never rebuild the queue.
+    // Instances dropped from each peel are counted here, as the CPU never sees what the GPU culler draws.
+    s_instanceReaches.assign(s_instanceEntities.size(), RENDERER_DEPTHPEELING_MAXPASSES - 1);
+    std::fill(std::begin(s_instanceReachesSkipped), std::end(s_instanceReachesSkipped), 0u);
+    if (s_depthPeelingEntityCulling) {
+        for (size_t i = 0; i < s_instanceEntities.size(); i++) {
+            auto found = s_peelReaches.find(s_instanceEntities[i]);
+            if (found == s_peelReaches.end()) continue;
+            s_instanceReaches[i] = found->second;
+            for (unsigned int peel = found->second + 1; peel < RENDERER_DEPTHPEELING_MAXPASSES; peel++)
+                s_instanceReachesSkipped[peel]++;
+        }
     }
+    GpuCuller::setupReaches(s_instanceReaches);
+    s_instanceReachesVersion = s_peelReachesVersion;
+}
+
+bool Renderer::computeTransparencyBounds(std::vector<Entity*> *transparentEntities, glm::mat4 &viewMatrix) {
+    // Cover the whole framebuffer if restriction is off
+    if (!s_transparencyScissor) {
+        s_transparencyBounds[0] = 0;
+        s_transparencyBounds[1] = 0;
+        s_transparencyBounds[2] = s_framebufferWidth;
+        s_transparencyBounds[3] = s_framebufferHeight;
+        s_transparencyCoverage = 1.0f;
+        return true;
+    }
+
+    // Grow a rectangle in NDC by projecting the corners of each visible entity's bounding box
+    glm::mat4 viewProjection = s_camera.getPerspectiveMatrix() * viewMatrix;
+    glm::vec2 ndcMin{ 1.0f };
+    glm::vec2 ndcMax{ -1.0f };
+    for (auto iter = transparentEntities->begin(); iter != transparentEntities->end(); iter++) {
+        if ((*iter)->getMaterial()->diffuse.a < 0.0001f) continue;
+        glm::vec3 center, extents;
+        (*iter)->getWorldBounds(center, extents);
+
+        // Project the corners, tracking which clip planes each lies outside of. Boxes with every corner outside the
+        // same plane are culled, including those lying entirely behind the camera. Corners behind the camera cannot
+        // be projected: a box straddling the camera plane may then cover the whole screen.
+        glm::vec4 clips[8];
+        unsigned int outsideAll = 0x3F;
+        bool behindCamera = false;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 offset{ (corner & 1) ? extents.x : -extents.x, (corner & 2) ? extents.y : -extents.y, (corner & 4) ? extents.z : -extents.z };
+            glm::vec4 clip = viewProjection * glm::vec4{ center + offset, 1.0f };
+            unsigned int outside = (clip.x < -clip.w ? 0x01 : 0) | (clip.x > clip.w ? 0x02 : 0)
+                                 | (clip.y < -clip.w ? 0x04 : 0) | (clip.y > clip.w ? 0x08 : 0)
+                                 | (clip.z < -clip.w ? 0x10 : 0) | (clip.z > clip.w ? 0x20 : 0);
+            outsideAll &= outside;
+            behindCamera |= clip.w <= 0.0001f;
+            clips[corner] = clip;
+        }
+        if (outsideAll != 0) continue;
+        glm::vec2 entityMin{ -1.0f };
+        glm::vec2 entityMax{ 1.0f };
+        if (!behindCamera) {
+            entityMin = glm::vec2{ std::numeric_limits<float>::max() };
+            entityMax = glm::vec2{ std::numeric_limits<float>::lowest() };
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec2 ndc = glm::vec2{ clips[corner] } / clips[corner].w;
+                entityMin = glm::min(entityMin, ndc);
+                entityMax = glm::max(entityMax, ndc);
+            }
+        }
+
+        // Skip entities lying outside the screen
+        if (entityMax.x < -1.0f || entityMax.y < -1.0f || entityMin.x > 1.0f || entityMin.y > 1.0f) continue;
+        ndcMin = glm::min(ndcMin, entityMin);
+        ndcMax = glm::max(ndcMax, entityMax);
+    }
+
+    // Clip rectangle to the screen; stop if empty
+    ndcMin = glm::clamp(ndcMin, -1.0f, 1.0f);
+    ndcMax = glm::clamp(ndcMax, -1.0f, 1.0f);
+    if (ndcMin.x >= ndcMax.x || ndcMin.y >= ndcMax.y) {
+        s_transparencyCoverage = 0.0f;
+        return false;
+    }
+
+    // Convert to pixels, rounding outwards
+    glm::vec2 resolution{ (float)s_framebufferWidth, (float)s_framebufferHeight };
+    glm::ivec2 pixelMin = glm::ivec2{ glm::floor((ndcMin * 0.5f + 0.5f) * resolution) };
+    glm::ivec2 pixelMax = glm::ivec2{ glm::ceil((ndcMax * 0.5f + 0.5f) * resolution) };
+    s_transparencyBounds[0] = pixelMin.x;
+    s_transparencyBounds[1] = pixelMin.y;
+    s_transparencyBounds[2] = pixelMax.x - pixelMin.x;
+    s_transparencyBounds[3] = pixelMax.y - pixelMin.y;
+    s_transparencyCoverage = (float)(s_transparencyBounds[2] * s_transparencyBounds[3]) / (resolution.x * resolution.y);
+    return true;
+}
+
+void Renderer::setupLinkedListNodePool() {
+    // Allocate node pool; its content is rewritten every frame
+    if (s_linkedListNodesSSBO == 0) glGenBuffers(1, &s_linkedListNodesSSBO);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_linkedListNodesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)getLinkedListNodePoolSize() * RENDERER_LINKEDLIST_NODESIZE, NULL, GL_DYNAMIC_COPY);
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Renderer::setupTexture(unsigned int &texture, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers) {
+    // Swap the texture for a pooled target with the new key; if the key did not change, the same target comes back
+    RenderTargetPool::release(texture);
+    texture = RenderTargetPool::acquire(internalFormat, width, height, layers);
+}
+
+GBufferResources Renderer::createGBuffer(FrameGraphResource depth) {
+    // The compact profile reconstructs position from the depth buffer and stores octahedral-encoded normals.
+    // With material IDs, the diffuse buffer holds a normalized 16-bit material ID, and roughness + metalness +
+    // ambient occlusion are fetched from the material. Targets a layout does not store are not created at all.
+    bool compact = s_gBufferProfile == GBufferProfile::compact;
+    bool materialIDs = s_gBufferMaterialIDs;
+    GBufferResources gBuffer;
+    gBuffer.position = compact ? FRAMEGRAPH_NONE : s_frameGraph.createTexture("G-buffer position", GL_RGBA16F, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.normal = s_frameGraph.createTexture("G-buffer normal", compact ? GL_RG16F : GL_RGBA32F, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.diffuse = s_frameGraph.createTexture("G-buffer diffuse", materialIDs ? GL_R16 : GL_RGBA8, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.roughnessMetalnessAO = materialIDs ? FRAMEGRAPH_NONE : s_frameGraph.createTexture("G-buffer roughness, metalness, AO", GL_RGBA8, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.depth = depth;
+    return gBuffer;
+}
 
+GBufferResources Renderer::createDualPeelingGBuffer(FrameGraphResource depth) {
+    // Position is not stored: the lighting pass reconstructs it from the min-max depth buffer,
+    // which keeps the geometry pass within the 8 color attachments guaranteed by OpenGL.
+    GBufferResources gBuffer;
+    gBuffer.position = FRAMEGRAPH_NONE;
+    gBuffer.normal = s_frameGraph.createTexture("Dual peeling normal", GL_RGBA16F, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.diffuse = s_frameGraph.createTexture("Dual peeling diffuse", GL_RGBA8, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.roughnessMetalnessAO = s_frameGraph.createTexture("Dual peeling roughness, metalness, AO", GL_RGBA8, s_framebufferWidth, s_framebufferHeight);
+    gBuffer.depth = depth;
+    return gBuffer;
+}
 
-    // --- Opaque G-buffer FBO
-    // Create position buffer for opaque rendering
-    if (s_opaqueGPosition == 0) glGenTextures(1, &s_opaqueGPosition);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create normal buffer for opaque rendering
-    if (s_opaqueGNormal == 0) glGenTextures(1, &s_opaqueGNormal);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create diffuse buffer for opaque rendering
-    if (s_opaqueGDiffuse == 0) glGenTextures(1, &s_opaqueGDiffuse);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGDiffuse);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create roughness + metalness + ambient occlusion buffer for opaque rendering
-    if (s_opaqueGRoughnessMetalnessAO == 0) glGenTextures(1, &s_opaqueGRoughnessMetalnessAO);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGRoughnessMetalnessAO);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebufferWidth, framebufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Create G-buffer FBOs for tranparency rendering
-    if (s_opaqueGBufferFBO == 0) glGenFramebuffers(1, &s_opaqueGBufferFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueGBufferFBO);
-
-    // Attach color buffers to this G-buffer
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGPosition);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_opaqueGPosition, 0);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGNormal);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, s_opaqueGNormal, 0);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGDiffuse);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, s_opaqueGDiffuse, 0);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueGRoughnessMetalnessAO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, s_opaqueGRoughnessMetalnessAO, 0);
-
-    // Tell OpenGL which color attachments the G-buffer FBOs will use for rendering
-    unsigned int gAttachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-    glDrawBuffers(4, gAttachments);
-
-    // Create and attach depth buffer
-    if (s_opaqueDepthBuffer == 0) glGenTextures(1, &s_opaqueDepthBuffer);
-    glBindTexture(GL_TEXTURE_2D, s_opaqueDepthBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, framebufferWidth, framebufferHeight, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, s_opaqueDepthBuffer, 0);
-    // If you want to let shaders use these buffers with sampler2DShadow, set the following parameter for both textures:
-    // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-
-    // Check if the FBO is complete
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueGBufferFBO);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER: Opaque G-buffer FBO not complete.\n";
-
-
-    // --- Unbind
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-
-    // NOTE FOR RESIZE: glTexImage2D allows to resize the buffer (https://stackoverflow.com/questions/23362497/how-can-i-resize-existing-texture-attachments-at-my-framebuffer)
-    //                  glRenderbufferStorage doesn't: you need to recreate the whole thing
+void Renderer::writeGBuffer(const GBufferResources &gBuffer) {
+    // Attachments match the outputs of gBufferShader.frag, whatever the layout
+    s_frameGraph.setColorAttachments({ gBuffer.position, gBuffer.normal, gBuffer.diffuse, gBuffer.roughnessMetalnessAO });
+    s_frameGraph.setDepthAttachment(gBuffer.depth, true);
+}
+
+void Renderer::readGBuffer(const GBufferResources &gBuffer) {
+    s_frameGraph.read(gBuffer.position);
+    s_frameGraph.read(gBuffer.normal);
+    s_frameGraph.read(gBuffer.diffuse);
+    s_frameGraph.read(gBuffer.roughnessMetalnessAO);
+    s_frameGraph.read(gBuffer.depth);
+}
+
+void Renderer::readLights(const FrameResources &frame) {
+    // Cluster lists are read only with clustered lighting; otherwise no pass reads them, and light binning is culled
+    if (!s_clusteredLighting) return;
+    s_frameGraph.read(frame.clusterLightCounts, FrameGraphAccess::storage);
+    s_frameGraph.read(frame.clusterLightIndices, FrameGraphAccess::storage);
+}
+
+void Renderer::readDrawCommands(const FrameResources &frame) {
+    // Compacted commands are read only with GPU culling; otherwise no pass reads them, and GPU culling is culled
+    if (!s_gpuCulling) return;
+    s_frameGraph.read(frame.drawCommands, FrameGraphAccess::indirect);
+}
+
+void Renderer::applyTransparencyBounds() {
+    // Restrict clears, geometry and lighting passes to the screen bounds of transparent entities
+    // Each peel then costs fill-rate only for the fraction of the screen covered by transparency.
+    StateCache::setCapability(GL_SCISSOR_TEST, true);
+    glScissor(s_transparencyBounds[0], s_transparencyBounds[1], s_transparencyBounds[2], s_transparencyBounds[3]);
+}
+
+FrameGraphResource Renderer::addDepthPeelingPasses(const FrameResources &frame) {
+    // Each peel writes a G-buffer and a depth buffer of its own, then lights them
+    // Once lit, a peel's G-buffer is dead, so the next peel aliases its memory; depth buffers are read by the next
+    // peel too, so they alternate between two targets. Returns the depth buffer of the last peel.
     //
-    //                  So, you don't have to destroy the buffer first and generate a new one.
-    //                  Remember the GLuint is only a 'pointer' of sorts for OpenGL. It is not
-    //                  the actual storage, thus it is perfectly fine to reuse the same 'pointer'
-    //                  (if you did not delete it yet of course).
-}
-
-void Renderer::deferredRenderGeometry(bool firstPass, Entity *entity, glm::mat4 &viewMatrix) {
-    // Setup matrices for this entity
-    glm::mat4 modelMatrix = glm::mat4{ 1.0f };
-    glm::mat3 normalMatrix = glm::mat3{ 1.0f };
-    modelMatrix = glm::translate(modelMatrix, entity->getPosition());
-    normalMatrix = glm::inverseTranspose(glm::mat3(viewMatrix * modelMatrix));
-    s_gBufferShader->setMatrix4("modelMatrix", modelMatrix);
-    s_gBufferShader->setMatrix3("normalMatrix", normalMatrix);
-
-    // Setup material uniforms
-    Material *material = entity->getMaterial();
-    s_gBufferShader->setVector4("material.diffuse", material->diffuse);
-    s_gBufferShader->setFloat("material.roughness", material->roughness);
-    s_gBufferShader->setFloat("material.metalness", material->metalness);
-    s_gBufferShader->setFloat("material.ambientOcclusion", material->ambientOcclusion);
-
-    // State whether this is the first depth peeling pass
-    s_gBufferShader->setInteger("firstPass", firstPass);
-
-    // Build VAO list
-    Model *model = entity->getModel();
-    int meshNum = model->getMeshesNumber();
-    GLuint *vaoList = new GLuint[meshNum];
-    int *indicesNumberList = new int[meshNum];
-    model->buildMeshLists(vaoList, indicesNumberList);
+    // Peels also flag the instances with fragments past their tests. Read back a frame later (see readPeelSamples),
+    // flags let every peel past the first one draw only the instances which still had layers left.
+    FrameGraphResource previousDepth = FRAMEGRAPH_NONE;
+    int maxPasses = s_depthPeelingActivePasses;
+    unsigned int samplesSet = s_peelSamplesSet;
+    unsigned int transparentInstances = 0;
+    for (const DrawGroup &group : s_transparentDrawList.groups)
+        transparentInstances += group.instanceCount;
+
+    // Remember which instances the flags of this frame belong to
+    s_peelSamplesEntities[samplesSet].clear();
+    s_peelSamplesFirstInstances[samplesSet] = 0;
+    if (!s_transparentDrawList.groups.empty()) {
+        unsigned int firstInstance = s_transparentDrawList.groups.front().firstInstance;
+        s_peelSamplesEntities[samplesSet].assign(s_instanceEntities.begin() + firstInstance, s_instanceEntities.begin() + firstInstance + transparentInstances);
+        s_peelSamplesFirstInstances[samplesSet] = firstInstance;
+    }
+    s_peelSamplesEntitiesVersions[samplesSet] = EntityManager::getVersion();
+    s_peelSamplesPasses[samplesSet] = maxPasses;
+    s_peelSamplesSet = 1 - samplesSet;
+
+    for (int pass = 0; pass < maxPasses; pass++) {
+        FrameGraphResource depth = s_frameGraph.createTexture("Peel depth", GL_DEPTH_COMPONENT24, s_framebufferWidth, s_framebufferHeight);
+        GBufferResources gBuffer = createGBuffer(depth);
+        unsigned int query = s_depthPeelingQueries[s_depthPeelingQuerySet][pass];
+
+        // Pick the instances to draw
+        DrawList *drawList = &s_transparentDrawList;
+        if (pass > 0 && s_depthPeelingEntityCulling) {
+            drawList = &s_peelDrawLists[pass];
+            unsigned int drawnInstances = 0;
+            for (const DrawGroup &group : drawList->groups)
+                drawnInstances += group.instanceCount;
+            s_depthPeelingSkippedInstances += s_gpuCulling ? s_instanceReachesSkipped[pass] : transparentInstances - drawnInstances;
+        }
 
-    // Render
-    for (int i = 0; i < meshNum; i++) {
-        glBindVertexArray(vaoList[i]);
-        glDrawElements(GL_TRIANGLES, indicesNumberList[i], GL_UNSIGNED_INT, 0);
+        // Geometry pass
+        // The first peel has no previous layer to test against, so it runs its own variant.
+        bool first = pass == 0;
+        bool last = pass == maxPasses - 1;
+        s_frameGraph.addPass("Depth peeling geometry", [frame, previousDepth, first, last, pass, query, samplesSet, drawList]() {
+            // Disable backface culling
+            applyTransparencyBounds();
+            StateCache::setCapability(GL_CULL_FACE, false);
+
+            // Clear G-buffer
+            // By setting alpha to 0, the blending operations for the lighting pass will make the background black with alpha = 1.
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // Disable blending for geometry pass
+            StateCache::setCapability(GL_BLEND, false);
+
+            // Use shader on G-buffer
+            (first ? s_gBufferFirstPeelShader : s_gBufferPeelShader)->use();
+
+            // Setup depth peeling textures for geometry pass
+            StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(previousDepth));
+            StateCache::bindTexture(1, GL_TEXTURE_2D, s_frameGraph.getTexture(frame.depth));
+
+            // Setup per-instance sample flags; the first peel clears them, allocating more memory only if needed
+            unsigned int samplesSSBO = s_peelSamplesSSBOs[samplesSet];
+            if (first) {
+                unsigned int capacity = (unsigned int)s_instanceEntities.size();
+                StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, samplesSSBO);
+                if (capacity > s_peelSamplesSSBOCapacities[samplesSet]) {
+                    s_peelSamplesSSBOCapacities[samplesSet] = (unsigned int)s_instanceEntities.capacity();
+                    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * RENDERER_DEPTHPEELING_MAXPASSES * s_peelSamplesSSBOCapacities[samplesSet], NULL, GL_DYNAMIC_READ);
+                }
+                unsigned int zero = 0;
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+                StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            }
+            StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, samplesSSBO);
+            s_passUniforms.peel = pass;
+
+            // Run geometry pass, counting the samples of this peel
+            glBeginQuery(GL_SAMPLES_PASSED, query);
+            deferredRenderGeometry(*drawList);
+            glEndQuery(GL_SAMPLES_PASSED);
+
+            // Fence the sample flags after the last peel, to be read back in a later frame
+            if (last) {
+                glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+                if (s_peelSamplesFences[samplesSet] != nullptr) glDeleteSync(s_peelSamplesFences[samplesSet]);
+                s_peelSamplesFences[samplesSet] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+        });
+        writeGBuffer(gBuffer);
+        s_frameGraph.read(previousDepth);
+        s_frameGraph.read(frame.depth);
+        readDrawCommands(frame);
+
+        // Lighting pass
+        s_frameGraph.addPass("Depth peeling lighting", [frame, gBuffer, query]() {
+            applyTransparencyBounds();
+
+            // Enable blending for lighting pass
+            //
+            // These blending settings enable front-to-back blending.
+            // The front-to-back blending equation is:
+            //      Cdst = Adst (Asrc Csrc) + Cdst
+            //      Adst = (1-Asrc) Adst
+            // The following blending settings produce:
+            //      Cdst = Adst (Csrc) + Cdst
+            //      Adst = (1-Asrc) Adst
+            // The missing multiply by Asrc must be compensated in the shader of the lighting pass,
+            // by simply multiplying the rgb component of the final color with the alpha value.
+            //
+            // SOURCE: https://community.khronos.org/t/front-to-back-blending/65155/3
+            StateCache::setCapability(GL_BLEND, true);
+            StateCache::blendEquation(GL_FUNC_ADD);
+            StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+            // Run lighting pass, unless the peel was empty
+            // The GPU waits for the query, the CPU does not.
+            glBeginConditionalRender(query, GL_QUERY_WAIT);
+            deferredRenderLighting(GBufferSource::transparent, gBuffer, frame.pointLightsSSBO);
+            glEndConditionalRender();
+        });
+        s_frameGraph.setColorAttachments({ frame.output });
+        s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+        readGBuffer(gBuffer);
+        readLights(frame);
+
+        previousDepth = depth;
     }
-    glBindVertexArray(0);
-
-    // Deallocate lists
-    delete[] vaoList;
-    delete[] indicesNumberList;
-}
-
-void Renderer::deferredRenderLighting(bool transparentGBuffer, glm::vec3 ambientLight, unsigned int pointLightsSSBO, unsigned int pointLightsSize) {  
-    // Use shader on opaque framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, s_opaqueFBO);
-    s_deferredShader->use();
-
-    // Bind G-buffer textures
-    if (transparentGBuffer) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGDiffuse);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, s_transparentGRoughnessMetalnessAO);
-    } else {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, s_opaqueGPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, s_opaqueGNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, s_opaqueGDiffuse);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, s_opaqueGRoughnessMetalnessAO);
+    return previousDepth;
+}
+
+void Renderer::addDualDepthPeelingPasses(const FrameResources &frame) {
+    // How dual depth peeling works:
+    //      0) An initialization pass stores the nearest and farthest depth of every pixel as (-nearest, farthest),
+    //         by using GL_MAX blending in place of the depth test;
+    //      1) Each following pass reads the previous min-max depth buffer: fragments matching the nearest depth are
+    //         written to the front G-buffer, fragments matching the farthest depth are written to the back G-buffer,
+    //         while fragments in between compute the min-max depth buffer for the next pass;
+    //      2) The front layer is lit and blended front-to-back on the opaque buffer, the back layer is lit and blended
+    //         back-to-front on a separate back buffer;
+    //      3) The back buffer is finally blended under all front layers.
+    // Two layers are peeled by each pass, halving the geometry passes needed for the same depth complexity.
+    //
+    // SOURCE: Bavoil, Myers - Order Independent Transparency with Dual Depth Peeling (NVIDIA, 2008)
+
+    // Clear back buffer
+    // Alpha stores the transmittance of the back layers, so it starts from 1.
+    FrameGraphResource backBuffer = s_frameGraph.createTexture("Dual peeling back buffer", GL_RGBA16F, s_framebufferWidth, s_framebufferHeight);
+    s_frameGraph.addPass("Dual depth peeling clear", []() {
+        applyTransparencyBounds();
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    });
+    s_frameGraph.setColorAttachments({ backBuffer });
+
+    // Execute initialization pass and dual depth peeling passes
+    // Each pass writes a min-max depth buffer and layer G-buffers of its own; as with depth peeling, G-buffers alias
+    // from one pass to the next, while min-max depth buffers alternate between two targets.
+    FrameGraphResource previousMinMaxDepth = FRAMEGRAPH_NONE;
+    int maxPasses = s_depthPeelingActivePasses;
+    for (int pass = 0; pass <= maxPasses; pass++) {
+        // The initialization pass only stores depths, so it runs its own variant with no G-buffer
+        bool first = pass == 0;
+        FrameGraphResource minMaxDepth = s_frameGraph.createTexture("Dual peeling min-max depth", GL_RG32F, s_framebufferWidth, s_framebufferHeight);
+        GBufferResources front{ FRAMEGRAPH_NONE, FRAMEGRAPH_NONE, FRAMEGRAPH_NONE, FRAMEGRAPH_NONE, previousMinMaxDepth };
+        GBufferResources back = front;
+        if (!first) {
+            front = createDualPeelingGBuffer(previousMinMaxDepth);
+            back = createDualPeelingGBuffer(previousMinMaxDepth);
+        }
+        unsigned int query = first ? 0 : s_depthPeelingQueries[s_depthPeelingQuerySet][pass - 1];
+
+        // Geometry pass
+        s_frameGraph.addPass("Dual depth peeling geometry", [frame, previousMinMaxDepth, first, query]() {
+            // Disable backface culling
+            applyTransparencyBounds();
+            StateCache::setCapability(GL_CULL_FACE, false);
+
+            // Clear min-max depth buffer and G-buffers, with values which leave each attachment untouched under GL_MAX blending
+            const float emptyDepth[4] = { -1.0f, -1.0f, 0.0f, 0.0f };
+            const float emptyNormal[4] = { -65504.0f, -65504.0f, -65504.0f, -65504.0f };
+            const float emptyColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            glClearBufferfv(GL_COLOR, 0, emptyDepth);
+            if (!first) {
+                glClearBufferfv(GL_COLOR, 1, emptyNormal);
+                glClearBufferfv(GL_COLOR, 2, emptyColor);
+                glClearBufferfv(GL_COLOR, 3, emptyColor);
+                glClearBufferfv(GL_COLOR, 4, emptyNormal);
+                glClearBufferfv(GL_COLOR, 5, emptyColor);
+                glClearBufferfv(GL_COLOR, 6, emptyColor);
+            }
+
+            // Use GL_MAX blending on all attachments for geometry pass
+            // The pass has no depth attachment, hence depth testing is implicitly disabled.
+            StateCache::setCapability(GL_BLEND, true);
+            StateCache::blendEquation(GL_MAX);
+
+            // Use shader on G-buffers
+            (first ? s_dualDepthPeelingInitShader : s_dualDepthPeelingShader)->use();
+
+            // Setup depth peeling textures for geometry pass
+            StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(previousMinMaxDepth));
+            StateCache::bindTexture(1, GL_TEXTURE_2D, s_frameGraph.getTexture(frame.depth));
+
+            // Run geometry pass, counting the samples of peeling passes
+            if (!first) glBeginQuery(GL_SAMPLES_PASSED, query);
+            deferredRenderGeometry(s_transparentDrawList);
+            if (!first) glEndQuery(GL_SAMPLES_PASSED);
+        });
+        s_frameGraph.setColorAttachments({ minMaxDepth, front.normal, front.diffuse, front.roughnessMetalnessAO,
+                                           back.normal, back.diffuse, back.roughnessMetalnessAO });
+        s_frameGraph.read(previousMinMaxDepth);
+        s_frameGraph.read(frame.depth);
+        readDrawCommands(frame);
+        previousMinMaxDepth = minMaxDepth;
+
+        // The initialization pass peels no layer
+        if (first) continue;
+
+        // Run lighting pass for front layer, blending front-to-back on the opaque buffer, only if the peel was not empty
+        s_frameGraph.addPass("Dual depth peeling front lighting", [frame, front, query]() {
+            applyTransparencyBounds();
+            StateCache::setCapability(GL_BLEND, true);
+            StateCache::blendEquation(GL_FUNC_ADD);
+            StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+            glBeginConditionalRender(query, GL_QUERY_WAIT);
+            deferredRenderLighting(GBufferSource::dualFront, front, frame.pointLightsSSBO);
+            glEndConditionalRender();
+        });
+        s_frameGraph.setColorAttachments({ frame.output });
+        s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+        readGBuffer(front);
+        readLights(frame);
+
+        // Run lighting pass for back layer, blending back-to-front on the back buffer, only if the peel was not empty
+        // The lighting shader premultiplies alpha, so the following settings produce:
+        //      Cdst = Asrc Csrc + (1-Asrc) Cdst
+        //      Adst = (1-Asrc) Adst
+        s_frameGraph.addPass("Dual depth peeling back lighting", [frame, back, query]() {
+            applyTransparencyBounds();
+            StateCache::setCapability(GL_BLEND, true);
+            StateCache::blendEquation(GL_FUNC_ADD);
+            StateCache::blendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+            glBeginConditionalRender(query, GL_QUERY_WAIT);
+            deferredRenderLighting(GBufferSource::dualBack, back, frame.pointLightsSSBO);
+            glEndConditionalRender();
+        });
+        s_frameGraph.setColorAttachments({ backBuffer });
+        s_frameGraph.read(backBuffer, FrameGraphAccess::renderTarget);
+        readGBuffer(back);
+        readLights(frame);
     }
-    
-    // Setup G-buffer textures uniforms
-    s_deferredShader->setInteger("gPosition", 0);
-    s_deferredShader->setInteger("gNormal", 1);
-    s_deferredShader->setInteger("gDiffuse", 2);
-    s_deferredShader->setInteger("gRoughnessMetalnessAO", 3);
 
-    // Setup lights
-    s_deferredShader->setVector3("ambientLight", ambientLight);
-    s_deferredShader->setInteger("pointLightsNumber", pointLightsSize);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointLightsSSBO);
+    // Blend back layers under front layers
+    // The blend shader outputs the back buffer's color and its opacity (1 - transmittance),
+    // so that the front-to-back settings produce:
+    //      Cdst = Adst Cback + Cdst
+    //      Adst = Tback Adst
+    s_frameGraph.addPass("Dual depth peeling blend", [backBuffer]() {
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_BLEND, true);
+        StateCache::blendEquation(GL_FUNC_ADD);
+        StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        s_dualDepthPeelingBlendShader->use();
+        StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(backBuffer));
+        StateCache::bindVertexArray(s_quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        StateCache::bindVertexArray(0);
+    });
+    s_frameGraph.setColorAttachments({ frame.output });
+    s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+    s_frameGraph.read(backBuffer);
+}
+
+void Renderer::addLinkedListPasses(const FrameResources &frame) {
+    // How per-pixel linked lists (A-buffer) work:
+    //      1) A single geometry pass appends every transparent fragment, packed as it would be on the G-buffer,
+    //         to a list per pixel; nodes are allocated from a pool through an atomic counter;
+    //      2) A full-screen resolve pass sorts each pixel's list by depth, lights its fragments with the same
+    //         GGX model of the deferred lighting pass and blends them front-to-back.
+    // Geometry is submitted once, regardless of depth complexity.
+    //
+    // SOURCE: Yang et al. - Real-Time Concurrent Linked List Construction on the GPU (EGSR 2010)
+    FrameGraphResource headPointers = s_frameGraph.createTexture("Linked list heads", GL_R32UI, s_framebufferWidth, s_framebufferHeight);
+    FrameGraphResource nodes = s_frameGraph.importBuffer("Linked list nodes", s_linkedListNodesSSBO);
+
+    // Geometry pass
+    // Fragments are tested against the opaque depth buffer without writing it; nothing is written on color buffers.
+    s_frameGraph.addPass("Linked list geometry", [headPointers]() {
+        unsigned int currSet = s_linkedListCounterSet;
+        unsigned int prevSet = 1 - currSet;
+
+        // Read the node counter of the previous frame, only if the GPU is done with it
+        if (s_linkedListFences[prevSet] != nullptr) {
+            GLenum status = glClientWaitSync(s_linkedListFences[prevSet], 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                unsigned int allocated = 0;
+                StateCache::bindBuffer(GL_ATOMIC_COUNTER_BUFFER, s_linkedListCounters[prevSet]);
+                glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(unsigned int), &allocated);
+                unsigned int poolSize = getLinkedListNodePoolSize();
+                s_linkedListStoredFragments = glm::min(allocated, poolSize);
+                s_linkedListOverflowFragments = allocated - s_linkedListStoredFragments;
+                glDeleteSync(s_linkedListFences[prevSet]);
+                s_linkedListFences[prevSet] = nullptr;
+            }
+        }
+
+        // Reset node counter and list heads
+        unsigned int zero = 0;
+        unsigned int endOfList = 0xFFFFFFFF;
+        unsigned int headPointersTexture = s_frameGraph.getTexture(headPointers);
+        StateCache::bindBuffer(GL_ATOMIC_COUNTER_BUFFER, s_linkedListCounters[currSet]);
+        glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(unsigned int), &zero);
+        StateCache::bindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+        glClearTexImage(headPointersTexture, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &endOfList);
+
+        // Bind lists' resources
+        StateCache::bindImageTexture(0, headPointersTexture, 0, GL_FALSE, GL_READ_WRITE, GL_R32UI);
+        StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s_linkedListNodesSSBO);
+        StateCache::bindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, s_linkedListCounters[currSet]);
+
+        // Setup geometry pass
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_CULL_FACE, false);
+        StateCache::setCapability(GL_BLEND, false);
+        StateCache::depthMask(false);
+        StateCache::depthFunc(GL_LESS);
+        s_linkedListShader->use();
+        s_nodePoolSizeUniform.set((int)getLinkedListNodePoolSize());
+
+        // Run geometry pass
+        deferredRenderGeometry(s_transparentDrawList);
+
+        // Restore depth state
+        StateCache::depthFunc(GL_LEQUAL);
+        StateCache::depthMask(true);
+
+        // Fence the node counter, to be read back in the next frame
+        if (s_linkedListFences[currSet] != nullptr) glDeleteSync(s_linkedListFences[currSet]);
+        s_linkedListFences[currSet] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        s_linkedListCounterSet = prevSet;
+    });
+    s_frameGraph.setDepthAttachment(frame.depth, false);
+    s_frameGraph.write(headPointers, FrameGraphAccess::image);
+    readDrawCommands(frame);
+    s_frameGraph.write(nodes, FrameGraphAccess::storage);
+
+    // Resolve pass
+    // Lists are made visible to it by the frame graph, as it reads them as image and storage.
+    s_frameGraph.addPass("Linked list resolve", [frame, headPointers]() {
+        // Enable front-to-back blending for resolve pass
+        // The resolve shader outputs premultiplied color and opacity of all the layers of a pixel, producing:
+        //      Cdst = Adst Csrc + Cdst
+        //      Adst = (1-Asrc) Adst
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_BLEND, true);
+        StateCache::blendEquation(GL_FUNC_ADD);
+        StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+        // Setup lists and lights
+        s_linkedListResolveShader->use();
+        StateCache::bindImageTexture(0, s_frameGraph.getTexture(headPointers), 0, GL_FALSE, GL_READ_WRITE, GL_R32UI);
+        StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s_linkedListNodesSSBO);
+        setupLights(frame.pointLightsSSBO);
+
+        // Run resolve pass
+        StateCache::bindVertexArray(s_quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        StateCache::bindVertexArray(0);
+    });
+    s_frameGraph.setColorAttachments({ frame.output });
+    s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+    s_frameGraph.read(headPointers, FrameGraphAccess::image);
+    s_frameGraph.read(nodes, FrameGraphAccess::storage);
+    readLights(frame);
+}
+
+void Renderer::addWeightedBlendedPasses(const FrameResources &frame, FrameGraphResource peeledDepth) {
+    // How weighted blended OIT works:
+    //      1) A single geometry pass lights every transparent fragment and accumulates its premultiplied color,
+    //         weighted by depth and alpha, along with the product of (1 - alpha) of all fragments (revealage);
+    //      2) A full-screen composite pass resolves the weighted average color and blends it over the opaque buffer.
+    // The result is approximate, but its cost does not depend on depth complexity.
+    // If the depth of already peeled layers is given, only fragments behind them are accumulated.
+    //
+    // SOURCE: McGuire, Bavoil - Weighted Blended Order-Independent Transparency (JCGT, 2013)
+    FrameGraphResource accumulation = s_frameGraph.createTexture("WBOIT accumulation", GL_RGBA16F, s_framebufferWidth, s_framebufferHeight);
+    FrameGraphResource revealage = s_frameGraph.createTexture("WBOIT revealage", GL_R16F, s_framebufferWidth, s_framebufferHeight);
+
+    // Accumulation pass
+    s_frameGraph.addPass("Weighted blended accumulation", [frame, peeledDepth]() {
+        // Clear accumulation and revealage targets
+        const float clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const float clearRevealage[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        applyTransparencyBounds();
+        glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+        glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+        // Setup blending for geometry pass
+        //      accumulation = Csrc + accumulation
+        //      revealage    = (1-Csrc) revealage
+        StateCache::setCapability(GL_CULL_FACE, false);
+        StateCache::setCapability(GL_BLEND, true);
+        StateCache::blendEquation(GL_FUNC_ADD);
+        StateCache::blendFunci(0, GL_ONE, GL_ONE);
+        StateCache::blendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+
+        // Fragments are tested against the opaque depth buffer without writing it
+        StateCache::depthMask(false);
+        StateCache::depthFunc(GL_LESS);
+
+        // Setup shader, lights and common uniforms
+        s_weightedBlendedShader->use();
+        setupLights(frame.pointLightsSSBO);
+
+        // Setup peeled layers' depth
+        s_skipPeeledLayersUniform.set(peeledDepth != FRAMEGRAPH_NONE);
+        StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(peeledDepth));
+
+        // Run geometry pass
+        deferredRenderGeometry(s_transparentDrawList);
+
+        // Restore depth state
+        StateCache::depthFunc(GL_LEQUAL);
+        StateCache::depthMask(true);
+    });
+    s_frameGraph.setColorAttachments({ accumulation, revealage });
+    s_frameGraph.setDepthAttachment(frame.depth, false);
+    s_frameGraph.read(peeledDepth);
+    readDrawCommands(frame);
+    readLights(frame);
+
+    // Composite pass
+    s_frameGraph.addPass("Weighted blended composite", [accumulation, revealage]() {
+        // Enable front-to-back blending for composite pass
+        // The composite shader outputs premultiplied color and opacity, producing:
+        //      Cdst = Adst Csrc + Cdst
+        //      Adst = (1-Asrc) Adst
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_BLEND, true);
+        StateCache::blendEquation(GL_FUNC_ADD);
+        StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+        // Run composite pass
+        s_weightedBlendedCompositeShader->use();
+        StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(accumulation));
+        StateCache::bindTexture(1, GL_TEXTURE_2D, s_frameGraph.getTexture(revealage));
+        StateCache::bindVertexArray(s_quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        StateCache::bindVertexArray(0);
+    });
+    s_frameGraph.setColorAttachments({ frame.output });
+    s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+    s_frameGraph.read(accumulation);
+    s_frameGraph.read(revealage);
+}
+
+void Renderer::addKBufferPasses(const FrameResources &frame) {
+    // How the k-buffer works:
+    //      1) A single geometry pass inserts every transparent fragment, packed as it would be on the G-buffer,
+    //         into a fixed number of per-pixel layers kept sorted by depth; a per-pixel spin lock guards insertion,
+    //         and fragments beyond the nearest RENDERER_KBUFFER_LAYERS are dropped;
+    //      2) A full-screen resolve pass lights the layers with the same GGX model of the deferred lighting pass
+    //         and blends them front-to-back.
+    // It matches the quality of as many depth peeling passes, with a single geometry submission and bounded memory.
+    //
+    // SOURCE: Bavoil et al. - Multi-Fragment Effects on the GPU using the k-Buffer (I3D 2007)
+    FrameGraphResource layers = s_frameGraph.createTexture("K-buffer layers", GL_RGBA32UI, s_framebufferWidth, s_framebufferHeight, RENDERER_KBUFFER_LAYERS);
+    FrameGraphResource locks = s_frameGraph.createTexture("K-buffer locks", GL_R32UI, s_framebufferWidth, s_framebufferHeight);
+
+    // Geometry pass
+    // Fragments are tested against the opaque depth buffer without writing it; nothing is written on color buffers.
+    s_frameGraph.addPass("K-buffer geometry", [layers, locks]() {
+        // Reset layers and locks
+        const unsigned int emptyLayer[4] = { 0x3F800000, 0, 0, 0 }; // Depth of 1.0f, as unsigned integer
+        unsigned int unlocked = 0;
+        unsigned int layersTexture = s_frameGraph.getTexture(layers);
+        unsigned int locksTexture = s_frameGraph.getTexture(locks);
+        glClearTexImage(layersTexture, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, emptyLayer);
+        glClearTexImage(locksTexture, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &unlocked);
+
+        // Bind k-buffer's images
+        StateCache::bindImageTexture(0, layersTexture, 0, GL_TRUE, GL_READ_WRITE, GL_RGBA32UI);
+        StateCache::bindImageTexture(1, locksTexture, 0, GL_FALSE, GL_READ_WRITE, GL_R32UI);
+
+        // Setup geometry pass
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_CULL_FACE, false);
+        StateCache::setCapability(GL_BLEND, false);
+        StateCache::depthMask(false);
+        StateCache::depthFunc(GL_LESS);
+        s_kBufferShader->use();
+
+        // Run geometry pass
+        deferredRenderGeometry(s_transparentDrawList);
+
+        // Restore depth state
+        StateCache::depthFunc(GL_LEQUAL);
+        StateCache::depthMask(true);
+    });
+    s_frameGraph.setDepthAttachment(frame.depth, false);
+    s_frameGraph.write(layers, FrameGraphAccess::image);
+    s_frameGraph.write(locks, FrameGraphAccess::image);
+    readDrawCommands(frame);
+
+    // Resolve pass
+    // Layers are made visible to it by the frame graph, as it reads them as image.
+    s_frameGraph.addPass("K-buffer resolve", [frame, layers]() {
+        // Enable front-to-back blending for resolve pass
+        // The resolve shader outputs premultiplied color and opacity of all the layers of a pixel, producing:
+        //      Cdst = Adst Csrc + Cdst
+        //      Adst = (1-Asrc) Adst
+        applyTransparencyBounds();
+        StateCache::setCapability(GL_BLEND, true);
+        StateCache::blendEquation(GL_FUNC_ADD);
+        StateCache::blendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+        // Setup layers and lights
+        s_kBufferResolveShader->use();
+        StateCache::bindImageTexture(0, s_frameGraph.getTexture(layers), 0, GL_TRUE, GL_READ_WRITE, GL_RGBA32UI);
+        setupLights(frame.pointLightsSSBO);
+
+        // Run resolve pass
+        StateCache::bindVertexArray(s_quadVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        StateCache::bindVertexArray(0);
+    });
+    s_frameGraph.setColorAttachments({ frame.output });
+    s_frameGraph.read(frame.output, FrameGraphAccess::renderTarget);
+    s_frameGraph.read(layers, FrameGraphAccess::image);
+    readLights(frame);
+}
 
-    // Setup subroutines
-    s_deferredShader->setSubroutineUniform(GL_FRAGMENT_SHADER, "LocalModel", "GGX");
-    glBindVertexArray(s_quadVAO);
-    s_deferredShader->loadSubroutines(GL_FRAGMENT_SHADER);
+void Renderer::addHybridPasses(const FrameResources &frame) {
+    // How the hybrid technique works:
+    //      1) Depth peeling runs for the first layers only, which carry most of the visual weight
+    //         under front-to-back blending;
+    //      2) All the layers behind the last peel are accumulated by weighted blended OIT, whose composite pass
+    //         blends them under the peeled ones through the transmittance accumulated on the opaque buffer (Adst).
+    // Deep layers are approximated instead of being dropped, while peels are kept to a few.
+    FrameGraphResource lastPeelDepth = addDepthPeelingPasses(frame);
+
+    // Accumulate the tail behind the depth of the last peel
+    // The last peel's G-buffer is dead by then, so accumulation aliases its position target with the full profile.
+    addWeightedBlendedPasses(frame, lastPeelDepth);
+}
+
+void Renderer::buildLightClusters(unsigned int pointLightsSSBO, unsigned int pointLightsSize) {
+    // How clustered lighting works:
+    //      1) The view frustum is split into a grid of clusters: screen tiles along x and y,
+    //         exponentially spaced slices along depth;
+    //      2) This compute pass tests every point light's sphere, bounded by its radius, against each cluster's
+    //         view-space bounding box, storing the indices of the overlapping lights on the cluster's list;
+    //      3) Lighting passes find the cluster of each fragment and loop over its list only.
+    // Clusters are 3D, so every transparent layer picks the lights around its own depth.
+    //
+    // SOURCE: Olsson, Billeter, Assarsson - Clustered Deferred and Forward Shading (HPG 2012)
+    s_lightClusteringShader->use();
+    s_clusteringLightsNumberUniform.set((int)pointLightsSize);
+    s_clusteringTileSizeUniform.set(getClusterTileSize());
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointLightsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, s_clusterLightCountsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, s_clusterLightIndicesSSBO);
+
+    // Dispatch one invocation per cluster
+    // Lists are made visible to the lighting passes by the frame graph, as they read them as storage.
+    unsigned int clustersNumber = RENDERER_CLUSTERS_X * RENDERER_CLUSTERS_Y * RENDERER_CLUSTERS_Z;
+    glDispatchCompute((clustersNumber + RENDERER_LIGHTCLUSTERING_GROUPSIZE - 1) / RENDERER_LIGHTCLUSTERING_GROUPSIZE, 1, 1);
+}
+
+void Renderer::setupLights(unsigned int pointLightsSSBO) {
+    // Setup lights' buffers
+    // Lighting globals are in the lighting UBO, uploaded once per frame by renderEntities.
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointLightsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, s_clusterLightCountsSSBO);
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, s_clusterLightIndicesSSBO);
+}
+
+glm::vec2 Renderer::getClusterTileSize() {
+    // Tiles are rounded up, so that the grid covers the whole framebuffer
+    return glm::vec2{ glm::ceil((float)s_framebufferWidth / RENDERER_CLUSTERS_X), glm::ceil((float)s_framebufferHeight / RENDERER_CLUSTERS_Y) };
+}
+
+void Renderer::buildRenderQueue(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities) {
+    // How the render queue works:
+    //      1) Every drawn entity becomes a draw item with a 64-bit sort key, from the most significant bits:
+    //             pass (2) | shader (6) | model (16) | peels not reached (4) | material (16) | depth (20);
+    //      2) Items are radix-sorted by key;
+    //      3) Runs of items sharing pass and model become draw groups, i.e. instanced draws; within a group,
+    //         instances are ordered by the peels they reach (deepest first), then by material, then front-to-back;
+    //      4) One indirect command is emitted per mesh of each group; then, for every depth peel past the first one,
+    //         per mesh of the leading instances of each group which reach that peel;
+    //      5) With GPU culling, every list is handed to the GPU culler, which compacts its commands per frame.
+    // With materials in an SSBO and every mesh behind the arena VAO, neither costs a state change between draws:
+    // the model takes the place of the VAO, and comes before the material so that its instances stay together.
+    // The queue is cached across frames; every pass and every peel reuses it.
+    s_drawItems.clear();
+    s_queueModels.clear();
+    glm::vec3 cameraPosition = s_camera.getPosition();
+    float maxDepth = (float)((1 << 20) - 1);
+    float depthScale = maxDepth / s_camera.getFarPlane();
+    for (uint64_t pass = 0; pass < 2; pass++) {
+        std::vector<Entity*> *entities = pass == 0 ? opaqueEntities : transparentEntities;
+        uint64_t shader = pass == 0 ? 0 : (uint64_t)s_transparencyMode + 1;
+        for (auto iter = entities->begin(); iter != entities->end(); iter++) {
+            // Entities with no opacity are left out of transparent passes
+            Material *material = (*iter)->getMaterial();
+            if (pass == 1 && material->diffuse.a < 0.0001f) continue;
+
+            // Models are few, so their queue IDs are searched linearly
+            unsigned int model = 0;
+            while (model < s_queueModels.size() && s_queueModels[model] != (*iter)->getModel()) model++;
+            if (model == s_queueModels.size()) s_queueModels.push_back((*iter)->getModel());
+
+            // Peels reached by transparent entities, see readPeelSamples; every one of them, when unknown
+            // The GPU culler drops instances from the peels they do not reach by itself (see uploadInstanceReaches),
+            // so that its peel lists hold every transparent instance.
+            uint64_t reach = RENDERER_DEPTHPEELING_MAXPASSES - 1;
+            if (pass == 1 && s_depthPeelingEntityCulling && !s_gpuCulling) {
+                auto found = s_peelReaches.find(*iter);
+                if (found != s_peelReaches.end()) reach = found->second;
+            }
+
+            // Compose key
+            float depth = glm::clamp(glm::distance(cameraPosition, (*iter)->getPosition()) * depthScale, 0.0f, maxDepth);
+            uint64_t key = pass << 62 | (shader & 0x3F) << 56 | ((uint64_t)model & 0xFFFF) << 40 | ((RENDERER_DEPTHPEELING_MAXPASSES - 1 - reach) & 0xF) << 36 | ((uint64_t)material->id & 0xFFFF) << 20 | (uint64_t)depth;
+            s_drawItems.push_back(DrawItem{ key, *iter });
+        }
+    }
+    radixSortDrawItems();
+
+    // Build draw groups and instance order
+    s_instanceEntities.clear();
+    s_instanceMaterials.clear();
+    s_opaqueDrawList.groups.clear();
+    s_transparentDrawList.groups.clear();
+    for (auto iter = s_drawItems.begin(); iter != s_drawItems.end(); iter++) {
+        DrawList &drawList = (iter->key >> 62) == 0 ? s_opaqueDrawList : s_transparentDrawList;
+        Model *model = iter->entity->getModel();
+        if (drawList.groups.empty() || drawList.groups.back().model != model)
+            drawList.groups.push_back(DrawGroup{ model, (unsigned int)s_instanceEntities.size(), 0 });
+        drawList.groups.back().instanceCount++;
+        s_instanceEntities.push_back(iter->entity);
+        s_instanceMaterials.push_back((int)iter->entity->getMaterial()->id);
+    }
+
+    // Upload material IDs; they change only with the queue, unlike transforms
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_instanceMaterialsSSBO);
+    if (s_instanceMaterials.size() > s_instanceMaterialsSSBOCapacity) {
+        s_instanceMaterialsSSBOCapacity = (unsigned int)s_instanceMaterials.capacity();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(int) * s_instanceMaterialsSSBOCapacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (!s_instanceMaterials.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(int) * s_instanceMaterials.size(), s_instanceMaterials.data());
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Emit draw commands
+    // Mesh lists are built in scratch vectors, which stop allocating once they are large enough.
+    s_drawCommands.clear();
+    DrawList *drawLists[2] = { &s_opaqueDrawList, &s_transparentDrawList };
+    for (int l = 0; l < 2; l++) {
+        DrawList *drawList = drawLists[l];
+        drawList->firstCommand = (unsigned int)s_drawCommands.size();
+        for (auto iter = drawList->groups.begin(); iter != drawList->groups.end(); iter++) {
+            int meshNum = iter->model->getMeshesNumber();
+            s_meshFirstIndices.resize(meshNum);
+            s_meshBaseVertices.resize(meshNum);
+            s_meshIndicesNumbers.resize(meshNum);
+            iter->model->buildMeshLists(s_meshFirstIndices.data(), s_meshBaseVertices.data(), s_meshIndicesNumbers.data());
+            for (int i = 0; i < meshNum; i++)
+                s_drawCommands.push_back(DrawElementsIndirectCommand{ (unsigned int)s_meshIndicesNumbers[i], iter->instanceCount, s_meshFirstIndices[i], s_meshBaseVertices[i], iter->firstInstance });
+        }
+        drawList->commandCount = (unsigned int)s_drawCommands.size() - drawList->firstCommand;
+    }
+    for (int peel = 1; peel < RENDERER_DEPTHPEELING_MAXPASSES; peel++) {
+        DrawList &drawList = s_peelDrawLists[peel];
+        drawList.groups.clear();
+        drawList.firstCommand = (unsigned int)s_drawCommands.size();
+        drawList.commandCount = 0;
+        if (!s_depthPeelingEntityCulling) continue;
+        for (auto iter = s_transparentDrawList.groups.begin(); iter != s_transparentDrawList.groups.end(); iter++) {
+            // Instances reaching the peel lead their group
+            unsigned int instanceCount = 0;
+            while (instanceCount < iter->instanceCount && RENDERER_DEPTHPEELING_MAXPASSES - 1 - ((s_drawItems[iter->firstInstance + instanceCount].key >> 36) & 0xF) >= (uint64_t)peel)
+                instanceCount++;
+            if (instanceCount == 0) continue;
+            drawList.groups.push_back(DrawGroup{ iter->model, iter->firstInstance, instanceCount });
+            int meshNum = iter->model->getMeshesNumber();
+            s_meshFirstIndices.resize(meshNum);
+            s_meshBaseVertices.resize(meshNum);
+            s_meshIndicesNumbers.resize(meshNum);
+            iter->model->buildMeshLists(s_meshFirstIndices.data(), s_meshBaseVertices.data(), s_meshIndicesNumbers.data());
+            for (int i = 0; i < meshNum; i++)
+                s_drawCommands.push_back(DrawElementsIndirectCommand{ (unsigned int)s_meshIndicesNumbers[i], instanceCount, s_meshFirstIndices[i], s_meshBaseVertices[i], iter->firstInstance });
+        }
+        drawList.commandCount = (unsigned int)s_drawCommands.size() - drawList.firstCommand;
+    }
+    std::vector<DrawList*> gpuLists = { &s_opaqueDrawList, &s_transparentDrawList };
+    for (int peel = 1; peel < RENDERER_DEPTHPEELING_MAXPASSES; peel++)
+        gpuLists.push_back(&s_peelDrawLists[peel]);
+    for (unsigned int l = 0; l < (unsigned int)gpuLists.size(); l++) {
+        gpuLists[l]->gpuList = l;
+        gpuLists[l]->backFaceCulling = l == 0;
+        gpuLists[l]->peel = l < 2 ? 0 : l - 1;
+    }
+    if (s_gpuCulling) GpuCuller::setupLists(gpuLists);
+
+    // Upload draw commands; allocate more memory only if needed
+    StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, s_drawCommandsBuffer);
+    if (s_drawCommands.size() > s_drawCommandsBufferCapacity) {
+        s_drawCommandsBufferCapacity = (unsigned int)s_drawCommands.capacity();
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * s_drawCommandsBufferCapacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (!s_drawCommands.empty())
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * s_drawCommands.size(), s_drawCommands.data());
+    StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // Remember what the queue was built from
+    s_renderQueueValid = true;
+    s_renderQueueEntitiesVersion = EntityManager::getVersion();
+    s_renderQueueModelsVersion = ResourceManager::getModelsVersion();
+    s_renderQueueVisibilityVersion = OcclusionCuller::getVersion();
+    s_renderQueuePeelReachesVersion = s_peelReachesVersion;
+    s_renderQueueGpuCulling = s_gpuCulling;
+    s_renderQueueCameraPosition = cameraPosition;
+    s_renderQueueRebuilds++;
+}
+
+void Renderer::radixSortDrawItems() {
+    // LSD radix sort on 8-bit digits
+    // Digits shared by every key (e.g. the unused shader bits) leave the order untouched, so their pass is skipped.
+    s_drawItemsScratch.resize(s_drawItems.size());
+    if (s_drawItems.empty()) return;
+    for (int shift = 0; shift < 64; shift += 8) {
+        unsigned int offsets[256] = { 0 };
+        for (auto iter = s_drawItems.begin(); iter != s_drawItems.end(); iter++)
+            offsets[(iter->key >> shift) & 0xFF]++;
+        if (offsets[(s_drawItems[0].key >> shift) & 0xFF] == s_drawItems.size()) continue;
+
+        unsigned int sum = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            unsigned int count = offsets[digit];
+            offsets[digit] = sum;
+            sum += count;
+        }
+        for (auto iter = s_drawItems.begin(); iter != s_drawItems.end(); iter++)
+            s_drawItemsScratch[offsets[(iter->key >> shift) & 0xFF]++] = *iter;
+        s_drawItems.swap(s_drawItemsScratch);
+    }
+}
+
+void Renderer::uploadFrameUniforms(glm::mat4 &viewMatrix, glm::vec3 ambientLight, unsigned int pointLightsSize) {
+    // Upload camera data
+    glm::mat4 projectionMatrix = s_camera.getPerspectiveMatrix();
+    CameraUniforms camera{};
+    camera.viewMatrix = viewMatrix;
+    camera.projectionMatrix = projectionMatrix;
+    camera.inverseProjectionMatrix = glm::inverse(projectionMatrix);
+    camera.bufferSize = glm::vec2{ (float)s_framebufferWidth, (float)s_framebufferHeight };
+    camera.nearPlane = s_camera.getNearPlane();
+    camera.farPlane = s_camera.getFarPlane();
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_cameraUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &camera);
+
+    // Upload lighting globals
+    // Depth slices are mapped from view-space depth as: slice = log(-z) scale + bias
+    float logDepthRange = glm::log(camera.farPlane / camera.nearPlane);
+    LightingUniforms lighting{};
+    lighting.ambientLight = ambientLight;
+    lighting.pointLightsNumber = (int)pointLightsSize;
+    lighting.clusterTileSize = getClusterTileSize();
+    lighting.clusterDepthParams = glm::vec2{ RENDERER_CLUSTERS_Z / logDepthRange, -RENDERER_CLUSTERS_Z * glm::log(camera.nearPlane) / logDepthRange };
+    lighting.clusteredLighting = s_clusteredLighting;
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_lightingUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingUniforms), &lighting);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Bind every uniform buffer once; shaders find them at the binding points of their blocks
+    StateCache::bindBufferBase(GL_UNIFORM_BUFFER, 0, s_cameraUBO);
+    StateCache::bindBufferBase(GL_UNIFORM_BUFFER, 1, s_passUBO);
+    StateCache::bindBufferBase(GL_UNIFORM_BUFFER, 2, s_lightingUBO);
+}
+
+void Renderer::uploadPassUniforms() {
+    // Upload pass constants, unless they match the ones already in the buffer
+    // Geometry and lighting passes alternate within the peel loop, and often leave them unchanged.
+    if (s_passUniformsUploaded && memcmp(&s_passUniforms, &s_uploadedPassUniforms, sizeof(PassUniforms)) == 0) return;
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, s_passUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PassUniforms), &s_passUniforms);
+    StateCache::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    s_uploadedPassUniforms = s_passUniforms;
+    s_passUniformsUploaded = true;
+}
+
+void Renderer::deferredRenderGeometry(DrawList &drawList) {
+    // Upload pass constants; whether this is a depth peeling pass is told by the shader variant in use
+    uploadPassUniforms();
+    if (drawList.commandCount == 0) return;
+
+    // Transforms and material IDs are read from per-instance SSBOs, at gl_BaseInstance + gl_InstanceID
+    // The GPU culling pass binds its own buffers on points 0-7, so every SSBO read here has to be bound anew, each
+    // pass: a binding left over from an earlier pass may belong to the culling pass (see gpuCullingShader.comp).
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, MaterialManager::getMaterialsSSBO());
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, TransformStage::getTransformsSSBO());
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, s_instanceMaterialsSSBO);
+
+    // Every mesh lives in the geometry arena, behind a single VAO
+    StateCache::bindVertexArray(GeometryArena::getVAO());
+
+    // Render
+    // How submission works:
+    //      - GPU culling: a single call runs the commands compacted for the list, as many as the GPU counted;
+    //      - Multi-draw indirect: a single call runs every command of the list;
+    //      - Instancing: one call per command, i.e. per mesh of each group;
+    //      - Neither: one call per command and per instance.
+    if (s_gpuCulling) {
+        GpuCuller::draw(drawList.gpuList);
+        s_drawCalls++;
+    } else if (s_multiDrawIndirect) {
+        StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, s_drawCommandsBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(sizeof(DrawElementsIndirectCommand) * drawList.firstCommand), drawList.commandCount, 0);
+        StateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        s_drawCalls++;
+    } else for (unsigned int c = drawList.firstCommand; c < drawList.firstCommand + drawList.commandCount; c++) {
+        DrawElementsIndirectCommand &command = s_drawCommands[c];
+        void *indices = (void*)(sizeof(GLuint) * command.firstIndex);
+        if (s_instancing) {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indices, command.instanceCount, command.baseVertex, command.baseInstance);
+            s_drawCalls++;
+        } else for (unsigned int instance = 0; instance < command.instanceCount; instance++) {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indices, 1, command.baseVertex, command.baseInstance + instance);
+            s_drawCalls++;
+        }
+    }
+    StateCache::bindVertexArray(0);
+}
+
+void Renderer::deferredRenderLighting(GBufferSource source, const GBufferResources &gBuffer, unsigned int pointLightsSSBO) {
+    // Use shader; the target framebuffer is bound by the frame graph
+    // Back layers of dual depth peeling are accumulated apart, all the others go on the opaque buffer.
+    // Dual depth peeling has its own G-buffer layout, with neither position nor material IDs, hence its own permutation.
+    bool dual = source == GBufferSource::dualFront || source == GBufferSource::dualBack;
+    (dual ? s_dualDeferredShader : s_deferredShader)->use();
+
+    // Bind G-buffer textures; targets the layout does not store bind no texture
+    StateCache::bindTexture(0, GL_TEXTURE_2D, s_frameGraph.getTexture(gBuffer.position));
+    StateCache::bindTexture(1, GL_TEXTURE_2D, s_frameGraph.getTexture(gBuffer.normal));
+    StateCache::bindTexture(2, GL_TEXTURE_2D, s_frameGraph.getTexture(gBuffer.diffuse));
+    StateCache::bindTexture(3, GL_TEXTURE_2D, s_frameGraph.getTexture(gBuffer.roughnessMetalnessAO));
+    StateCache::bindTexture(4, GL_TEXTURE_2D, s_frameGraph.getTexture(gBuffer.depth));
+
+    // The depth mask selects which channel of the depth texture holds the fragment's depth (and its sign)
+    glm::vec2 depthMask{ 1.0f, 0.0f };
+    if (source == GBufferSource::dualFront) depthMask = glm::vec2{ -1.0f, 0.0f };
+    else if (source == GBufferSource::dualBack) depthMask = glm::vec2{ 0.0f, 1.0f };
+    s_passUniforms.gDepthMask = depthMask;
+    uploadPassUniforms();
+
+    // Setup material fetching
+    StateCache::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, MaterialManager::getMaterialsSSBO());
+
+    // Setup lights
+    setupLights(pointLightsSSBO);
 
     // Draw on quad
-    glBindVertexArray(s_quadVAO);
+    StateCache::bindVertexArray(s_quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    StateCache::bindVertexArray(0);
 }
 
 void Renderer::keyboardHandler(int key, KeyboardType type, float deltaTime) {
@@ -1,13 +1,18 @@
 #ifndef RENDERER_HPP
 #define RENDERER_HPP
 
+#include <cstdint>
 #include <list>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 
 #include "consts.hpp"
 #include "input/input_manager.hpp"
+#include "rendering/frame_graph.hpp"
 #include "rendering/lights.hpp"
 #include "rendering/material_manager.hpp"
 #include "rendering/camera.hpp"
@@ -16,6 +21,93 @@
 #include "scene/entity.hpp"
 
 
+// --- Transparency techniques
+enum class TransparencyMode { depthPeeling, dualDepthPeeling, linkedList, weightedBlended, kBuffer, hybrid };
+
+// --- Layouts of opaque and transparent G-buffers
+enum class GBufferProfile { full, compact };
+
+// --- G-buffers which can be read by the lighting pass
+enum class GBufferSource { opaque, transparent, dualFront, dualBack };
+
+// --- Targets of a G-buffer on the frame graph; FRAMEGRAPH_NONE for the ones the layout does not store
+struct GBufferResources {
+    FrameGraphResource position;
+    FrameGraphResource normal;
+    FrameGraphResource diffuse;
+    FrameGraphResource roughnessMetalnessAO;
+    FrameGraphResource depth;
+};
+
+// --- Resources shared by the passes of a frame, as recorded on the frame graph
+struct FrameResources {
+    FrameGraphResource output;  // Opaque buffer, on which every technique blends
+    FrameGraphResource depth;   // Opaque depth buffer
+    FrameGraphResource clusterLightCounts;
+    FrameGraphResource clusterLightIndices;
+    FrameGraphResource drawCommands;    // Compacted by GPU culling
+    unsigned int pointLightsSSBO;
+};
+
+// --- Per-frame camera data, laid out as std140 for the camera UBO (see camera.glsl)
+struct CameraUniforms {
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::mat4 inverseProjectionMatrix;
+    glm::vec2 bufferSize;
+    float nearPlane;
+    float farPlane;
+};
+
+// --- Per-pass constants, laid out as std140 for the pass UBO (see pass.glsl)
+struct PassUniforms {
+    glm::vec2 gDepthMask;
+    int peel;
+    int padding;
+};
+
+// --- Lighting globals, laid out as std140 for the lighting UBO (see lighting.glsl)
+struct LightingUniforms {
+    glm::vec3 ambientLight;
+    int pointLightsNumber;  // std140 packs it right after the vec3
+    glm::vec2 clusterTileSize;
+    glm::vec2 clusterDepthParams;
+    int clusteredLighting;
+    int padding[3];
+};
+
+// --- Contiguous range of instances sharing a Model
+struct DrawGroup {
+    Model *model;
+    unsigned int firstInstance;
+    unsigned int instanceCount;
+};
+
+// --- Indirect draw command, laid out as glMultiDrawElementsIndirect reads it
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// --- Item of the render queue, see Renderer::buildRenderQueue for its key
+struct DrawItem {
+    uint64_t key;
+    Entity *entity;
+};
+
+// --- Draw groups of a geometry pass, and their range of indirect commands
+struct DrawList {
+    std::vector<DrawGroup> groups;
+    unsigned int firstCommand;
+    unsigned int commandCount;
+    unsigned int gpuList;   // Index among the lists culled on the GPU, see GpuCuller
+    bool backFaceCulling;   // Whether its geometry pass culls back faces, so that meshlets facing away can be culled
+    unsigned int peel;      // Depth peel its instances must reach to be drawn on the GPU, see Renderer::uploadInstanceReaches
+};
+
 // --- Render class
 class Renderer {
 	public:		
@@ -31,6 +123,41 @@ class Renderer {
 		static unsigned int getFramebufferHeight();
 		static unsigned int getDepthPeelingPasses();
 		static void setDepthPeelingPasses(int passesNumber);
+		static unsigned int getDepthPeelingActivePasses();
+		static unsigned int getDepthPeelingNonEmptyPasses();
+		static bool getDepthPeelingEarlyTermination();
+		static void setDepthPeelingEarlyTermination(bool enable);
+		static unsigned int getDepthPeelingSampleThreshold();
+		static void setDepthPeelingSampleThreshold(int threshold);
+		static bool getDepthPeelingEntityCulling();
+		static void setDepthPeelingEntityCulling(bool enable);
+		static unsigned int getDepthPeelingSkippedInstances();
+		static unsigned int getHybridPeelingPasses();
+		static void setHybridPeelingPasses(int passesNumber);
+		static unsigned int getLinkedListNodesPerPixel();
+		static void setLinkedListNodesPerPixel(int nodesPerPixel);
+		static unsigned int getLinkedListNodePoolSize();
+		static unsigned int getLinkedListStoredFragments();
+		static unsigned int getLinkedListOverflowFragments();
+		static bool getTransparencyScissor();
+		static void setTransparencyScissor(bool enable);
+		static float getTransparencyCoverage();
+		static bool getClusteredLighting();
+		static void setClusteredLighting(bool enable);
+		static GBufferProfile getGBufferProfile();
+		static void setGBufferProfile(GBufferProfile profile);
+		static bool getGBufferMaterialIDs();
+		static void setGBufferMaterialIDs(bool enable);
+		static unsigned int getGBufferBytesPerPixel();
+		static bool getInstancing();
+		static void setInstancing(bool enable);
+		static bool getMultiDrawIndirect();
+		static void setMultiDrawIndirect(bool enable);
+		static unsigned int getDrawCalls();
+		static unsigned int getRenderQueueRebuilds();
+		static const FrameGraph &getFrameGraph();
+		static TransparencyMode getTransparencyMode();
+		static void setTransparencyMode(TransparencyMode mode);
 		
 	private:
 		// --- Private constructor
@@ -38,8 +165,37 @@ class Renderer {
 		
 		// --- Private static methods
 		static void setupFramebuffers(unsigned int framebufferWidth, unsigned int framebufferHeight);
-		static void deferredRenderGeometry(bool firstPass, Entity *entity, glm::mat4 &viewMatrix);
-		static void deferredRenderLighting(bool transparentGBuffer, glm::vec3 ambientLight, unsigned int pointLightsSSBO, unsigned int pointLightsSize);
+		static void applyPendingResolution();
+		static std::vector<std::string> getClusterDefines(std::vector<std::string> defines = {});
+		static void loadGBufferShaders();
+		static unsigned int estimateDepthPeelingPasses(unsigned int maxPasses);
+		static void readPeelSamples();
+		static void uploadInstanceReaches();
+		static bool computeTransparencyBounds(std::vector<Entity*> *transparentEntities, glm::mat4 &viewMatrix);
+		static void setupLinkedListNodePool();
+		static void setupTexture(unsigned int &texture, GLenum internalFormat, unsigned int width, unsigned int height, unsigned int layers = 1);
+		static GBufferResources createGBuffer(FrameGraphResource depth);
+		static GBufferResources createDualPeelingGBuffer(FrameGraphResource depth);
+		static void writeGBuffer(const GBufferResources &gBuffer);
+		static void readGBuffer(const GBufferResources &gBuffer);
+		static void readLights(const FrameResources &frame);
+		static void readDrawCommands(const FrameResources &frame);
+		static void applyTransparencyBounds();
+		static FrameGraphResource addDepthPeelingPasses(const FrameResources &frame);
+		static void addDualDepthPeelingPasses(const FrameResources &frame);
+		static void addLinkedListPasses(const FrameResources &frame);
+		static void addWeightedBlendedPasses(const FrameResources &frame, FrameGraphResource peeledDepth = FRAMEGRAPH_NONE);
+		static void addHybridPasses(const FrameResources &frame);
+		static void addKBufferPasses(const FrameResources &frame);
+		static void buildLightClusters(unsigned int pointLightsSSBO, unsigned int pointLightsSize);
+		static void setupLights(unsigned int pointLightsSSBO);
+		static glm::vec2 getClusterTileSize();
+		static void buildRenderQueue(std::vector<Entity*> *opaqueEntities, std::vector<Entity*> *transparentEntities);
+		static void radixSortDrawItems();
+		static void uploadFrameUniforms(glm::mat4 &viewMatrix, glm::vec3 ambientLight, unsigned int pointLightsSize);
+		static void uploadPassUniforms();
+		static void deferredRenderGeometry(DrawList &drawList);
+		static void deferredRenderLighting(GBufferSource source, const GBufferResources &gBuffer, unsigned int pointLightsSSBO);
 		static void keyboardHandler(int key, KeyboardType type, float deltaTime);
 		static void mouseDeltaHandler(float xdelta, float ydelta, float deltaTime);
 		static void mouseScrollHandler(float xdelta, float ydelta, float deltaTime);
@@ -48,25 +204,111 @@ class Renderer {
 		static bool s_isInitialized;
         static Camera s_camera;
 		static Shader *s_gBufferShader;
+		static Shader *s_gBufferFirstPeelShader;
+		static Shader *s_gBufferPeelShader;
 		static Shader *s_deferredShader;
+		static Shader *s_dualDeferredShader;
 		static Shader *s_screenSpaceShader;
+		static Shader *s_dualDepthPeelingShader;
+		static Shader *s_dualDepthPeelingInitShader;
+		static Shader *s_dualDepthPeelingBlendShader;
+		static Shader *s_linkedListShader;
+		static Shader *s_linkedListResolveShader;
+		static Shader *s_weightedBlendedShader;
+		static Shader *s_weightedBlendedCompositeShader;
+		static Shader *s_kBufferShader;
+		static Shader *s_kBufferResolveShader;
+		static Shader *s_lightClusteringShader;
+		static TransparencyMode s_transparencyMode;
+		static GBufferProfile s_gBufferProfile;
+		static bool s_gBufferMaterialIDs;
+		static bool s_transparencyScissor;
+		static int s_transparencyBounds[4];
+		static float s_transparencyCoverage;
 		static unsigned int s_framebufferWidth;
 		static unsigned int s_framebufferHeight;
+		static unsigned int s_outputWidth;
+		static unsigned int s_outputHeight;
+		static bool s_resizePending;
+		static double s_resizeTime;
 		static unsigned int s_depthPeelingPasses;
-		static unsigned int s_opaqueFBO;
+		static unsigned int s_depthPeelingActivePasses;
+		static unsigned int s_depthPeelingNonEmptyPasses;
+		static bool s_depthPeelingEarlyTermination;
+		static unsigned int s_depthPeelingSampleThreshold;
+		static unsigned int s_hybridPeelingPasses;
+		static unsigned int s_depthPeelingQueries[2][RENDERER_DEPTHPEELING_MAXPASSES];
+		static unsigned int s_depthPeelingQueriesIssued[2];
+		static unsigned int s_depthPeelingQuerySet;
+		static bool s_depthPeelingEntityCulling;
+		static unsigned int s_depthPeelingSkippedInstances;
+		static unsigned int s_peelSamplesSSBOs[2];
+		static unsigned int s_peelSamplesSSBOCapacities[2];
+		static GLsync s_peelSamplesFences[2];
+		static std::vector<Entity*> s_peelSamplesEntities[2];
+		static unsigned int s_peelSamplesEntitiesVersions[2];
+		static unsigned int s_peelSamplesFirstInstances[2];
+		static unsigned int s_peelSamplesPasses[2];
+		static unsigned int s_peelSamplesSet;
+		static std::vector<unsigned int> s_peelSamples;
+		static std::unordered_map<Entity*, unsigned int> s_peelReaches;
+		static unsigned int s_peelReachesVersion;
+		static std::vector<unsigned int> s_instanceReaches;
+		static unsigned int s_instanceReachesVersion;
+		static unsigned int s_instanceReachesSkipped[RENDERER_DEPTHPEELING_MAXPASSES];
+		static DrawList s_peelDrawLists[RENDERER_DEPTHPEELING_MAXPASSES];
+		static FrameGraph s_frameGraph;
 		static unsigned int s_opaqueBuffer;
-		static unsigned int s_transparentGBufferFBO[2];
-		static unsigned int s_transparentDepthBuffer[2];
-		static unsigned int s_transparentGPosition;
-		static unsigned int s_transparentGNormal;
-		static unsigned int s_transparentGDiffuse;
-		static unsigned int s_transparentGRoughnessMetalnessAO;
-		static unsigned int s_opaqueGBufferFBO;
 		static unsigned int s_opaqueDepthBuffer;
-		static unsigned int s_opaqueGPosition;
-		static unsigned int s_opaqueGNormal;
-		static unsigned int s_opaqueGDiffuse;
-		static unsigned int s_opaqueGRoughnessMetalnessAO;
+		static unsigned int s_linkedListNodesPerPixel;
+		static unsigned int s_linkedListNodesSSBO;
+		static unsigned int s_linkedListCounters[2];
+		static GLsync s_linkedListFences[2];
+		static unsigned int s_linkedListCounterSet;
+		static unsigned int s_linkedListStoredFragments;
+		static unsigned int s_linkedListOverflowFragments;
+		static bool s_clusteredLighting;
+		static unsigned int s_clusterLightCountsSSBO;
+		static unsigned int s_clusterLightIndicesSSBO;
+		static bool s_instancing;
+		static std::vector<int> s_instanceMaterials;
+		static bool s_multiDrawIndirect;
+		static bool s_gpuCulling;
+		static glm::mat4 s_previousViewProjection;
+		static bool s_previousDepthValid;
+		static std::vector<DrawElementsIndirectCommand> s_drawCommands;
+		static DrawList s_opaqueDrawList;
+		static DrawList s_transparentDrawList;
+		static unsigned int s_instanceMaterialsSSBO;
+		static unsigned int s_instanceMaterialsSSBOCapacity;
+		static unsigned int s_drawCommandsBuffer;
+		static unsigned int s_drawCommandsBufferCapacity;
+		static std::vector<DrawItem> s_drawItems;
+		static std::vector<DrawItem> s_drawItemsScratch;
+		static std::vector<Entity*> s_instanceEntities;
+		static std::vector<Model*> s_queueModels;
+		static std::vector<unsigned int> s_meshFirstIndices;
+		static std::vector<int> s_meshBaseVertices;
+		static std::vector<int> s_meshIndicesNumbers;
+		static bool s_renderQueueValid;
+		static unsigned int s_renderQueueEntitiesVersion;
+		static unsigned int s_renderQueueModelsVersion;
+		static unsigned int s_renderQueueVisibilityVersion;
+		static unsigned int s_renderQueuePeelReachesVersion;
+		static bool s_renderQueueGpuCulling;
+		static glm::vec3 s_renderQueueCameraPosition;
+		static unsigned int s_renderQueueRebuilds;
+		static unsigned int s_drawCalls;
+		static unsigned int s_cameraUBO;
+		static unsigned int s_passUBO;
+		static unsigned int s_lightingUBO;
+		static PassUniforms s_passUniforms;
+		static PassUniforms s_uploadedPassUniforms;
+		static bool s_passUniformsUploaded;
+		static UniformHandle<int> s_nodePoolSizeUniform;
+		static UniformHandle<int> s_skipPeeledLayersUniform;
+		static UniformHandle<int> s_clusteringLightsNumberUniform;
+		static UniformHandle<glm::vec2> s_clusteringTileSizeUniform;
 		static unsigned int s_quadVAO;
 		static unsigned int s_quadVBO;	
 };
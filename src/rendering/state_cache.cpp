@@ -0,0 +1,277 @@
+#include <glad/glad.h>
+
+#include "consts.hpp"
+#include "rendering/state_cache.hpp"
+
+
+// --- Private static members
+unsigned int StateCache::s_program{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_drawFramebuffer{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_readFramebuffer{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_vertexArray{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_activeTextureUnit{ STATECACHE_UNKNOWN };
+TextureBinding StateCache::s_textures[STATECACHE_TEXTUREUNITS];
+ImageBinding StateCache::s_images[STATECACHE_IMAGEUNITS];
+unsigned int StateCache::s_buffers[8];
+unsigned int StateCache::s_indexedBuffers[3][STATECACHE_BUFFERBINDINGS];
+unsigned int StateCache::s_capabilities[4];
+unsigned int StateCache::s_blendEquation{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_blendFunc[4];
+unsigned int StateCache::s_depthMask{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_depthFunc{ STATECACHE_UNKNOWN };
+unsigned int StateCache::s_issuedCalls{ 0 };
+unsigned int StateCache::s_elidedCalls{ 0 };
+unsigned int StateCache::s_lastIssuedCalls{ 0 };
+unsigned int StateCache::s_lastElidedCalls{ 0 };
+
+
+// --- Public static methods
+void StateCache::beginFrame() {
+    // Keep the counters of the frame just ended, and forget cached state
+    s_lastIssuedCalls = s_issuedCalls;
+    s_lastElidedCalls = s_elidedCalls;
+    s_issuedCalls = 0;
+    s_elidedCalls = 0;
+    invalidate();
+}
+
+void StateCache::invalidate() {
+    // Mark every state as unknown, so that the next change of each is issued
+    s_program = STATECACHE_UNKNOWN;
+    s_drawFramebuffer = STATECACHE_UNKNOWN;
+    s_readFramebuffer = STATECACHE_UNKNOWN;
+    s_vertexArray = STATECACHE_UNKNOWN;
+    s_activeTextureUnit = STATECACHE_UNKNOWN;
+    for (unsigned int i = 0; i < STATECACHE_TEXTUREUNITS; i++)
+        s_textures[i] = TextureBinding{ STATECACHE_UNKNOWN, STATECACHE_UNKNOWN };
+    for (unsigned int i = 0; i < STATECACHE_IMAGEUNITS; i++)
+        s_images[i].texture = STATECACHE_UNKNOWN;
+    for (unsigned int i = 0; i < 8; i++)
+        s_buffers[i] = STATECACHE_UNKNOWN;
+    for (unsigned int t = 0; t < 3; t++)
+        for (unsigned int i = 0; i < STATECACHE_BUFFERBINDINGS; i++)
+            s_indexedBuffers[t][i] = STATECACHE_UNKNOWN;
+    for (unsigned int i = 0; i < 4; i++) {
+        s_capabilities[i] = STATECACHE_UNKNOWN;
+        s_blendFunc[i] = STATECACHE_UNKNOWN;
+    }
+    s_blendEquation = STATECACHE_UNKNOWN;
+    s_depthMask = STATECACHE_UNKNOWN;
+    s_depthFunc = STATECACHE_UNKNOWN;
+}
+
+void StateCache::useProgram(unsigned int program) {
+    if (update(s_program, program)) glUseProgram(program);
+}
+
+void StateCache::bindFramebuffer(GLenum target, unsigned int framebuffer) {
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    if (target == GL_FRAMEBUFFER) {
+        if (s_drawFramebuffer == framebuffer && s_readFramebuffer == framebuffer) {
+            s_elidedCalls++;
+            return;
+        }
+        s_drawFramebuffer = framebuffer;
+        s_readFramebuffer = framebuffer;
+        s_issuedCalls++;
+        glBindFramebuffer(target, framebuffer);
+    } else if (update(target == GL_DRAW_FRAMEBUFFER ? s_drawFramebuffer : s_readFramebuffer, framebuffer))
+        glBindFramebuffer(target, framebuffer);
+}
+
+void StateCache::bindVertexArray(unsigned int vertexArray) {
+    if (update(s_vertexArray, vertexArray)) glBindVertexArray(vertexArray);
+}
+
+void StateCache::bindTexture(unsigned int unit, GLenum target, unsigned int texture) {
+    // Units above the tracked ones are always bound
+    if (unit >= STATECACHE_TEXTUREUNITS) {
+        s_activeTextureUnit = unit;
+        s_issuedCalls += 2;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        return;
+    }
+
+    // Only the last target bound to a unit is tracked; binding another target of the same unit is always issued
+    TextureBinding &binding = s_textures[unit];
+    if (binding.target == target && binding.texture == texture) {
+        s_elidedCalls++;
+        return;
+    }
+    if (update(s_activeTextureUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    binding = TextureBinding{ target, texture };
+    s_issuedCalls++;
+    glBindTexture(target, texture);
+}
+
+void StateCache::bindBuffer(GLenum target, unsigned int buffer) {
+    // Untracked targets (e.g. GL_ELEMENT_ARRAY_BUFFER, which is part of the VAO's state) are always bound
+    int slot = getBufferSlot(target);
+    if (slot < 0) {
+        s_issuedCalls++;
+        glBindBuffer(target, buffer);
+    } else if (update(s_buffers[slot], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void StateCache::bindBufferBase(GLenum target, unsigned int index, unsigned int buffer) {
+    // Binding an indexed binding point binds the generic one too
+    int slot = getIndexedBufferSlot(target);
+    if (slot < 0 || index >= STATECACHE_BUFFERBINDINGS) {
+        s_issuedCalls++;
+        glBindBufferBase(target, index, buffer);
+    } else if (update(s_indexedBuffers[slot][index], buffer))
+        glBindBufferBase(target, index, buffer);
+    else return;
+    int genericSlot = getBufferSlot(target);
+    if (genericSlot >= 0) s_buffers[genericSlot] = buffer;
+}
+
+void StateCache::bindImageTexture(unsigned int unit, unsigned int texture, int level, GLboolean layered, GLenum access, GLenum format) {
+    // Units above the tracked ones are always bound; layer selection is not tracked, since only whole layered images are bound
+    if (unit >= STATECACHE_IMAGEUNITS) {
+        s_issuedCalls++;
+        glBindImageTexture(unit, texture, level, layered, 0, access, format);
+        return;
+    }
+    ImageBinding &binding = s_images[unit];
+    if (binding.texture == texture && binding.level == level && binding.layered == layered && binding.access == access && binding.format == format) {
+        s_elidedCalls++;
+        return;
+    }
+    binding = ImageBinding{ texture, level, layered, access, format };
+    s_issuedCalls++;
+    glBindImageTexture(unit, texture, level, layered, 0, access, format);
+}
+
+void StateCache::deleteBuffer(unsigned int buffer) {
+    // Deleting a buffer unbinds it, and its name may be reused by the next buffer created
+    for (unsigned int i = 0; i < 8; i++)
+        if (s_buffers[i] == buffer) s_buffers[i] = STATECACHE_UNKNOWN;
+    for (unsigned int t = 0; t < 3; t++)
+        for (unsigned int i = 0; i < STATECACHE_BUFFERBINDINGS; i++)
+            if (s_indexedBuffers[t][i] == buffer) s_indexedBuffers[t][i] = STATECACHE_UNKNOWN;
+    glDeleteBuffers(1, &buffer);
+}
+
+void StateCache::deleteTexture(unsigned int texture) {
+    // Deleting a texture unbinds it from every unit, and its name may be reused by the next texture created
+    for (unsigned int i = 0; i < STATECACHE_TEXTUREUNITS; i++)
+        if (s_textures[i].texture == texture) s_textures[i] = TextureBinding{ STATECACHE_UNKNOWN, STATECACHE_UNKNOWN };
+    for (unsigned int i = 0; i < STATECACHE_IMAGEUNITS; i++)
+        if (s_images[i].texture == texture) s_images[i].texture = STATECACHE_UNKNOWN;
+    glDeleteTextures(1, &texture);
+}
+
+void StateCache::deleteVertexArray(unsigned int vertexArray) {
+    // Deleting the bound vertex array reverts the binding to 0
+    if (s_vertexArray == vertexArray) s_vertexArray = 0;
+    glDeleteVertexArrays(1, &vertexArray);
+}
+
+void StateCache::deleteProgram(unsigned int program) {
+    // The program in use is only flagged for deletion, but its name must not be trusted once it is gone
+    if (s_program == program) s_program = STATECACHE_UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void StateCache::setCapability(GLenum capability, bool enabled) {
+    // Untracked capabilities are always set
+    int slot = getCapabilitySlot(capability);
+    if (slot >= 0 && !update(s_capabilities[slot], enabled)) return;
+    if (slot < 0) s_issuedCalls++;
+    if (enabled) glEnable(capability);
+    else glDisable(capability);
+}
+
+void StateCache::blendEquation(GLenum mode) {
+    if (update(s_blendEquation, mode)) glBlendEquation(mode);
+}
+
+void StateCache::blendFunc(GLenum source, GLenum destination) {
+    blendFuncSeparate(source, destination, source, destination);
+}
+
+void StateCache::blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha) {
+    if (s_blendFunc[0] == sourceRGB && s_blendFunc[1] == destinationRGB && s_blendFunc[2] == sourceAlpha && s_blendFunc[3] == destinationAlpha) {
+        s_elidedCalls++;
+        return;
+    }
+    s_blendFunc[0] = sourceRGB;
+    s_blendFunc[1] = destinationRGB;
+    s_blendFunc[2] = sourceAlpha;
+    s_blendFunc[3] = destinationAlpha;
+    s_issuedCalls++;
+    glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+}
+
+void StateCache::blendFunci(unsigned int drawBuffer, GLenum source, GLenum destination) {
+    // Per-buffer blending is not tracked; it leaves the shared blending function unknown
+    for (unsigned int i = 0; i < 4; i++)
+        s_blendFunc[i] = STATECACHE_UNKNOWN;
+    s_issuedCalls++;
+    glBlendFunci(drawBuffer, source, destination);
+}
+
+void StateCache::depthMask(bool enabled) {
+    if (update(s_depthMask, enabled)) glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void StateCache::depthFunc(GLenum function) {
+    if (update(s_depthFunc, function)) glDepthFunc(function);
+}
+
+unsigned int StateCache::getIssuedCalls() {
+    return s_lastIssuedCalls;
+}
+
+unsigned int StateCache::getElidedCalls() {
+    return s_lastElidedCalls;
+}
+
+
+// --- Private static methods
+bool StateCache::update(unsigned int &cached, unsigned int value) {
+    // Report whether the call has to be issued, counting it either way
+    if (cached == value) {
+        s_elidedCalls++;
+        return false;
+    }
+    cached = value;
+    s_issuedCalls++;
+    return true;
+}
+
+int StateCache::getBufferSlot(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_SHADER_STORAGE_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_ATOMIC_COUNTER_BUFFER: return 3;
+        case GL_DRAW_INDIRECT_BUFFER: return 4;
+        case GL_PARAMETER_BUFFER: return 5;
+        case GL_COPY_READ_BUFFER: return 6;
+        case GL_COPY_WRITE_BUFFER: return 7;
+        default: return -1;
+    }
+}
+
+int StateCache::getIndexedBufferSlot(GLenum target) {
+    switch (target) {
+        case GL_SHADER_STORAGE_BUFFER: return 0;
+        case GL_UNIFORM_BUFFER: return 1;
+        case GL_ATOMIC_COUNTER_BUFFER: return 2;
+        default: return -1;
+    }
+}
+
+int StateCache::getCapabilitySlot(GLenum capability) {
+    switch (capability) {
+        case GL_BLEND: return 0;
+        case GL_CULL_FACE: return 1;
+        case GL_DEPTH_TEST: return 2;
+        case GL_SCISSOR_TEST: return 3;
+        default: return -1;
+    }
+}
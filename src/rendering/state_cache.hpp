@@ -0,0 +1,86 @@
+#ifndef STATE_CACHE_HPP
+#define STATE_CACHE_HPP
+
+#include <glad/glad.h>
+
+#include "consts.hpp"
+
+
+// --- Texture bound to a texture unit
+struct TextureBinding {
+    GLenum target;
+    unsigned int texture;
+};
+
+// --- Texture level bound to an image unit
+struct ImageBinding {
+    unsigned int texture;
+    int level;
+    GLboolean layered;
+    GLenum access;
+    GLenum format;
+};
+
+// --- StateCache class
+// Every GL state change of the engine goes through here; changes matching the current state are dropped.
+// Cached state is forgotten at the start of each frame, so that anything set outside the engine (e.g. by Dear ImGui)
+// is never trusted for long.
+class StateCache {
+    public:
+        // --- Public static methods
+        static void beginFrame();
+        static void invalidate();
+        static void useProgram(unsigned int program);
+        static void bindFramebuffer(GLenum target, unsigned int framebuffer);
+        static void bindVertexArray(unsigned int vertexArray);
+        static void bindTexture(unsigned int unit, GLenum target, unsigned int texture);
+        static void bindBuffer(GLenum target, unsigned int buffer);
+        static void bindBufferBase(GLenum target, unsigned int index, unsigned int buffer);
+        static void bindImageTexture(unsigned int unit, unsigned int texture, int level, GLboolean layered, GLenum access, GLenum format);
+        static void deleteBuffer(unsigned int buffer);
+        static void deleteTexture(unsigned int texture);
+        static void deleteVertexArray(unsigned int vertexArray);
+        static void deleteProgram(unsigned int program);
+        static void setCapability(GLenum capability, bool enabled);
+        static void blendEquation(GLenum mode);
+        static void blendFunc(GLenum source, GLenum destination);
+        static void blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+        static void blendFunci(unsigned int drawBuffer, GLenum source, GLenum destination);
+        static void depthMask(bool enabled);
+        static void depthFunc(GLenum function);
+        static unsigned int getIssuedCalls();
+        static unsigned int getElidedCalls();
+
+    private:
+        // --- Private constructor
+        StateCache();
+
+        // --- Private static methods
+        static bool update(unsigned int &cached, unsigned int value);
+        static int getBufferSlot(GLenum target);
+        static int getIndexedBufferSlot(GLenum target);
+        static int getCapabilitySlot(GLenum capability);
+
+        // --- Private static members
+        static unsigned int s_program;
+        static unsigned int s_drawFramebuffer;
+        static unsigned int s_readFramebuffer;
+        static unsigned int s_vertexArray;
+        static unsigned int s_activeTextureUnit;
+        static TextureBinding s_textures[STATECACHE_TEXTUREUNITS];
+        static ImageBinding s_images[STATECACHE_IMAGEUNITS];
+        static unsigned int s_buffers[8];
+        static unsigned int s_indexedBuffers[3][STATECACHE_BUFFERBINDINGS];
+        static unsigned int s_capabilities[4];
+        static unsigned int s_blendEquation;
+        static unsigned int s_blendFunc[4];
+        static unsigned int s_depthMask;
+        static unsigned int s_depthFunc;
+        static unsigned int s_issuedCalls;
+        static unsigned int s_elidedCalls;
+        static unsigned int s_lastIssuedCalls;
+        static unsigned int s_lastElidedCalls;
+};
+
+
+#endif // STATE_CACHE_HPP
@@ -0,0 +1,231 @@
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_STAGE_SSE
+#endif
+
+#include "rendering/transform_stage.hpp"
+#include "rendering/state_cache.hpp"
+
+
+// --- Private static members
+std::vector<float> TransformStage::s_positionsX;
+std::vector<float> TransformStage::s_positionsY;
+std::vector<float> TransformStage::s_positionsZ;
+std::vector<float> TransformStage::s_viewPositionsX;
+std::vector<float> TransformStage::s_viewPositionsY;
+std::vector<float> TransformStage::s_viewPositionsZ;
+std::vector<unsigned int> TransformStage::s_rotatedIndices;
+std::vector<float> TransformStage::s_rotations[9];
+std::vector<float> TransformStage::s_viewRotations[9];
+std::vector<float> TransformStage::s_normalMatrices[9];
+std::vector<InstanceTransform> TransformStage::s_transforms;
+unsigned int TransformStage::s_transformsSSBO{ 0 };
+unsigned int TransformStage::s_transformsSSBOCapacity{ 0 };
+unsigned int TransformStage::s_translationOnlyNumber{ 0 };
+
+
+// --- Public static methods
+void TransformStage::init() {
+    // Create SSBO for per-instance transforms; it grows with the number of entities
+    glGenBuffers(1, &s_transformsSSBO);
+}
+
+void TransformStage::update(std::vector<Entity*> &entities, const glm::mat4 &viewMatrix) {
+    // How the transform stage works:
+    //      1) Gather entity positions into SoA arrays, padded to a multiple of the SIMD width; rotated entities also
+    //         gather the 3x3 rotation of their model matrix, into SoA arrays of their own;
+    //      2) Transform every position to view-space at once, four at a time;
+    //      3) Compose the model-view rotation and normal matrix of every rotated entity, four at a time;
+    //      4) Write per-instance matrices. Entities with no rotation take a fast path: their model-view matrix is the
+    //         view matrix with its translation replaced by the one from step 2, and their normal matrix is the view's
+    //         own, computed once per frame. Rotated entities assemble theirs from steps 2 and 3;
+    //      5) Upload every transform at once.
+    // Only the upload is AoS, as the SSBO is indexed per instance by the shaders.
+
+    // 1) Gather positions and rotations
+    size_t count = entities.size();
+    size_t paddedCount = (count + 3) & ~(size_t)3;
+    s_positionsX.resize(paddedCount, 0.0f);
+    s_positionsY.resize(paddedCount, 0.0f);
+    s_positionsZ.resize(paddedCount, 0.0f);
+    s_rotatedIndices.clear();
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 position = entities[i]->getPosition();
+        s_positionsX[i] = position.x;
+        s_positionsY[i] = position.y;
+        s_positionsZ[i] = position.z;
+        if (entities[i]->getRotation() != glm::vec3{ 0.0f })
+            s_rotatedIndices.push_back((unsigned int)i);
+    }
+    size_t rotatedCount = s_rotatedIndices.size();
+    size_t paddedRotatedCount = (rotatedCount + 3) & ~(size_t)3;
+    for (int e = 0; e < 9; e++)
+        s_rotations[e].resize(paddedRotatedCount);
+    for (size_t j = 0; j < paddedRotatedCount; j++) {
+        // Padding lanes hold the identity, so that they invert cleanly
+        glm::mat3 rotation = j < rotatedCount ? glm::mat3(entities[s_rotatedIndices[j]]->getModelMatrix()) : glm::mat3{ 1.0f };
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                s_rotations[c * 3 + r][j] = rotation[c][r];
+    }
+
+    // 2) Transform positions
+    transformPositions(viewMatrix);
+
+    // 3) Transform rotations
+    transformRotations(viewMatrix);
+
+    // 4) Write matrices
+    glm::mat4 viewNormalMatrix = glm::mat4(glm::inverseTranspose(glm::mat3(viewMatrix)));
+    s_transforms.resize(count);
+    s_translationOnlyNumber = (unsigned int)(count - rotatedCount);
+    size_t rotated = 0;
+    for (size_t i = 0; i < count; i++) {
+        InstanceTransform &transform = s_transforms[i];
+        transform.modelMatrix = glm::mat4{ 1.0f };
+        transform.modelMatrix[3] = glm::vec4{ s_positionsX[i], s_positionsY[i], s_positionsZ[i], 1.0f };
+        if (rotated < rotatedCount && s_rotatedIndices[rotated] == i) {
+            transform.modelViewMatrix = glm::mat4{ 1.0f };
+            transform.normalMatrix = glm::mat4{ 1.0f };
+            for (int c = 0; c < 3; c++) {
+                for (int r = 0; r < 3; r++) {
+                    transform.modelMatrix[c][r] = s_rotations[c * 3 + r][rotated];
+                    transform.modelViewMatrix[c][r] = s_viewRotations[c * 3 + r][rotated];
+                    transform.normalMatrix[c][r] = s_normalMatrices[c * 3 + r][rotated];
+                }
+            }
+            rotated++;
+        } else {
+            transform.modelViewMatrix = viewMatrix;
+            transform.normalMatrix = viewNormalMatrix;
+        }
+        transform.modelViewMatrix[3] = glm::vec4{ s_viewPositionsX[i], s_viewPositionsY[i], s_viewPositionsZ[i], 1.0f };
+    }
+
+    // 5) Upload transforms; allocate more memory only if needed
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, s_transformsSSBO);
+    if (s_transforms.size() > s_transformsSSBOCapacity) {
+        s_transformsSSBOCapacity = (unsigned int)s_transforms.capacity();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(InstanceTransform) * s_transformsSSBOCapacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (!s_transforms.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(InstanceTransform) * s_transforms.size(), s_transforms.data());
+    StateCache::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+unsigned int TransformStage::getTransformsSSBO() {
+    return s_transformsSSBO;
+}
+
+unsigned int TransformStage::getTranslationOnlyNumber() {
+    return s_translationOnlyNumber;
+}
+
+void TransformStage::clear() {
+    StateCache::deleteBuffer(s_transformsSSBO);
+    s_transformsSSBOCapacity = 0;
+}
+
+
+// --- Private static methods
+void TransformStage::transformPositions(const glm::mat4 &viewMatrix) {
+    // View-space position of every entity, i.e. the translation of its model-view matrix:
+    //      t = V[0] * p.x + V[1] * p.y + V[2] * p.z + V[3]
+    size_t count = s_positionsX.size();
+    s_viewPositionsX.resize(count);
+    s_viewPositionsY.resize(count);
+    s_viewPositionsZ.resize(count);
+#ifdef TRANSFORM_STAGE_SSE
+    // Broadcast every view matrix coefficient, so that each lane handles one entity
+    __m128 v[4][3];
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 3; r++)
+            v[c][r] = _mm_set1_ps(viewMatrix[c][r]);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(&s_positionsX[i]);
+        __m128 y = _mm_loadu_ps(&s_positionsY[i]);
+        __m128 z = _mm_loadu_ps(&s_positionsZ[i]);
+        __m128 viewPosition[3];
+        for (int r = 0; r < 3; r++)
+            viewPosition[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0][r], x), _mm_mul_ps(v[1][r], y)), _mm_add_ps(_mm_mul_ps(v[2][r], z), v[3][r]));
+        _mm_storeu_ps(&s_viewPositionsX[i], viewPosition[0]);
+        _mm_storeu_ps(&s_viewPositionsY[i], viewPosition[1]);
+        _mm_storeu_ps(&s_viewPositionsZ[i], viewPosition[2]);
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        glm::vec4 viewPosition = viewMatrix * glm::vec4{ s_positionsX[i], s_positionsY[i], s_positionsZ[i], 1.0f };
+        s_viewPositionsX[i] = viewPosition.x;
+        s_viewPositionsY[i] = viewPosition.y;
+        s_viewPositionsZ[i] = viewPosition.z;
+    }
+#endif
+}
+
+void TransformStage::transformRotations(const glm::mat4 &viewMatrix) {
+    // Model-view rotation of every rotated entity, M = V * R, and its normal matrix, the inverse-transpose of M. With
+    // a, b, c the columns of M, the latter is built from cofactors, dodging a general inverse:
+    //      N = [b x c, c x a, a x b] / (a . (b x c))
+    size_t count = s_rotations[0].size();
+    for (int e = 0; e < 9; e++) {
+        s_viewRotations[e].resize(count);
+        s_normalMatrices[e].resize(count);
+    }
+#ifdef TRANSFORM_STAGE_SSE
+    // Broadcast the view rotation, so that each lane handles one entity
+    __m128 v[3][3];
+    for (int c = 0; c < 3; c++)
+        for (int r = 0; r < 3; r++)
+            v[c][r] = _mm_set1_ps(viewMatrix[c][r]);
+    for (size_t i = 0; i < count; i += 4) {
+        // M[c][r] = V[0][r] * R[c][0] + V[1][r] * R[c][1] + V[2][r] * R[c][2]
+        __m128 m[3][3];
+        for (int c = 0; c < 3; c++) {
+            __m128 r0 = _mm_loadu_ps(&s_rotations[c * 3 + 0][i]);
+            __m128 r1 = _mm_loadu_ps(&s_rotations[c * 3 + 1][i]);
+            __m128 r2 = _mm_loadu_ps(&s_rotations[c * 3 + 2][i]);
+            for (int r = 0; r < 3; r++) {
+                m[c][r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0][r], r0), _mm_mul_ps(v[1][r], r1)), _mm_mul_ps(v[2][r], r2));
+                _mm_storeu_ps(&s_viewRotations[c * 3 + r][i], m[c][r]);
+            }
+        }
+
+        // Cofactor columns: column c is the cross product of the other two columns, in cyclic order
+        __m128 n[3][3];
+        for (int c = 0; c < 3; c++) {
+            const __m128 *p = m[(c + 1) % 3];
+            const __m128 *q = m[(c + 2) % 3];
+            n[c][0] = _mm_sub_ps(_mm_mul_ps(p[1], q[2]), _mm_mul_ps(p[2], q[1]));
+            n[c][1] = _mm_sub_ps(_mm_mul_ps(p[2], q[0]), _mm_mul_ps(p[0], q[2]));
+            n[c][2] = _mm_sub_ps(_mm_mul_ps(p[0], q[1]), _mm_mul_ps(p[1], q[0]));
+        }
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], n[0][0]), _mm_mul_ps(m[0][1], n[0][1])), _mm_mul_ps(m[0][2], n[0][2]));
+        __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                _mm_storeu_ps(&s_normalMatrices[c * 3 + r][i], _mm_mul_ps(n[c][r], inverseDeterminant));
+    }
+#else
+    glm::mat3 viewRotation{ viewMatrix };
+    for (size_t i = 0; i < count; i++) {
+        glm::mat3 rotation;
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                rotation[c][r] = s_rotations[c * 3 + r][i];
+        glm::mat3 modelView = viewRotation * rotation;
+        glm::mat3 normalMatrix = glm::inverseTranspose(modelView);
+        for (int c = 0; c < 3; c++) {
+            for (int r = 0; r < 3; r++) {
+                s_viewRotations[c * 3 + r][i] = modelView[c][r];
+                s_normalMatrices[c * 3 + r][i] = normalMatrix[c][r];
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef TRANSFORM_STAGE_HPP
+#define TRANSFORM_STAGE_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/entity.hpp"
+
+
+// --- Per-instance transforms, laid out as std430 for the transforms SSBO (see gBufferShader.vert)
+struct InstanceTransform {
+    glm::mat4 modelMatrix;
+    glm::mat4 modelViewMatrix;
+    glm::mat4 normalMatrix; // mat3 in view-space, padded to mat4 as std430 aligns its columns to vec4
+};
+
+// --- TransformStage class
+// Computes the matrices of every instance once per frame, for every pass to index.
+class TransformStage {
+    public:
+        // --- Public static methods
+        static void init();
+        static void update(std::vector<Entity*> &entities, const glm::mat4 &viewMatrix);
+        static unsigned int getTransformsSSBO();
+        static unsigned int getTranslationOnlyNumber();
+        static void clear();
+
+    private:
+        // --- Private constructor
+        TransformStage();
+
+        // --- Private static methods
+        static void transformPositions(const glm::mat4 &viewMatrix);
+        static void transformRotations(const glm::mat4 &viewMatrix);
+
+        // --- Private static members
+        static std::vector<float> s_positionsX;
+        static std::vector<float> s_positionsY;
+        static std::vector<float> s_positionsZ;
+        static std::vector<float> s_viewPositionsX;
+        static std::vector<float> s_viewPositionsY;
+        static std::vector<float> s_viewPositionsZ;
+        static std::vector<unsigned int> s_rotatedIndices;
+        static std::vector<float> s_rotations[9];           // Column-major 3x3 entries of rotated entities
+        static std::vector<float> s_viewRotations[9];
+        static std::vector<float> s_normalMatrices[9];
+        static std::vector<InstanceTransform> s_transforms;
+        static unsigned int s_transformsSSBO;
+        static unsigned int s_transformsSSBOCapacity;
+        static unsigned int s_translationOnlyNumber;
+};
+
+
+#endif // TRANSFORM_STAGE_HPP
@@ -0,0 +1,193 @@
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "resources/geometry_arena.hpp"
+#include "resources/mesh.hpp"
+#include "rendering/state_cache.hpp"
+
+
+// --- Private static members
+unsigned int GeometryArena::s_VAO{ 0 };
+unsigned int GeometryArena::s_VBO{ 0 };
+unsigned int GeometryArena::s_EBO{ 0 };
+unsigned int GeometryArena::s_vertexCapacity{ 0 };
+unsigned int GeometryArena::s_indexCapacity{ 0 };
+std::vector<ArenaRange> GeometryArena::s_freeVertices;
+std::vector<ArenaRange> GeometryArena::s_freeIndices;
+
+
+// --- Public static methods
+void GeometryArena::init() {
+    // Create the shared VAO and the initial buffers
+    glGenVertexArrays(1, &s_VAO);
+    growBuffer(s_VBO, s_vertexCapacity, s_freeVertices, sizeof(Vertex), ARENA_VERTEXCAPACITY);
+    growBuffer(s_EBO, s_indexCapacity, s_freeIndices, sizeof(GLuint), ARENA_INDEXCAPACITY);
+    setupVAO();
+}
+
+ArenaAllocation GeometryArena::allocate(const void *vertices, unsigned int verticesNumber, const GLuint *indices, unsigned int indicesNumber) {
+    // Reserve ranges; buffers grow only when no free range is large enough
+    ArenaAllocation allocation{ { 0, verticesNumber }, { 0, indicesNumber } };
+    if (!allocateRange(s_freeVertices, verticesNumber, allocation.vertices.offset)) {
+        growBuffer(s_VBO, s_vertexCapacity, s_freeVertices, sizeof(Vertex), verticesNumber);
+        allocateRange(s_freeVertices, verticesNumber, allocation.vertices.offset);
+        setupVAO();
+    }
+    if (!allocateRange(s_freeIndices, indicesNumber, allocation.indices.offset)) {
+        growBuffer(s_EBO, s_indexCapacity, s_freeIndices, sizeof(GLuint), indicesNumber);
+        allocateRange(s_freeIndices, indicesNumber, allocation.indices.offset);
+        setupVAO();
+    }
+
+    // Upload data
+    // GL_COPY_WRITE_BUFFER is used as target, so that no VAO's element buffer binding is touched.
+    StateCache::bindBuffer(GL_COPY_WRITE_BUFFER, s_VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(Vertex) * allocation.vertices.offset, sizeof(Vertex) * verticesNumber, vertices);
+    StateCache::bindBuffer(GL_COPY_WRITE_BUFFER, s_EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * allocation.indices.offset, sizeof(GLuint) * indicesNumber, indices);
+    StateCache::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return allocation;
+}
+
+void GeometryArena::free(ArenaAllocation &allocation) {
+    // Give ranges back to the free lists; their content is left as it is
+    // Meshes outliving the arena (e.g. destroyed at exit, after clear()) have nothing to give back.
+    if (s_VAO == 0) return;
+    freeRange(s_freeVertices, allocation.vertices);
+    freeRange(s_freeIndices, allocation.indices);
+    allocation.vertices.count = 0;
+    allocation.indices.count = 0;
+}
+
+unsigned int GeometryArena::getVAO() {
+    return s_VAO;
+}
+
+unsigned int GeometryArena::getVertexCapacity() {
+    return s_vertexCapacity;
+}
+
+unsigned int GeometryArena::getIndexCapacity() {
+    return s_indexCapacity;
+}
+
+unsigned int GeometryArena::getFreeVertices() {
+    unsigned int count = 0;
+    for (auto iter = s_freeVertices.begin(); iter != s_freeVertices.end(); iter++)
+        count += iter->count;
+    return count;
+}
+
+unsigned int GeometryArena::getFreeIndices() {
+    unsigned int count = 0;
+    for (auto iter = s_freeIndices.begin(); iter != s_freeIndices.end(); iter++)
+        count += iter->count;
+    return count;
+}
+
+void GeometryArena::clear() {
+    StateCache::deleteVertexArray(s_VAO);
+    StateCache::deleteBuffer(s_VBO);
+    StateCache::deleteBuffer(s_EBO);
+    s_VAO = s_VBO = s_EBO = 0;
+    s_vertexCapacity = s_indexCapacity = 0;
+    s_freeVertices.clear();
+    s_freeIndices.clear();
+}
+
+
+// --- Private static methods
+bool GeometryArena::allocateRange(std::vector<ArenaRange> &freeList, unsigned int count, unsigned int &offset) {
+    // First fit; the free list is sorted by offset
+    if (count == 0) {
+        offset = 0;
+        return true;
+    }
+    for (auto iter = freeList.begin(); iter != freeList.end(); iter++) {
+        if (iter->count < count) continue;
+        offset = iter->offset;
+        iter->offset += count;
+        iter->count -= count;
+        if (iter->count == 0) freeList.erase(iter);
+        return true;
+    }
+    return false;
+}
+
+void GeometryArena::freeRange(std::vector<ArenaRange> &freeList, ArenaRange range) {
+    if (range.count == 0) return;
+
+    // Insert range keeping the list sorted by offset
+    auto iter = freeList.begin();
+    while (iter != freeList.end() && iter->offset < range.offset) iter++;
+    iter = freeList.insert(iter, range);
+
+    // Coalesce with the following and the preceding ranges
+    auto next = iter + 1;
+    if (next != freeList.end() && iter->offset + iter->count == next->offset) {
+        iter->count += next->count;
+        iter = freeList.erase(next) - 1;
+    }
+    if (iter != freeList.begin()) {
+        auto prev = iter - 1;
+        if (prev->offset + prev->count == iter->offset) {
+            prev->count += iter->count;
+            freeList.erase(iter);
+        }
+    }
+}
+
+void GeometryArena::growBuffer(unsigned int &buffer, unsigned int &capacity, std::vector<ArenaRange> &freeList, unsigned int elementSize, unsigned int requiredCount) {
+    // Double capacity until the free tail of the buffer can hold the request
+    unsigned int tail = 0;
+    if (!freeList.empty() && freeList.back().offset + freeList.back().count == capacity)
+        tail = freeList.back().count;
+    unsigned int newCapacity = capacity > 0 ? capacity : 1;
+    while (newCapacity - capacity + tail < requiredCount) newCapacity *= 2;
+
+    // Copy current content into a larger buffer
+    unsigned int newBuffer;
+    glGenBuffers(1, &newBuffer);
+    StateCache::bindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)elementSize * newCapacity, NULL, GL_STATIC_DRAW);
+    if (buffer != 0) {
+        StateCache::bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)elementSize * capacity);
+        StateCache::bindBuffer(GL_COPY_READ_BUFFER, 0);
+        StateCache::deleteBuffer(buffer);
+    }
+    StateCache::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    buffer = newBuffer;
+
+    // Hand the new space to the free list
+    freeRange(freeList, ArenaRange{ capacity, newCapacity - capacity });
+    capacity = newCapacity;
+}
+
+void GeometryArena::setupVAO() {
+    // Point the shared VAO to the current buffers
+    // These will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)").
+    StateCache::bindVertexArray(s_VAO);
+    StateCache::bindBuffer(GL_ARRAY_BUFFER, s_VBO);
+    // Vertex positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+    // Normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+    // Texture Coordinates
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoords));
+    // Tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, tangent));
+    // Bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, bitangent));
+    StateCache::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_EBO);
+    StateCache::bindVertexArray(0);
+    StateCache::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
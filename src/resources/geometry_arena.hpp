@@ -0,0 +1,60 @@
+#ifndef GEOMETRY_ARENA_HPP
+#define GEOMETRY_ARENA_HPP
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "consts.hpp"
+
+
+// --- Range of elements (vertices or indices) inside the arena
+struct ArenaRange {
+    unsigned int offset;
+    unsigned int count;
+};
+
+// --- Vertices and indices owned by a mesh
+// Indices are relative to the mesh, so draws add vertices.offset as base vertex.
+struct ArenaAllocation {
+    ArenaRange vertices;
+    ArenaRange indices;
+};
+
+// --- GeometryArena class
+// Every mesh lives in one vertex buffer and one index buffer, sharing a single VAO.
+class GeometryArena {
+    public:
+        // --- Public static methods
+        static void init();
+        static ArenaAllocation allocate(const void *vertices, unsigned int verticesNumber, const GLuint *indices, unsigned int indicesNumber);
+        static void free(ArenaAllocation &allocation);
+        static unsigned int getVAO();
+        static unsigned int getVertexCapacity();
+        static unsigned int getIndexCapacity();
+        static unsigned int getFreeVertices();
+        static unsigned int getFreeIndices();
+        static void clear();
+
+    private:
+        // --- Private constructor
+        GeometryArena();
+
+        // --- Private static methods
+        static bool allocateRange(std::vector<ArenaRange> &freeList, unsigned int count, unsigned int &offset);
+        static void freeRange(std::vector<ArenaRange> &freeList, ArenaRange range);
+        static void growBuffer(unsigned int &buffer, unsigned int &capacity, std::vector<ArenaRange> &freeList, unsigned int elementSize, unsigned int requiredCount);
+        static void setupVAO();
+
+        // --- Private static members
+        static unsigned int s_VAO;
+        static unsigned int s_VBO;
+        static unsigned int s_EBO;
+        static unsigned int s_vertexCapacity;
+        static unsigned int s_indexCapacity;
+        static std::vector<ArenaRange> s_freeVertices;
+        static std::vector<ArenaRange> s_freeIndices;
+};
+
+
+#endif // GEOMETRY_ARENA_HPP
@@ -7,6 +7,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "resources/geometry_arena.hpp"
+
 
 // --- Vertex data structure
 struct Vertex {
@@ -17,6 +19,27 @@ struct Vertex {
     glm::vec3 bitangent;
 };
 
+// --- Bounding volumes, in model-space
+// The sphere is centered on the box; culling tests each plane against whichever of the two is tighter.
+struct BoundingVolume {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+};
+
+// --- Cluster of a mesh's triangles, culled and drawn on its own
+// Its triangles are contiguous among the mesh's indices. The cone bounds the normals of its triangles, so that the
+// whole cluster can be found facing away from a viewpoint (see gpuCullingShader.comp).
+struct Meshlet {
+    unsigned int firstIndex;    // Relative to the mesh's first index
+    unsigned int indexCount;
+    glm::vec3 center;           // Bounding sphere, in model-space
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;           // Sine of the cone's half-angle; 1 if the cluster may face any way
+};
+
 // --- Mesh class
 class Mesh {
     public:
@@ -25,8 +48,8 @@ class Mesh {
         Mesh(const Mesh& copy) = delete; //disallow copy
         Mesh& operator=(const Mesh &) = delete;
         
-        // This constructor empties the source vectors (vertices and indices)
-        Mesh(std::vector<Vertex> &vertices, std::vector<GLuint> &indices) noexcept;
+        // This constructor empties the source vectors (vertices, indices and meshlets)
+        Mesh(std::vector<Vertex> &vertices, std::vector<GLuint> &indices, const BoundingVolume &bounds, std::vector<Meshlet> &meshlets) noexcept;
 
         // Move constructor
         Mesh(Mesh &&move) noexcept;
@@ -38,16 +61,22 @@ class Mesh {
         ~Mesh() noexcept;
 
         // --- Public methods
-        GLuint getVAO();
         int getIndicesNumber();
+        unsigned int getFirstIndex();
+        int getBaseVertex();
+        const BoundingVolume &getBounds() const;
+        const std::vector<Vertex> &getVertices() const;
+        const std::vector<GLuint> &getIndices() const;
+        const std::vector<Meshlet> &getMeshlets() const;
 
     private:
         // --- Private members
         std::vector<Vertex> m_vertices;
         std::vector<GLuint> m_indices;
-        GLuint m_VAO;
-        GLuint m_VBO;
-        GLuint m_EBO;
+        ArenaAllocation m_allocation;
+        BoundingVolume m_bounds;
+        std::vector<Meshlet> m_meshlets;
+        bool m_isAllocated;
 
         // --- Private methods
         void setup();
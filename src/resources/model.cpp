@@ -1,27 +1,33 @@
 #include <iostream>
+#include <limits>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "consts.hpp"
 #include "resources/mesh.hpp"
 #include "resources/model.hpp"
 
 
 // --- Public constructor
-Model::Model() {}
+Model::Model() :
+    m_bounds{ glm::vec3{ 0.0f }, glm::vec3{ 0.0f }, glm::vec3{ 0.0f }, 0.0f } {}
 
 
 // --- Public methods
 void Model::setup(const aiScene *scene) {
-    // Begin the recursive processing of nodes in the Assimp data structure
+    // Begin the recursive processing of nodes in the Assimp data structure, then bound the meshes found
     this->processNode(scene->mRootNode, scene);
+    this->computeBounds();
 }
 
-void Model::buildMeshLists(unsigned int *vaoList, int *indicesNumberList) {
+void Model::buildMeshLists(unsigned int *firstIndexList, int *baseVertexList, int *indicesNumberList) {
     for(unsigned int i = 0; i < m_meshes.size(); i++) {
-        vaoList[i] = m_meshes[i].getVAO();
+        firstIndexList[i] = m_meshes[i].getFirstIndex();
+        baseVertexList[i] = m_meshes[i].getBaseVertex();
         indicesNumberList[i] = m_meshes[i].getIndicesNumber();
     }
 }
@@ -30,6 +36,14 @@ int Model::getMeshesNumber() {
     return m_meshes.size();
 }
 
+const BoundingVolume &Model::getBounds() const {
+    return m_bounds;
+}
+
+const std::vector<Mesh> &Model::getMeshes() const {
+    return m_meshes;
+}
+
 
 // --- Private methods
 void Model::processNode(aiNode* node, const aiScene* scene) {
@@ -49,6 +63,11 @@ Mesh Model::processMesh(aiMesh* mesh) {
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
+    // Bounds start inverted, so that the first vertex processed initializes them
+    BoundingVolume bounds;
+    bounds.min = glm::vec3{ std::numeric_limits<float>::max() };
+    bounds.max = glm::vec3{ std::numeric_limits<float>::lowest() };
+
     for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
         Vertex vertex;
         // The vector data type used by Assimp is different than the GLM vector needed to allocate the OpenGL buffers
@@ -59,6 +78,9 @@ Mesh Model::processMesh(aiMesh* mesh) {
         vector.y = mesh->mVertices[i].y;
         vector.z = mesh->mVertices[i].z;
         vertex.position = vector;
+        // Grow model-space bounding box
+        bounds.min = glm::min(bounds.min, vector);
+        bounds.max = glm::max(bounds.max, vector);
         // Normals
         vector.x = mesh->mNormals[i].x;
         vector.y = mesh->mNormals[i].y;
@@ -100,6 +122,154 @@ Mesh Model::processMesh(aiMesh* mesh) {
             indices.emplace_back(face.mIndices[j]);
     }
 
+    // Bounding sphere, centered on the box and reaching its farthest vertex; tighter than the box's half-diagonal
+    if (vertices.empty()) bounds.min = bounds.max = glm::vec3{ 0.0f };
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    bounds.radius = 0.0f;
+    for (const Vertex &vertex : vertices)
+        bounds.radius = glm::max(bounds.radius, glm::length(vertex.position - bounds.center));
+
+    // Split triangles into meshlets, reordering indices so that each meshlet is a contiguous range
+    std::vector<Meshlet> meshlets;
+    buildMeshlets(vertices, indices, meshlets);
+
     // Return an instance of the Mesh class created using the vertices and faces data structures created above.
-    return Mesh(vertices, indices);
+    return Mesh(vertices, indices, bounds, meshlets);
+}
+
+void Model::buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<Meshlet> &meshlets) {
+    // How meshlets are built:
+    //      1) Triangles are listed per vertex, so that the ones sharing vertices with a meshlet are found at once;
+    //      2) A meshlet starts from the first triangle left, then grows by the adjacent triangle adding the fewest new
+    //         vertices, until it reaches either limit or no adjacent triangle fits;
+    //      3) Triangles are written back meshlet by meshlet;
+    //      4) Each meshlet is bounded by a sphere, centered on its box, and by a cone around the average normal of its
+    //         triangles. Normals follow the winding, which decides what back-face culling drops.
+    // Compact meshlets keep spheres tight and cones narrow, so that both reject more of them.
+    //
+    // SOURCE: https://github.com/zeux/meshoptimizer (meshopt_buildMeshlets, meshopt_computeMeshletBounds)
+    size_t triangleCount = indices.size() / 3;
+
+    // 1) List triangles per vertex
+    std::vector<unsigned int> firstTriangles(vertices.size() + 1, 0);
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        firstTriangles[indices[i] + 1]++;
+    for (size_t v = 0; v < vertices.size(); v++)
+        firstTriangles[v + 1] += firstTriangles[v];
+    std::vector<unsigned int> cursors(firstTriangles.begin(), firstTriangles.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        vertexTriangles[cursors[indices[i]]++] = (unsigned int)(i / 3);
+
+    // 2) and 3) Grow meshlets; vertices are marked with the last meshlet using them
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> vertexMeshlets(vertices.size(), -1);
+    std::vector<unsigned int> meshletVertices;
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    size_t seed = 0;
+    while (true) {
+        while (seed < triangleCount && emitted[seed]) seed++;
+        if (seed == triangleCount) break;
+        int meshlet = (int)meshlets.size();
+        Meshlet current{};
+        current.firstIndex = (unsigned int)ordered.size();
+        meshletVertices.clear();
+        size_t triangle = seed;
+        for (unsigned int triangleNumber = 1; ; triangleNumber++) {
+            // Append triangle
+            emitted[triangle] = true;
+            for (int k = 0; k < 3; k++) {
+                unsigned int vertex = indices[triangle * 3 + k];
+                ordered.push_back(vertex);
+                if (vertexMeshlets[vertex] != meshlet) {
+                    vertexMeshlets[vertex] = meshlet;
+                    meshletVertices.push_back(vertex);
+                }
+            }
+            if (triangleNumber == MODEL_MESHLET_MAXTRIANGLES) break;
+
+            // Pick the adjacent triangle adding the fewest vertices, stopping at the first one adding none
+            size_t best = triangleCount;
+            unsigned int bestNewVertices = 3;
+            for (size_t v = 0; v < meshletVertices.size() && bestNewVertices > 0; v++) {
+                unsigned int vertex = meshletVertices[v];
+                for (unsigned int t = firstTriangles[vertex]; t < firstTriangles[vertex + 1]; t++) {
+                    unsigned int candidate = vertexTriangles[t];
+                    if (emitted[candidate]) continue;
+                    unsigned int newVertices = 0;
+                    for (int k = 0; k < 3; k++)
+                        newVertices += vertexMeshlets[indices[candidate * 3 + k]] != meshlet;
+                    if (meshletVertices.size() + newVertices > MODEL_MESHLET_MAXVERTICES) continue;
+                    if (best == triangleCount || newVertices < bestNewVertices) {
+                        best = candidate;
+                        bestNewVertices = newVertices;
+                        if (bestNewVertices == 0) break;
+                    }
+                }
+            }
+            if (best == triangleCount) break;
+            triangle = best;
+        }
+        current.indexCount = (unsigned int)ordered.size() - current.firstIndex;
+        meshlets.push_back(current);
+    }
+
+    // Indices left over by non-triangle faces are kept at the end, out of every meshlet
+    ordered.insert(ordered.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(ordered);
+
+    // 4) Bound meshlets
+    for (Meshlet &meshlet : meshlets) {
+        glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+        glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+        glm::vec3 normalSum{ 0.0f };
+        for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+            const glm::vec3 &a = vertices[indices[i]].position;
+            const glm::vec3 &b = vertices[indices[i + 1]].position;
+            const glm::vec3 &c = vertices[indices[i + 2]].position;
+            boundsMin = glm::min(boundsMin, glm::min(a, glm::min(b, c)));
+            boundsMax = glm::max(boundsMax, glm::max(a, glm::max(b, c)));
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) normalSum += normal / length;
+        }
+        meshlet.center = (boundsMin + boundsMax) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+            meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+
+        // The cone's half-angle reaches the normal farthest from the axis
+        // Past 90 degrees, some triangle faces any viewpoint, and the meshlet is never dropped.
+        float normalSumLength = glm::length(normalSum);
+        meshlet.coneAxis = normalSumLength > 0.0f ? normalSum / normalSumLength : glm::vec3{ 0.0f, 0.0f, 1.0f };
+        meshlet.coneCutoff = 1.0f;
+        if (normalSumLength > 0.0f) {
+            float minDot = 1.0f;
+            for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+                const glm::vec3 &a = vertices[indices[i]].position;
+                glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+                float length = glm::length(normal);
+                if (length > 0.0f) minDot = glm::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+            }
+            if (minDot > 0.1f) meshlet.coneCutoff = glm::sqrt(1.0f - minDot * minDot);
+        }
+    }
+}
+
+void Model::computeBounds() {
+    // The box of the model encloses the ones of its meshes, and its sphere, centered on the box, encloses their spheres
+    // The radius is capped by the half-diagonal of the box, which encloses every vertex as well.
+    m_bounds.min = glm::vec3{ std::numeric_limits<float>::max() };
+    m_bounds.max = glm::vec3{ std::numeric_limits<float>::lowest() };
+    for (const Mesh &mesh : m_meshes) {
+        m_bounds.min = glm::min(m_bounds.min, mesh.getBounds().min);
+        m_bounds.max = glm::max(m_bounds.max, mesh.getBounds().max);
+    }
+    if (m_meshes.empty()) m_bounds.min = m_bounds.max = glm::vec3{ 0.0f };
+    m_bounds.center = (m_bounds.min + m_bounds.max) * 0.5f;
+    m_bounds.radius = 0.0f;
+    for (const Mesh &mesh : m_meshes)
+        m_bounds.radius = glm::max(m_bounds.radius, glm::length(mesh.getBounds().center - m_bounds.center) + mesh.getBounds().radius);
+    m_bounds.radius = glm::min(m_bounds.radius, glm::length(m_bounds.max - m_bounds.center));
 }
\ No newline at end of file
@@ -29,16 +29,21 @@ class Model {
 
         // --- Public methods
         void setup(const aiScene *scene);
-        void buildMeshLists(unsigned int *vaoList, int *indicesNumberList);
+        void buildMeshLists(unsigned int *firstIndexList, int *baseVertexList, int *indicesNumberList);
         int getMeshesNumber();
+        const BoundingVolume &getBounds() const;
+        const std::vector<Mesh> &getMeshes() const;
 
 private:
     // --- Private members
     std::vector<Mesh> m_meshes;
+    BoundingVolume m_bounds;
 
     // --- Private methods
     void processNode(aiNode* node, const aiScene* scene);
     Mesh processMesh(aiMesh* mesh);
+    void buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<Meshlet> &meshlets);
+    void computeBounds();
 };
 
 
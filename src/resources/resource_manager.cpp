@@ -5,6 +5,7 @@
 
 #include <stb_image.h>
 
+#include "rendering/state_cache.hpp"
 #include "resources/resource_manager.hpp"
 
 
@@ -12,6 +13,7 @@
 std::map<std::string, Model> ResourceManager::s_models;
 std::map<std::string, Shader> ResourceManager::s_shaders;
 std::map<std::string, Texture> ResourceManager::s_textures;
+unsigned int ResourceManager::s_modelsVersion{ 0 };
 
 
 // --- Public static methods
@@ -29,64 +31,56 @@ Model *ResourceManager::loadModel(std::string path) {
 	// Store and return
 	s_models[path] = Model{};
 	s_models[path].setup(scene);
+	s_modelsVersion++;
 	return &s_models[path];
 }
 
-Shader *ResourceManager::loadShader(std::string name, std::string vertexPath, std::string fragmentPath, std::string geometryPath) {
-	// Convert strings into arrays of characters
-	const char *cVertexPath = vertexPath.c_str();
-	const char *cFragmentPath = fragmentPath.c_str();
-	const char *cGeometryPath = geometryPath == "" ? nullptr : geometryPath.c_str();
-
-	// Read shader files
-	std::string vertexCode;
-    std::string fragmentCode;
-	std::string geometryCode;
-	try {
-		// Open files
-		std::ifstream vertexFile(cVertexPath);
-		std::ifstream fragmentFile(cFragmentPath);
-		std::stringstream vertexStream, fragmentStream;
-		
-		// Put buffers into streams
-		vertexStream << vertexFile.rdbuf();
-		fragmentStream << fragmentFile.rdbuf();
-		
-		// Close file handlers
-		vertexFile.close();
-		fragmentFile.close();
-		
-		// Convert stream into string
-		vertexCode = vertexStream.str();
-		fragmentCode = fragmentStream.str();
-		
-		// Handle geometry shaders
-		if (cGeometryPath != nullptr) {
-			std::ifstream geometryFile(cGeometryPath);
-			std::stringstream geometryStream;
-			geometryStream << geometryFile.rdbuf();
-			geometryFile.close();
-			geometryCode = geometryStream.str();
-		}
-	} catch (std::exception e) {
-		std::cout << "ERROR::SHADER: failed to read shader files\n"; // better error messages whould be appreciated (state which file caused issues)
-	}
+Shader *ResourceManager::loadShader(std::string name, std::string vertexPath, std::string fragmentPath, std::string geometryPath, const std::vector<std::string> &defines) {
+	// Every permutation is cached under its own key, made of the name and its defines: e.g. "gBufferShader#DEPTH_PEELING"
+	std::string key = name;
+	for (const std::string &define : defines) key += "#" + define;
+	auto cached = s_shaders.find(key);
+	if (cached != s_shaders.end()) return &cached->second;
+
+	// Read shader files, specializing them with the permutation's defines
+	std::string vertexCode = readShaderSource(vertexPath);
+	std::string fragmentCode = readShaderSource(fragmentPath);
+	std::string geometryCode = geometryPath == "" ? "" : readShaderSource(geometryPath);
+	injectDefines(vertexCode, defines);
+	injectDefines(fragmentCode, defines);
+	injectDefines(geometryCode, defines);
 	
 	// Compile shader program from source files
 	const char *cVertexCode = vertexCode.c_str();
 	const char *cFragmentCode = fragmentCode.c_str();
 	const char *cGeometryCode = geometryCode.c_str();
 	Shader shader;
-	shader.compile(cVertexCode, cFragmentCode, cGeometryPath != nullptr ? cGeometryCode : nullptr);
+	shader.compile(key.c_str(), cVertexCode, cFragmentCode, geometryPath != "" ? cGeometryCode : nullptr);
 
-	// Setup subroutines
-	shader.setupSubroutines(GL_VERTEX_SHADER);
-	shader.setupSubroutines(GL_FRAGMENT_SHADER);
-	if (cGeometryPath != nullptr) shader.setupSubroutines(GL_GEOMETRY_SHADER);
+	// Store and return
+	s_shaders[key] = shader;
+	return &s_shaders[key];
+}
+
+Shader *ResourceManager::loadComputeShader(std::string name, std::string computePath, const std::vector<std::string> &defines) {
+	// Permutations are cached as in loadShader
+	std::string key = name;
+	for (const std::string &define : defines) key += "#" + define;
+	auto cached = s_shaders.find(key);
+	if (cached != s_shaders.end()) return &cached->second;
+
+	// Read shader file, specializing it with the permutation's defines
+	std::string computeCode = readShaderSource(computePath);
+	injectDefines(computeCode, defines);
+
+	// Compile compute program from source file
+	const char *cComputeCode = computeCode.c_str();
+	Shader shader;
+	shader.compileCompute(key.c_str(), cComputeCode);
 
 	// Store and return
-	s_shaders[name] = shader;
-	return &s_shaders[name];
+	s_shaders[key] = shader;
+	return &s_shaders[key];
 }
 
 Texture *ResourceManager::loadTexture(std::string path) {
@@ -127,14 +121,58 @@ Texture *ResourceManager::getTexture(std::string path) {
 	return &s_textures[path];
 }
 
+unsigned int ResourceManager::getModelsVersion() {
+	return s_modelsVersion;
+}
+
 void ResourceManager::clear() {
 	// Clear shaders
 	for (std::pair<const std::string, Shader> iter : s_shaders)
-		glDeleteProgram(iter.second.getID());
+		StateCache::deleteProgram(iter.second.getID());
 	
 	// Clear textures
-	for (std::pair<const std::string, Texture> iter : s_textures) {
-		unsigned int id{iter.second.getID()};
-		glDeleteTextures(1, &id);
+	for (std::pair<const std::string, Texture> iter : s_textures)
+		StateCache::deleteTexture(iter.second.getID());
+}
+
+
+// --- Private static methods
+std::string ResourceManager::readShaderSource(std::string path) {
+	// Open file
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cout << "ERROR::SHADER: failed to read shader file \"" << path << "\"\n";
+		return "";
 	}
-}
\ No newline at end of file
+
+	// Read file line by line, expanding #include "file" directives
+	// Included paths are relative to the directory of the including file.
+	std::string directory = path.substr(0, path.find_last_of('/') + 1);
+	std::stringstream source;
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t directive = line.find("#include");
+		if (directive != std::string::npos && directive == line.find_first_not_of(" \t")) {
+			size_t begin = line.find('"', directive);
+			size_t end = begin == std::string::npos ? std::string::npos : line.find('"', begin + 1);
+			if (end != std::string::npos) {
+				source << readShaderSource(directory + line.substr(begin + 1, end - begin - 1));
+				continue;
+			}
+		}
+		source << line << "\n";
+	}
+	file.close();
+	return source.str();
+}
+
+void ResourceManager::injectDefines(std::string &source, const std::vector<std::string> &defines) {
+	// Defines go right after the #version line, which must come first in GLSL
+	if (defines.empty()) return;
+	size_t version = source.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	size_t position = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+	std::string block;
+	for (const std::string &define : defines) block += "#define " + define + "\n";
+	source.insert(position, block);
+}
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -16,21 +17,28 @@ class ResourceManager {
 	public:
 		// --- Public static methods
 		static Model *loadModel(std::string path);
-		static Shader *loadShader(std::string name, std::string vertexPath, std::string fragmentPath, std::string geometryPath = "");
+		static Shader *loadShader(std::string name, std::string vertexPath, std::string fragmentPath, std::string geometryPath = "", const std::vector<std::string> &defines = {});
+		static Shader *loadComputeShader(std::string name, std::string computePath, const std::vector<std::string> &defines = {});
 		static Texture *loadTexture(std::string path);
 		static Model *getModel(std::string path);
 		static Shader *getShader(std::string name);
 		static Texture *getTexture(std::string path);
+		static unsigned int getModelsVersion();
 		static void clear();
 	
 	private:
 		// --- Private constructor
 		ResourceManager() { }
+
+		// --- Private static methods
+		static std::string readShaderSource(std::string path);
+		static void injectDefines(std::string &source, const std::vector<std::string> &defines);
 		
 		// --- Private static members 
 		static std::map<std::string, Model> s_models;
 		static std::map<std::string, Shader> s_shaders;
 		static std::map<std::string, Texture> s_textures;
+		static unsigned int s_modelsVersion;
 };
 
 
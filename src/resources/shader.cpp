@@ -1,42 +1,31 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <stdlib.h>
 #include <string>
-#include <utility>
+#include <vector>
 
 #include <glad/glad.h>
 
 #include "resources/shader.hpp"
+#include "rendering/state_cache.hpp"
 
 
-// --- Constructor and destructor
+// --- Constructor
 Shader::Shader() :
 	m_id{0},
-	m_subroutineConfigurationVertex{ nullptr },
-	m_subroutineConfigurationFragment{ nullptr },
-	m_subroutineConfigurationGeometry{ nullptr },
-	m_subroutineUniformsVertex{},
-	m_subroutineUniformsFragment{},
-	m_subroutineUniformsGeometry{},
-	m_subroutinesVertex{},
-	m_subroutinesFragment{},
-	m_subroutinesGeometry{} {
+	m_uniforms{},
+	m_blocks{} {
 	// ---
 }
 
-Shader::~Shader() {
-	delete(m_subroutineConfigurationVertex);
-	delete(m_subroutineConfigurationFragment);
-	delete(m_subroutineConfigurationGeometry);
-}
-
 
 // --- Public methods
 Shader *Shader::use() {
-	glUseProgram(m_id);
+	StateCache::useProgram(m_id);
 	return this;
 }
 
-void Shader::compile(const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
+void Shader::compile(const char *name, const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
 	unsigned int sVertex, sFragment, sGeometry;
 	
 	// Vertex shader
@@ -73,179 +62,201 @@ void Shader::compile(const char* vertexSource, const char* fragmentSource, const
 	glDeleteShader(sFragment);
 	if(geometrySource != nullptr)
 		glDeleteShader(sGeometry);
+
+	// Reflect active resources
+	reflect(name);
+}
+
+void Shader::compileCompute(const char *name, const char* computeSource) {
+	// Compute shader
+	unsigned int sCompute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(sCompute, 1, &computeSource, NULL);
+	glCompileShader(sCompute);
+	checkCompileErrors(sCompute, SHADER_ERROR_COMPUTE);
+
+	// Shader program
+	this->m_id = glCreateProgram();
+	glAttachShader(m_id, sCompute);
+	glLinkProgram(m_id);
+	checkCompileErrors(m_id, SHADER_ERROR_PROGRAM);
+
+	// Delete shader object
+	glDeleteShader(sCompute);
+
+	// Reflect active resources
+	reflect(name);
 }
 
 void Shader::setFloat(const char *name, float value) {
-	glUniform1f(glGetUniformLocation(m_id, name), value);
+	upload(findUniform(hashShaderName(name)), value);
 }
 
 void Shader::setInteger(const char *name, int value) {
-	glUniform1i(glGetUniformLocation(m_id, name), value);
+	upload(findUniform(hashShaderName(name)), value);
 }
 
 void Shader::setVector2(const char *name, float x, float y) {
-	glUniform2f(glGetUniformLocation(m_id, name), x, y);
+	upload(findUniform(hashShaderName(name)), glm::vec2{ x, y });
 }
 
 void Shader::setVector2(const char *name, const glm::vec2 &value) {
-	glUniform2f(glGetUniformLocation(m_id, name), value.x, value.y);
+	upload(findUniform(hashShaderName(name)), value);
 }
 
 void Shader::setVector3(const char *name, float x, float y, float z) {
-	glUniform3f(glGetUniformLocation(m_id, name), x, y, z);
+	upload(findUniform(hashShaderName(name)), glm::vec3{ x, y, z });
 }
 
 void Shader::setVector3(const char *name, const glm::vec3 &value) {
-	glUniform3f(glGetUniformLocation(m_id, name), value.x, value.y, value.z);
+	upload(findUniform(hashShaderName(name)), value);
 }
 
 void Shader::setVector4(const char *name, float x, float y, float z, float w) {
-	glUniform4f(glGetUniformLocation(m_id, name), x, y, z, w);
+	upload(findUniform(hashShaderName(name)), glm::vec4{ x, y, z, w });
 }
 
 void Shader::setVector4(const char *name, const glm::vec4 &value) {
-	glUniform4f(glGetUniformLocation(m_id, name), value.x, value.y, value.z, value.w);
+	upload(findUniform(hashShaderName(name)), value);
 }
 
 void Shader::setMatrix3(const char *name, const glm::mat3 &matrix) {
-	glUniformMatrix3fv(glGetUniformLocation(m_id, name), 1, false, glm::value_ptr(matrix));
+	upload(findUniform(hashShaderName(name)), matrix);
 }
 
 void Shader::setMatrix4(const char *name, const glm::mat4 &matrix) {
-	glUniformMatrix4fv(glGetUniformLocation(m_id, name), 1, false, glm::value_ptr(matrix));
+	upload(findUniform(hashShaderName(name)), matrix);
 }
 
-void Shader::setupSubroutines(GLenum shadertype) {
-	// SOURCES: https://stackoverflow.com/questions/18498767/multiple-subroutine-types-defined-in-the-same-fragment-shader-does-not-work-corr
-	//			https://www.khronos.org/opengl/wiki/Program_Introspection#Interface_query
-	// Initialize
-	int len;
-	bool canAllocate = false;
-	GLenum programInterface;
-	GLenum subroutineInterface;
-	//std::cout << "Program ID: " << m_id << "    Shader stage: ";
-	if (shadertype == GL_VERTEX_SHADER) {
-		programInterface = GL_VERTEX_SUBROUTINE_UNIFORM;
-		subroutineInterface = GL_VERTEX_SUBROUTINE;
-		//std::cout << "VERTEX\n";
-	} else if (shadertype == GL_FRAGMENT_SHADER) {
-		programInterface = GL_FRAGMENT_SUBROUTINE_UNIFORM;
-		subroutineInterface = GL_FRAGMENT_SUBROUTINE;
-		//std::cout << "FRAGMENT\n";
-	} else if (shadertype == GL_GEOMETRY_SHADER) {
-		programInterface = GL_GEOMETRY_SUBROUTINE_UNIFORM;
-		subroutineInterface = GL_GEOMETRY_SUBROUTINE;
-		//std::cout << "GEOMETRY\n";
-	}
+unsigned int Shader::getID() {
+	return m_id;
+}
+
+int Shader::getBlockBinding(uint32_t nameHash) {
+	const ShaderResource *block = findResource(m_blocks, nameHash);
+	return block != nullptr ? (int)block->index : -1;
+}
 
-	// Get subroutine uniforms number for this shader stage
-	int subUniNum;
-	glGetProgramInterfaceiv(m_id, programInterface, GL_ACTIVE_RESOURCES, &subUniNum);
-	//std::cout << "Subroutine Uniforms found: " << subUniNum << "\n";
-
-	// Abort if no subroutine uniforms are found
-	if (subUniNum <= 0) return;
-
-	// Initialize string buffer for subroutine uniforms
-	int maxSubUniNameLength;
-	glGetProgramInterfaceiv(m_id, programInterface, GL_MAX_NAME_LENGTH, &maxSubUniNameLength);
-	char *strbufSubUni = new char[maxSubUniNameLength];
-
-	// Iterate through subroutine uniforms
-	for (unsigned int i = 0; i < subUniNum; i++) {
-		// Get name of subroutine uniform at index i
-		glGetProgramResourceName(m_id, programInterface, i, maxSubUniNameLength, &len, strbufSubUni);
-		std::pair<std::string, unsigned int> uniformPair = std::pair<std::string, unsigned int>{std::string{strbufSubUni}, i};
-		if      (shadertype == GL_VERTEX_SHADER)   m_subroutineUniformsVertex.insert(uniformPair);
-		else if (shadertype == GL_FRAGMENT_SHADER) m_subroutineUniformsFragment.insert(uniformPair);
-		else if (shadertype == GL_GEOMETRY_SHADER) m_subroutineUniformsGeometry.insert(uniformPair);
-		//std::cout << "Subroutine Uniform #" << i << ": " << std::string{strbufSubUni} << "\n";
-
-		// Get number of subroutines for the subroutine uniform at index i
-		int subNum;
-		glGetProgramInterfaceiv(m_id, subroutineInterface, GL_ACTIVE_RESOURCES, &subNum);
-		//std::cout << "Subroutines found: " << subNum << "\n";
-
-		// Initialize string buffer for subroutine uniforms
-		int maxSubNameLength;
-		glGetProgramInterfaceiv(m_id, subroutineInterface, GL_MAX_NAME_LENGTH, &maxSubNameLength);
-		char *strbufSub = new char[maxSubNameLength];
-		
-		// Get names of subroutines for the subroutine uniform at index i
-		for (unsigned int j = 0; j < subNum; j++) {
-			glGetProgramResourceName(m_id, subroutineInterface, j, maxSubNameLength, &len, strbufSub);
-			std::pair<std::string, unsigned int> functionPair = std::pair<std::string, unsigned int>{std::string{strbufSub}, j};
-			if      (shadertype == GL_VERTEX_SHADER)   m_subroutinesVertex.insert(functionPair);
-			else if (shadertype == GL_FRAGMENT_SHADER) m_subroutinesFragment.insert(functionPair);
-			else if (shadertype == GL_GEOMETRY_SHADER) m_subroutinesGeometry.insert(functionPair);
-			//std::cout << "Subroutine #" << j << ": " << std::string{strbufSub} << "\n";
-		}
 
-		// Deallocate resources for subroutine functions
-		delete[] strbufSub;
+// --- Private methods
+void Shader::reflect(const char *shaderName) {
+	// How reflection works:
+	//      1) Every active uniform of the default block is stored with its location, keyed by the hash of its name;
+	//         uniforms inside blocks have no location, and are skipped;
+	//      2) Every uniform and shader storage block is stored with its binding point;
+	//      3) Tables are sorted by hash, so that handles are resolved by binary search; two names sharing a hash would
+	//         alias each other silently, so collisions are reported here.
+	// Names are never read again after this.
+	//
+	// SOURCE: https://www.khronos.org/opengl/wiki/Program_Introspection#Interface_query
+	int count, maxNameLength;
+	GLenum property = GL_LOCATION;
+	glGetProgramInterfaceiv(m_id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(m_id, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+	std::vector<char> name(maxNameLength + 1);
+	std::vector<std::pair<uint32_t, std::string>> names;
+	m_uniforms.clear();
+	for (int i = 0; i < count; i++) {
+		int location;
+		glGetProgramResourceiv(m_id, GL_UNIFORM, i, 1, &property, 1, NULL, &location);
+		if (location < 0) continue;
+
+		// Arrays are reported as "name[0]", but set by their name
+		int length;
+		glGetProgramResourceName(m_id, GL_UNIFORM, i, (GLsizei)name.size(), &length, name.data());
+		if (length > 3 && std::strcmp(&name[length - 3], "[0]") == 0) name[length - 3] = '\0';
+		ShaderUniform uniform{};
+		uniform.hash = hashShaderName(name.data());
+		uniform.location = location;
+		m_uniforms.push_back(uniform);
+		names.emplace_back(uniform.hash, name.data());
 	}
+	std::sort(m_uniforms.begin(), m_uniforms.end(), [](const ShaderUniform &a, const ShaderUniform &b) { return a.hash < b.hash; });
+	checkHashCollisions(shaderName, names);
+
+	// Blocks
+	GLenum blockInterfaces[2] = { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK };
+	property = GL_BUFFER_BINDING;
+	names.clear();
+	m_blocks.clear();
+	for (int b = 0; b < 2; b++) {
+		glGetProgramInterfaceiv(m_id, blockInterfaces[b], GL_ACTIVE_RESOURCES, &count);
+		glGetProgramInterfaceiv(m_id, blockInterfaces[b], GL_MAX_NAME_LENGTH, &maxNameLength);
+		name.resize(maxNameLength + 1);
+		for (int i = 0; i < count; i++) {
+			int binding;
+			glGetProgramResourceiv(m_id, blockInterfaces[b], i, 1, &property, 1, NULL, &binding);
+			glGetProgramResourceName(m_id, blockInterfaces[b], i, (GLsizei)name.size(), NULL, name.data());
+			m_blocks.push_back(ShaderResource{ hashShaderName(name.data()), (unsigned int)binding });
+			names.emplace_back(m_blocks.back().hash, name.data());
+		}
+	}
+	std::sort(m_blocks.begin(), m_blocks.end(), [](const ShaderResource &a, const ShaderResource &b) { return a.hash < b.hash; });
+	checkHashCollisions(shaderName, names);
+}
 
-	// Deallocate string buffer
-	delete[] strbufSubUni;
+void Shader::checkHashCollisions(const char *shaderName, std::vector<std::pair<uint32_t, std::string>> &names) {
+	std::sort(names.begin(), names.end());
+	for (size_t i = 1; i < names.size(); i++)
+		if (names[i].first == names[i - 1].first)
+			std::cout << "ERROR::SHADER: name hash collision in \"" << shaderName << "\": \"" << names[i - 1].second << "\" and \"" << names[i].second << "\"\n";
+}
 
-	// Allocate resources for subroutines' configurations
-	if      (shadertype == GL_VERTEX_SHADER)   m_subroutineConfigurationVertex = (unsigned int*) calloc(m_subroutinesVertex.size(), sizeof(unsigned int));
-	else if (shadertype == GL_FRAGMENT_SHADER) m_subroutineConfigurationFragment = (unsigned int*) calloc(m_subroutinesFragment.size(), sizeof(unsigned int));
-	else if (shadertype == GL_GEOMETRY_SHADER) m_subroutineConfigurationGeometry = (unsigned int*) calloc(m_subroutinesGeometry.size(), sizeof(unsigned int));
+int Shader::findUniform(uint32_t nameHash) {
+	auto iter = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), nameHash, [](const ShaderUniform &uniform, uint32_t hash) { return uniform.hash < hash; });
+	return iter != m_uniforms.end() && iter->hash == nameHash ? (int)(iter - m_uniforms.begin()) : -1;
 }
 
-void Shader::setSubroutineUniform(GLenum shadertype, std::string uniformName, std::string subroutineName) {
-	/*
-	 *
-	 * WARNING: NOT VERY SAFE! YOU NEED TO TWEAK THE CRAP OUT OF IT.
-	 * 
-	 */
-
-	unsigned int uniformIndex;
-	unsigned int subroutineIndex;
-	switch(shadertype) {
-		default:
-			break;
-		case GL_VERTEX_SHADER:
-			uniformIndex = m_subroutineUniformsVertex.find(uniformName)->second;
-			subroutineIndex = m_subroutinesVertex.find(subroutineName)->second;
-			m_subroutineConfigurationVertex[uniformIndex] = subroutineIndex;
-			break;
-		case GL_FRAGMENT_SHADER:
-			uniformIndex = m_subroutineUniformsFragment.find(uniformName)->second;
-			subroutineIndex = m_subroutinesFragment.find(subroutineName)->second;
-			m_subroutineConfigurationFragment[uniformIndex] = subroutineIndex;
-			break;
-		case GL_GEOMETRY_SHADER:
-			uniformIndex = m_subroutineUniformsGeometry.find(uniformName)->second;
-			subroutineIndex = m_subroutinesGeometry.find(subroutineName)->second;
-			m_subroutineConfigurationGeometry[uniformIndex] = subroutineIndex;
-			break;
-	}
+const ShaderResource *Shader::findResource(const std::vector<ShaderResource> &resources, uint32_t nameHash) {
+	auto iter = std::lower_bound(resources.begin(), resources.end(), nameHash, [](const ShaderResource &resource, uint32_t hash) { return resource.hash < hash; });
+	return iter != resources.end() && iter->hash == nameHash ? &(*iter) : nullptr;
 }
 
-void Shader::loadSubroutines(GLenum shadertype) {
-	unsigned int *config;
-	GLsizei count;
-	if (shadertype == GL_VERTEX_SHADER) {
-		config = m_subroutineConfigurationVertex;
-		count = m_subroutineUniformsVertex.size();
-	} else if (shadertype == GL_FRAGMENT_SHADER) {
-		config = m_subroutineConfigurationFragment;
-		count = m_subroutineUniformsFragment.size();
-	} else if (shadertype == GL_GEOMETRY_SHADER) {
-		config = m_subroutineConfigurationGeometry;
-		count = m_subroutineUniformsGeometry.size();
-	}
-	glUniformSubroutinesuiv(shadertype, count, (const GLuint*)config);
+bool Shader::cacheUniform(int slot, const void *value, size_t size) {
+	// Store the value, reporting whether it needs to be uploaded
+	// Values are set with glProgramUniform, so they stay valid whichever program is bound.
+	if (slot < 0) return false;
+	ShaderUniform &uniform = m_uniforms[slot];
+	if (uniform.isCached && std::memcmp(uniform.value, value, size) == 0) return false;
+	std::memcpy(uniform.value, value, size);
+	uniform.isCached = true;
+	return true;
 }
 
-unsigned int Shader::getID() {
-	return m_id;
+void Shader::upload(int slot, float value) {
+	if (cacheUniform(slot, &value, sizeof(value)))
+		glProgramUniform1f(m_id, m_uniforms[slot].location, value);
 }
 
+void Shader::upload(int slot, int value) {
+	if (cacheUniform(slot, &value, sizeof(value)))
+		glProgramUniform1i(m_id, m_uniforms[slot].location, value);
+}
+
+void Shader::upload(int slot, const glm::vec2 &value) {
+	if (cacheUniform(slot, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform2fv(m_id, m_uniforms[slot].location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int slot, const glm::vec3 &value) {
+	if (cacheUniform(slot, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform3fv(m_id, m_uniforms[slot].location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int slot, const glm::vec4 &value) {
+	if (cacheUniform(slot, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform4fv(m_id, m_uniforms[slot].location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int slot, const glm::mat3 &value) {
+	if (cacheUniform(slot, glm::value_ptr(value), sizeof(value)))
+		glProgramUniformMatrix3fv(m_id, m_uniforms[slot].location, 1, false, glm::value_ptr(value));
+}
+
+void Shader::upload(int slot, const glm::mat4 &value) {
+	if (cacheUniform(slot, glm::value_ptr(value), sizeof(value)))
+		glProgramUniformMatrix4fv(m_id, m_uniforms[slot].location, 1, false, glm::value_ptr(value));
+}
 
-// --- Private methods
 void Shader::checkCompileErrors(unsigned int object, ShaderError type) {
 	int success;
 	char infoLog[1024];
@@ -253,6 +264,7 @@ void Shader::checkCompileErrors(unsigned int object, ShaderError type) {
 		case SHADER_ERROR_VERTEX:
 		case SHADER_ERROR_FRAGMENT:
 		case SHADER_ERROR_GEOMETRY:
+		case SHADER_ERROR_COMPUTE:
 			glGetShaderiv(object, GL_COMPILE_STATUS, &success);
 			if (!success) {
 				glGetShaderInfoLog(object, 1024, NULL, infoLog);
@@ -284,6 +296,10 @@ std::string Shader::printShaderError(ShaderError type) {
 		case SHADER_ERROR_GEOMETRY:
 			r = "GEOMETRY";
 			break;
+
+		case SHADER_ERROR_COMPUTE:
+			r = "COMPUTE";
+			break;
 		
 		case SHADER_ERROR_PROGRAM:
 			r = "PROGRAM";
@@ -1,8 +1,10 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-#include <map>
+#include <cstdint>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -14,23 +16,60 @@ enum ShaderError {
 	SHADER_ERROR_VERTEX,
 	SHADER_ERROR_FRAGMENT,
 	SHADER_ERROR_GEOMETRY,
+	SHADER_ERROR_COMPUTE,
 	SHADER_ERROR_PROGRAM
 };
 
+/* Hash of a shader resource name (32-bit FNV-1a) */
+constexpr uint32_t hashShaderName(const char *name) {
+	uint32_t hash = 2166136261u;
+	while (*name != '\0') {
+		hash ^= (uint32_t)(unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Hash of a shader resource name, forced at compile-time */
+#define SHADER_NAME(name) (std::integral_constant<uint32_t, hashShaderName(name)>::value)
+
+/* Active uniform of the default block, found by reflection at link time */
+struct ShaderUniform {
+	uint32_t hash;
+	int location;
+	bool isCached;
+	unsigned char value[sizeof(glm::mat4)];	// Last uploaded value, to skip redundant uploads
+};
+
+/* Active uniform or shader storage block */
+struct ShaderResource {
+	uint32_t hash;
+	unsigned int index;	// Binding point
+};
+
+template <typename T>
+class UniformHandle;
+
 /* Shader class with utilities */
 class Shader {
-	public:		
-		// Constructor and destructor
+	public:
+		// Constructor
 		Shader();
-		~Shader();
-		
+
 		// Sets the shader as active
 		Shader *use();
-		
-		// Compiles the shader with the given source code
-		void compile(const char *vertexSource, const char *fragmentSource, const char *geometrySource = nullptr);
-		
-		// Uniform setters
+
+		// Compiles the shader with the given source code; the name is only used to report errors
+		void compile(const char *name, const char *vertexSource, const char *fragmentSource, const char *geometrySource = nullptr);
+
+		// Compiles the shader as a compute program with the given source code
+		void compileCompute(const char *name, const char *computeSource);
+
+		// Resolves a typed handle to a uniform, to be set with no string work; see SHADER_NAME
+		template <typename T>
+		UniformHandle<T> getUniform(uint32_t nameHash);
+
+		// Uniform setters, looking up the uniform by name on every call
 		void setFloat(const char *name, float value);
 		void setInteger(const char *name, int value);
 		void setVector2(const char *name, float x, float y);
@@ -41,39 +80,64 @@ class Shader {
 		void setVector4(const char *name, const glm::vec4 &value);
 		void setMatrix3(const char *name, const glm::mat3 &matrix);
 		void setMatrix4(const char *name, const glm::mat4 &matrix);
-		
-		// Subroutine management
-		void setupSubroutines(GLenum shadertype);
-		void setSubroutineUniform(GLenum shadertype, std::string uniformName, std::string subroutineName);
-		void loadSubroutines(GLenum shadertype);
 
 		// Getters
 		unsigned int getID();
-	
+		int getBlockBinding(uint32_t nameHash);
+
 	private:
+		template <typename T>
+		friend class UniformHandle;
+
 		// --- Private members
 		// Program ID
 		unsigned int m_id;
 
-		// Maps of subroutine uniforms, matching names with their index.
-		std::map<std::string, unsigned int> m_subroutineUniformsVertex;
-		std::map<std::string, unsigned int> m_subroutineUniformsFragment;
-		std::map<std::string, unsigned int> m_subroutineUniformsGeometry;
-
-		// Maps of subroutines, matching names with their index.
-		std::map<std::string, unsigned int> m_subroutinesVertex;
-		std::map<std::string, unsigned int> m_subroutinesFragment;
-		std::map<std::string, unsigned int> m_subroutinesGeometry;
-
-		// Current configurations of subroutines.
-		unsigned int *m_subroutineConfigurationVertex;
-		unsigned int *m_subroutineConfigurationFragment;
-		unsigned int *m_subroutineConfigurationGeometry;
-		
+		// Reflected resources, sorted by name hash
+		std::vector<ShaderUniform> m_uniforms;
+		std::vector<ShaderResource> m_blocks;
+
 		// --- Private methods
+		void reflect(const char *shaderName);
+		static void checkHashCollisions(const char *shaderName, std::vector<std::pair<uint32_t, std::string>> &names);
+		int findUniform(uint32_t nameHash);
+		static const ShaderResource *findResource(const std::vector<ShaderResource> &resources, uint32_t nameHash);
+		bool cacheUniform(int slot, const void *value, size_t size);
+		void upload(int slot, float value);
+		void upload(int slot, int value);
+		void upload(int slot, const glm::vec2 &value);
+		void upload(int slot, const glm::vec3 &value);
+		void upload(int slot, const glm::vec4 &value);
+		void upload(int slot, const glm::mat3 &value);
+		void upload(int slot, const glm::mat4 &value);
 		void checkCompileErrors(unsigned int object, ShaderError type);
 		std::string printShaderError(ShaderError type);
 };
 
+/* Typed handle to a uniform of a shader, resolved once */
+// Handles to uniforms which are not active are valid, and setting them does nothing.
+template <typename T>
+class UniformHandle {
+	public:
+		// Constructors
+		UniformHandle() : m_shader{ nullptr }, m_slot{ -1 } { }
+		UniformHandle(Shader *shader, int slot) : m_shader{ shader }, m_slot{ slot } { }
+
+		// Uploads the value, unless it matches the last one uploaded
+		void set(const T &value) {
+			if (m_slot >= 0) m_shader->upload(m_slot, value);
+		}
+
+	private:
+		// --- Private members
+		Shader *m_shader;
+		int m_slot;
+};
+
+template <typename T>
+UniformHandle<T> Shader::getUniform(uint32_t nameHash) {
+	return UniformHandle<T>{ this, findUniform(nameHash) };
+}
+
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 
 #include "texture.hpp"
+#include "rendering/state_cache.hpp"
 
 
 /* CONSTRUCTOR */
@@ -19,7 +20,7 @@ void Texture::generate(unsigned int width, unsigned int height, unsigned char* d
 		m_height = height;
 
 		// Create texture object
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 		glTexImage2D(GL_TEXTURE_2D, 0, m_textureFormat, width, height, 0, m_loadedFormat, GL_UNSIGNED_BYTE, data);
 
 		// Set texture filering and wrapping modes
@@ -29,7 +30,7 @@ void Texture::generate(unsigned int width, unsigned int height, unsigned char* d
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_filterMag);
 
 		// Unbind
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 
 		// State that the texture has been generated
 		m_generatedTexture = true;
@@ -39,31 +40,23 @@ void Texture::generate(unsigned int width, unsigned int height, unsigned char* d
 void Texture::generateMipmaps() {
 	if (m_generatedTexture && !m_generatedMipmaps) {
 		// Bind to GL_TEXTURE_2D target
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 
 		// Generate mipmaps
 		glGenerateMipmap(GL_TEXTURE_2D);
 
 		// Unbind
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 
 		// State that the mipmaps have been generated
 		m_generatedMipmaps = true;
 	}
 }
 
-void Texture::bind() const {
-    glBindTexture(GL_TEXTURE_2D, m_id);
+void Texture::bind(unsigned int unit) const {
+    StateCache::bindTexture(unit, GL_TEXTURE_2D, m_id);
 }
 
-/*void Texture::bind(unsigned int unit) const {
-	int maxTextureImageUnits;
-	glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxTextureImageUnits);
-	if (0 <= unit && unit < maxTextureImageUnits)
-		glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, m_id);
-}*/
-
 unsigned int Texture::getID() {
 	return m_id;
 }
@@ -103,35 +96,35 @@ unsigned int Texture::getFilterMag() {
 void Texture::setWrapS(int wrapS) {
 	m_wrapS = wrapS;
 	if (m_generatedTexture) {
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 	}
 }
 
 void Texture::setWrapT(int wrapT) {
 	m_wrapT = wrapT;
 	if (m_generatedTexture) {
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 	}
 }
 
 void Texture::setFilterMin(int filterMin) {
 	m_filterMin = filterMin;
 	if (m_generatedTexture) {
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterMin);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 	}
 }
 
 void Texture::setFilterMag(int filterMag) {
 	m_filterMag = filterMag;
 	if (m_generatedTexture) {
-		glBindTexture(GL_TEXTURE_2D, m_id);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, m_id);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filterMag);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::bindTexture(0, GL_TEXTURE_2D, 0);
 	}
 }
\ No newline at end of file
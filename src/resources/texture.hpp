@@ -14,11 +14,8 @@ class Texture {
 		// Generates mipmaps from texture object
 		void generateMipmaps();
 		
-		// Bind texture object to GL_TEXTURE_2D target
-		void bind() const;
-		
-		// Bind texture object to GL_TEXTURE_2D target and activate the specified texture unit
-		//void bind(unsigned int unit) const;
+		// Bind texture object to GL_TEXTURE_2D target of the specified texture unit
+		void bind(unsigned int unit = 0) const;
 		
 		// Getters
 		unsigned int getID();
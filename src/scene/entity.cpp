@@ -1,6 +1,7 @@
 // Written by Luigi Rapetta, 2022.
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "scene/entity.hpp"
 #include "rendering/material_manager.hpp"
@@ -30,6 +31,32 @@ glm::vec3 Entity::getRotation() {
     return m_rotation;
 }
 
+glm::mat4 Entity::getModelMatrix() {
+    // Rotations are applied around x, then y, then z
+    // This is the only place composing model matrices: rendering (TransformStage) and culling bounds both use it.
+    glm::mat4 model = glm::translate(glm::mat4{ 1.0f }, m_position);
+    model = glm::rotate(model, glm::radians(m_rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(m_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(m_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    return model;
+}
+
+void Entity::getWorldBounds(glm::vec3 &center, glm::vec3 &extents) {
+    // World-space box enclosing the model's box: rotated entities carry its center along, and grow its extents
+    const BoundingVolume &bounds = m_model->getBounds();
+    center = bounds.center;
+    extents = (bounds.max - bounds.min) * 0.5f;
+    if (m_rotation != glm::vec3{ 0.0f }) {
+        glm::mat3 rotationMatrix{ getModelMatrix() };
+        glm::mat3 absRotationMatrix;
+        for (int c = 0; c < 3; c++)
+            absRotationMatrix[c] = glm::abs(rotationMatrix[c]);
+        center = rotationMatrix * center;
+        extents = absRotationMatrix * extents;
+    }
+    center += m_position;
+}
+
 void Entity::setMaterial(Material *material) {
     if (material == NULL) return;
     MaterialManager::assignMaterial(material, this);
@@ -21,6 +21,8 @@ class Entity {
         Material *getMaterial();
         glm::vec3 getPosition();
         glm::vec3 getRotation();
+        glm::mat4 getModelMatrix();
+        void getWorldBounds(glm::vec3 &center, glm::vec3 &extents);
         void setMaterial(Material *material);
 
     private:
@@ -8,6 +8,7 @@
 std::list<Entity> EntityManager::s_entities;
 std::vector<Entity*> EntityManager::s_opaqueEntities{};
 std::vector<Entity*> EntityManager::s_transparentEntities{};
+unsigned int EntityManager::s_version{ 0 };
 
 
 // --- Public static functions
@@ -18,6 +19,7 @@ Entity *EntityManager::newEntity(Model *model, Material *material, glm::vec3 pos
     if (material->diffuse.a < 1.f) s_transparentEntities.push_back(entPointer);
     else s_opaqueEntities.push_back(entPointer);
     entPointer->setMaterial(material);
+    markChanged();
     return entPointer;
 }
 
@@ -47,11 +49,21 @@ void EntityManager::setEntityTransparency(Entity *entity, bool isTransparent) {
     // Add entity to correct vector
     if (isTransparent) s_transparentEntities.push_back(entity);
     else s_opaqueEntities.push_back(entity);
+    markChanged();
+}
+
+void EntityManager::markChanged() {
+    // Consumers caching data built from entities (e.g. the renderer's queue) compare versions to detect changes
+    s_version++;
+}
 
+unsigned int EntityManager::getVersion() {
+    return s_version;
 }
 
 void EntityManager::clear() {
     s_entities.clear();
     s_opaqueEntities.clear();
     s_transparentEntities.clear();
+    markChanged();
 }
\ No newline at end of file
@@ -22,6 +22,8 @@ class EntityManager {
         static std::vector<Entity*> *getOpaqueEntities();
         static std::vector<Entity*> *getTransparentEntities();
         static void setEntityTransparency(Entity *entity, bool isTransparent);
+        static void markChanged();
+        static unsigned int getVersion();
         static void clear();
 
     private:
@@ -32,6 +34,7 @@ class EntityManager {
         static std::list<Entity> s_entities;
         static std::vector<Entity*> s_opaqueEntities;
         static std::vector<Entity*> s_transparentEntities;
+        static unsigned int s_version;
 };
 
 
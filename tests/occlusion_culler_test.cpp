@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "consts.hpp"
+#include "rendering/occlusion_culler.hpp"
+
+
+// --- Scene
+// The camera sits at the origin, looking down -z. A 4x4 quad faces it at z = -5, made of two triangles split along
+// its diagonal y = x.
+static std::vector<Vertex> quadVertices() {
+    std::vector<Vertex> vertices(4, Vertex{});
+    vertices[0].position = glm::vec3{ -2.0f, -2.0f, -5.0f };
+    vertices[1].position = glm::vec3{ 2.0f, -2.0f, -5.0f };
+    vertices[2].position = glm::vec3{ 2.0f, 2.0f, -5.0f };
+    vertices[3].position = glm::vec3{ -2.0f, 2.0f, -5.0f };
+    return vertices;
+}
+
+static glm::mat4 viewProjection() {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, CAMERA_DEFAULT_ZNEAR, CAMERA_DEFAULT_ZFAR);
+    glm::mat4 view = glm::lookAt(glm::vec3{ 0.0f }, glm::vec3{ 0.0f, 0.0f, -1.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f });
+    return projection * view;
+}
+
+
+// --- Cases
+// Boxes are kept off the quad's diagonal, along which neither triangle covers whole pixels.
+static bool testHiddenBehind() {
+    return OcclusionCuller::isOccluded(glm::vec3{ 1.0f, -1.0f, -10.0f }, glm::vec3{ 0.5f });
+}
+
+static bool testVisibleBeside() {
+    return !OcclusionCuller::isOccluded(glm::vec3{ 6.0f, 0.0f, -10.0f }, glm::vec3{ 0.5f });
+}
+
+static bool testStraddlingNearPlane() {
+    // The box reaches from far behind the quad to behind the camera
+    return !OcclusionCuller::isOccluded(glm::vec3{ 1.0f, -1.0f, -9.75f }, glm::vec3{ 0.5f, 0.5f, 10.25f });
+}
+
+
+// --- Main function
+int main() {
+    std::vector<Vertex> vertices = quadVertices();
+    std::vector<GLuint> indices = { 0, 1, 2, 0, 2, 3 };
+    std::vector<OccluderMesh> occluders = { OccluderMesh{ &vertices, &indices, glm::mat4{ 1.0f } } };
+
+    // Run with the workers the renderer would start
+    OcclusionCuller::init();
+    OcclusionCuller::rasterize(occluders, viewProjection());
+    struct { const char *name; bool (*run)(); } cases[] = {
+        { "quad hides a box behind it", testHiddenBehind },
+        { "quad does not hide a box beside it", testVisibleBeside },
+        { "box straddling the near plane is kept", testStraddlingNearPlane }
+    };
+    int failed = 0;
+    for (const auto &testCase : cases) {
+        bool passed = testCase.run();
+        std::printf("%s: %s\n", passed ? "PASS" : "FAIL", testCase.name);
+        if (!passed) failed++;
+    }
+    OcclusionCuller::clear();
+    return failed == 0 ? 0 : 1;
+}